@@ -15,74 +15,85 @@
  * - Matheus Klein Schaefer
 */
 
+//in MATH_INLINE builds 3d_math.h includes this file too
+#ifndef THREEDMATH_IMPL
+#define THREEDMATH_IMPL
+
+#include <float.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE__
+	#include <xmmintrin.h>
+#endif
 #include "3d_math.h"
+#include "3d_math_simd.h"
 
 #ifndef M_PI
 	#define M_PI 3.14159265358979323846
 #endif
 
-void math_vec2_zero(vec2 vec)
+MATH_API void math_vec2_zero(vec2 vec)
 {
 	vec[0] = 0.0f;
 	vec[1] = 0.0f;
 }
 
-void math_vec2_min(vec2 result, vec2 vec_a, vec2 vec_b)
+MATH_API void math_vec2_min(vec2 result, vec2 vec_a, vec2 vec_b)
 {
 	result[0] = fminf(vec_a[0], vec_b[0]);
 	result[1] = fminf(vec_a[1], vec_b[1]);
 }
 
-void math_vec2_max(vec2 result, vec2 vec_a, vec2 vec_b)
+MATH_API void math_vec2_max(vec2 result, vec2 vec_a, vec2 vec_b)
 {
 	result[0] = fmaxf(vec_a[0], vec_b[0]);
 	result[1] = fmaxf(vec_a[1], vec_b[1]);
 }
 
-void math_vec2_copy(vec2 result, vec2 original)
+MATH_API void math_vec2_copy(vec2 result, vec2 original)
 {
 	result[0] = original[0];
 	result[1] = original[1];
 }
 
-void math_vec2_add(vec2 result, vec2 vec_a, vec2 vec_b)
+MATH_API void math_vec2_add(vec2 result, vec2 vec_a, vec2 vec_b)
 {
 	result[0] = vec_a[0] + vec_b[0];
 	result[1] = vec_a[1] + vec_b[1];
 }
 
-void math_vec2_sub(vec2 result, vec2 vec_a, vec2 vec_b)
+MATH_API void math_vec2_sub(vec2 result, vec2 vec_a, vec2 vec_b)
 {
 	result[0] = vec_a[0] - vec_b[0];
 	result[1] = vec_a[1] - vec_b[1];
 }
 
-void math_vec2_scale(vec2 result, vec2 vec, float scalar)
+MATH_API void math_vec2_scale(vec2 result, vec2 vec, float scalar)
 {
 	result[0] = vec[0] * scalar;
 	result[1] = vec[1] * scalar;
 }
 
-float math_vec2_dot(vec2 vec_a, vec2 vec_b)
+MATH_API float math_vec2_dot(vec2 vec_a, vec2 vec_b)
 {
 	float dot = vec_a[0] * vec_b[0] + vec_a[1] * vec_b[1];
 	return dot;
 }
 
-float math_vec2_cross(vec2 vec_a, vec2 vec_b)
+MATH_API float math_vec2_cross(vec2 vec_a, vec2 vec_b)
 {
 	float cross = vec_a[0] * vec_b[1] - vec_a[1] * vec_b[0];
 	return cross;
 }
 
-float math_vec2_len(vec2 vec)
+MATH_API float math_vec2_len(vec2 vec)
 {
 	float result = sqrtf(math_vec2_dot(vec, vec));
 	return result;
 }
 
-void math_vec2_normalize(vec2 result, vec2 vec)
+MATH_API void math_vec2_normalize(vec2 result, vec2 vec)
 {
 	float norm = math_vec2_len(vec);
 
@@ -99,89 +110,89 @@ void math_vec2_normalize(vec2 result, vec2 vec)
 	glm_vec2_lerp(vec_a, vec_b, amount, result);
 }*/
 
-void math_vec3_zero(vec3 vec)
+MATH_API void math_vec3_zero(vec3 vec)
 {
 	vec[0] = 0.0f;
 	vec[1] = 0.0f;
 	vec[2] = 0.0f;
 }
 
-void math_vec3_min(vec3 result, vec3 vec_a, vec3 vec_b)
+MATH_API void math_vec3_min(vec3 result, vec3 vec_a, vec3 vec_b)
 {
 	result[0] = fminf(vec_a[0], vec_b[0]);
 	result[1] = fminf(vec_a[1], vec_b[1]);
 	result[2] = fminf(vec_a[2], vec_b[2]);
 }
 
-void math_vec3_max(vec3 result, vec3 vec_a, vec3 vec_b)
+MATH_API void math_vec3_max(vec3 result, vec3 vec_a, vec3 vec_b)
 {
 	result[0] = fmaxf(vec_a[0], vec_b[0]);
 	result[1] = fmaxf(vec_a[1], vec_b[1]);
 	result[2] = fmaxf(vec_a[2], vec_b[2]);
 }
 
-void math_vec3_copy(vec3 result, vec3 original)
+MATH_API void math_vec3_copy(vec3 result, vec3 original)
 {
 	result[0] = original[0];
 	result[1] = original[1];
 	result[2] = original[2];
 }
 
-void math_vec3_negate(vec3 result, vec3 vec)
+MATH_API void math_vec3_negate(vec3 result, vec3 vec)
 {
 	result[0] = -vec[0];
 	result[1] = -vec[1];
 	result[2] = -vec[2];
 }
 
-void math_vec3_add(vec3 result, vec3 vec_a, vec3 vec_b)
+MATH_API void math_vec3_add(vec3 result, vec3 vec_a, vec3 vec_b)
 {
 	result[0] = vec_a[0] + vec_b[0];
 	result[1] = vec_a[1] + vec_b[1];
 	result[2] = vec_a[2] + vec_b[2];
 }
 
-void math_vec3_sub(vec3 result, vec3 vec_a, vec3 vec_b)
+MATH_API void math_vec3_sub(vec3 result, vec3 vec_a, vec3 vec_b)
 {
 	result[0] = vec_a[0] - vec_b[0];
 	result[1] = vec_a[1] - vec_b[1];
 	result[2] = vec_a[2] - vec_b[2];
 }
 
-void math_vec3_div(vec3 result, vec3 vec, float div)
+MATH_API void math_vec3_div(vec3 result, vec3 vec, float div)
 {
 	result[0] = vec[0] / div;
 	result[1] = vec[1] / div;
 	result[2] = vec[2] / div;
 }
 
-void math_vec3_scale(vec3 result, vec3 vec, float scalar)
+MATH_API void math_vec3_scale(vec3 result, vec3 vec, float scalar)
 {
 	result[0] = vec[0] * scalar;
 	result[1] = vec[1] * scalar;
 	result[2] = vec[2] * scalar;
 }
 
-float math_vec3_dot(vec3 vec_a, vec3 vec_b)
+MATH_API float math_vec3_dot(vec3 vec_a, vec3 vec_b)
 {
 	float dot = vec_a[0] * vec_b[0] + vec_a[1] * vec_b[1] + vec_a[2] * vec_b[2];
 	return dot;
 }
 
-void math_vec3_cross(vec3 result, vec3 vec_a, vec3 vec_b)
+MATH_API void math_vec3_cross(vec3 result, vec3 vec_a, vec3 vec_b)
 {
 	result[0] = vec_a[1] * vec_b[2] - vec_a[2] * vec_b[1];
 	result[1] = vec_a[2] * vec_b[0] - vec_a[0] * vec_b[2];
 	result[2] = vec_a[0] * vec_b[1] - vec_a[1] * vec_b[0];
 }
 
-float math_vec3_len(vec3 vec)
+MATH_API float math_vec3_len(vec3 vec)
 {
 	float result = sqrtf(math_vec3_dot(vec, vec));
 	return result;
 }
 
-void math_vec3_normalize(vec3 vec)
+MATH_API void math_vec3_normalize(vec3 vec)
 {
 	float norm = math_vec3_len(vec);
 
@@ -193,7 +204,7 @@ void math_vec3_normalize(vec3 vec)
 	math_vec3_scale(vec, vec, 1.0f / norm);
 }
 
-void math_vec3_normalize_to(vec3 result, vec3 vec)
+MATH_API void math_vec3_normalize_to(vec3 result, vec3 vec)
 {
 	float norm = math_vec3_len(vec);
 
@@ -205,13 +216,20 @@ void math_vec3_normalize_to(vec3 result, vec3 vec)
 	math_vec3_scale(result, vec, 1.0f / norm);
 }
 
+MATH_API void math_vec3_normalize_approx(vec3 result, vec3 vec)
+{
+	float len2 = math_vec3_dot(vec, vec);
+	float inv = len2 >= FLT_MIN ? math_rsqrt(len2) : 0.0f;
+	math_vec3_scale(result, vec, inv);
+}
+
 /*void math_vec3_lerp(vec3 result, vec3 vec_a, vec3 vec_b, float amount)
 {
 	glm_vec3_lerp(vec_a, vec_b, amount, result);
 }*/
 
 
-void math_vec4_zero(vec4 vec)
+MATH_API void math_vec4_zero(vec4 vec)
 {
 	vec[0] = 0.0f;
 	vec[1] = 0.0f;
@@ -219,7 +237,7 @@ void math_vec4_zero(vec4 vec)
 	vec[3] = 0.0f;
 }
 
-void math_vec4_min(vec4 result, vec4 vec_a, vec4 vec_b)
+MATH_API void math_vec4_min(vec4 result, vec4 vec_a, vec4 vec_b)
 {
 	result[0] = fminf(vec_a[0], vec_b[0]);
 	result[1] = fminf(vec_a[1], vec_b[1]);
@@ -227,7 +245,7 @@ void math_vec4_min(vec4 result, vec4 vec_a, vec4 vec_b)
 	result[3] = fminf(vec_a[3], vec_b[3]);
 }
 
-void math_vec4_max(vec4 result, vec4 vec_a, vec4 vec_b)
+MATH_API void math_vec4_max(vec4 result, vec4 vec_a, vec4 vec_b)
 {
 	result[0] = fmaxf(vec_a[0], vec_b[0]);
 	result[1] = fmaxf(vec_a[1], vec_b[1]);
@@ -235,7 +253,7 @@ void math_vec4_max(vec4 result, vec4 vec_a, vec4 vec_b)
 	result[3] = fmaxf(vec_a[3], vec_b[3]);
 }
 
-void math_vec4_copy(vec4 result, vec4 original)
+MATH_API void math_vec4_copy(vec4 result, vec4 original)
 {
 	result[0] = original[0];
 	result[1] = original[1];
@@ -243,7 +261,7 @@ void math_vec4_copy(vec4 result, vec4 original)
 	result[3] = original[3];
 }
 
-void math_vec4_add(vec4 result, vec4 vec_a, vec4 vec_b)
+MATH_API void math_vec4_add(vec4 result, vec4 vec_a, vec4 vec_b)
 {
 	result[0] = vec_a[0] + vec_b[0];
 	result[1] = vec_a[1] + vec_b[1];
@@ -251,7 +269,7 @@ void math_vec4_add(vec4 result, vec4 vec_a, vec4 vec_b)
 	result[3] = vec_a[3] + vec_b[3];
 }
 
-void math_vec4_sub(vec4 result, vec4 vec_a, vec4 vec_b)
+MATH_API void math_vec4_sub(vec4 result, vec4 vec_a, vec4 vec_b)
 {
 	result[0] = vec_a[0] - vec_b[0];
 	result[1] = vec_a[1] - vec_b[1];
@@ -259,7 +277,7 @@ void math_vec4_sub(vec4 result, vec4 vec_a, vec4 vec_b)
 	result[3] = vec_a[3] - vec_b[3];
 }
 
-void math_vec4_div(vec4 result, vec4 vec, float div)
+MATH_API void math_vec4_div(vec4 result, vec4 vec, float div)
 {
 	result[0] = vec[0] / div;
 	result[1] = vec[1] / div;
@@ -267,7 +285,7 @@ void math_vec4_div(vec4 result, vec4 vec, float div)
 	result[3] = vec[3] / div;
 }
 
-void math_vec4_scale(vec4 result, vec4 vec, float scalar)
+MATH_API void math_vec4_scale(vec4 result, vec4 vec, float scalar)
 {
 	result[0] = vec[0] * scalar;
 	result[1] = vec[1] * scalar;
@@ -275,19 +293,19 @@ void math_vec4_scale(vec4 result, vec4 vec, float scalar)
 	result[3] = vec[3] * scalar;
 }
 
-float math_vec4_dot(vec4 vec_a, vec4 vec_b)
+MATH_API float math_vec4_dot(vec4 vec_a, vec4 vec_b)
 {
 	float dot = vec_a[0] * vec_b[0] + vec_a[1] * vec_b[1] + vec_a[2] * vec_b[2] + vec_a[3] * vec_b[3];
 	return dot;
 }
 
-float math_vec4_len(vec4 vec)
+MATH_API float math_vec4_len(vec4 vec)
 {
 	float result = sqrtf(math_vec4_dot(vec, vec));
 	return result;
 }
 
-void math_vec4_normalize(vec4 vec)
+MATH_API void math_vec4_normalize(vec4 vec)
 {
 	float norm = math_vec4_len(vec);
 
@@ -299,50 +317,63 @@ void math_vec4_normalize(vec4 vec)
 	math_vec4_scale(vec, vec, 1.0f / norm);
 }
 
+MATH_API void math_vec4_normalize_approx(vec4 result, vec4 vec)
+{
+	float len2 = math_vec4_dot(vec, vec);
+	float inv = len2 >= FLT_MIN ? math_rsqrt(len2) : 0.0f;
+	math_vec4_scale(result, vec, inv);
+}
+
 /*void math_vec4_lerp(vec4 result, vec4 vec_a, vec4 vec_b, float amount)
 {
 	glm_vec4_lerp(vec_a, vec_b, amount, result);
 }*/
 
-void math_mat4_zero(mat4 mat)
+MATH_API void math_mat4_zero(mat4 mat)
 {
 	for(int i = 0; i < 4; i++)
 		for(int j = 0; j < 4; j++)
 			mat[i][j] = 0.0f;
 }
 
-void math_mat4_identity(mat4 mat)
+MATH_API void math_mat4_identity(mat4 mat)
 {
 	for(int i = 0; i < 4; i++)
 		for(int j = 0; j < 4; j++)
 			mat[i][j] = i == j ? 1.0f : 0.0f;
 }
 
-void math_mat4_add(mat4 result, mat4 mat_a, mat4 mat_b)
+MATH_API void math_mat4_add(mat4 result, mat4 mat_a, mat4 mat_b)
 {
+	MATH_DISPATCH(mat4_add, &result[0][0], &mat_a[0][0], &mat_b[0][0]);
+
 	for(int i = 0; i < 4; ++i)
 	{
 		math_vec4_add(result[i], mat_a[i], mat_b[i]);
 	}
 }
 
-void math_mat4_sub(mat4 result, mat4 mat_a, mat4 mat_b)
+MATH_API void math_mat4_sub(mat4 result, mat4 mat_a, mat4 mat_b)
 {
+	MATH_DISPATCH(mat4_sub, &result[0][0], &mat_a[0][0], &mat_b[0][0]);
+
 	for(int i = 0; i < 4; ++i)
 	{
 		math_vec4_sub(result[i], mat_a[i], mat_b[i]);
 	}
 }
 
-void math_mat4_scale(mat4 result, mat4 mat, float s)
+MATH_API void math_mat4_scale(mat4 result, mat4 mat, float s)
 {
+	MATH_DISPATCH(mat4_scale, &result[0][0], &mat[0][0], s);
+
 	for(int i = 0; i < 4; i++)
 	{
 		math_vec4_scale(result[i], mat[i], s);
 	}
 }
 
-void math_mat4_row(vec4 result, mat4 mat, uint8_t index)
+MATH_API void math_mat4_row(vec4 result, mat4 mat, uint8_t index)
 {
 	for(uint8_t j = 0; j < 4; ++j)
 	{
@@ -350,7 +381,7 @@ void math_mat4_row(vec4 result, mat4 mat, uint8_t index)
 	}
 }
 
-void math_mat4_col(vec4 result, mat4 mat, uint8_t index)
+MATH_API void math_mat4_col(vec4 result, mat4 mat, uint8_t index)
 {
 	for(int j = 0; j < 4; ++j)
 	{
@@ -358,46 +389,81 @@ void math_mat4_col(vec4 result, mat4 mat, uint8_t index)
 	}
 }
 
-void math_mat4_scale_xyz(mat4 mat, float scalar)
+MATH_API void math_mat4_scale_xyz(mat4 mat, float scalar)
 {
 	math_mat4_scale(mat, mat, scalar);
 }
 
-void math_mat4_mul(mat4 result, mat4 mat_a, mat4 mat_b)
+MATH_API void math_mat4_mul(mat4 result, mat4 mat_a, mat4 mat_b)
 {
+	MATH_DISPATCH(mat4_mul, &result[0][0], &mat_a[0][0], &mat_b[0][0]);
+
 	int i, j, k;
+	mat4 tmp; //result may be mat_a or mat_b
 
 	for(i = 0; i < 4; i++)
 	{
 		for(j = 0; j < 4; j++)
 		{
-			result[i][j] = 0.0f;
+			tmp[i][j] = 0.0f;
 			for(k = 0; k < 4; k++)
 			{
-				result[i][j] += mat_a[i][k] * mat_b[k][j];
+				tmp[i][j] += mat_a[i][k] * mat_b[k][j];
 			}
 		}
 	}
+	math_mat4_copy(result, tmp);
 }
 
-void math_mat4_copy(mat4 result, mat4 original)
+MATH_API void math_mat4_copy(mat4 result, mat4 original)
 {
 	for(int i = 0; i < 4; i++)
 		for(int j = 0; j < 4; j++)
 			result[i][j] = original[i][j];
 }
 
-void math_mat4_translate(mat4 mat, vec3 vec)
+MATH_API void math_mat4_translate(mat4 mat, vec3 vec)
 {
 	mat[0][3] += vec[0];
 	mat[1][3] += vec[1];
 	mat[2][3] += vec[2];
 }
 
-void math_mat4_rotate_axis(mat4 mat, vec3 axis, float angle)
+MATH_API void math_sincos(float angle, float *s, float *c)
+{
+	float k = (angle * MATH_SINCOS_2_PI + MATH_ROUND_MAGIC) - MATH_ROUND_MAGIC;
+	int quadrant = (int)k;
+	float r = ((angle - k * MATH_SINCOS_PIO2_1) - k * MATH_SINCOS_PIO2_2) - k * MATH_SINCOS_PIO2_3;
+	float r2 = r * r;
+
+	float ps = r + r * r2 * (MATH_SINCOS_S1 + r2 * (MATH_SINCOS_S2 + r2 * MATH_SINCOS_S3));
+	float pc = 1.0f - 0.5f * r2 + r2 * r2 * (MATH_SINCOS_C1 + r2 * (MATH_SINCOS_C2 + r2 * MATH_SINCOS_C3));
+
+	switch(quadrant & 3)
+	{
+		case 0: *s = ps; *c = pc; break;
+		case 1: *s = pc; *c = -ps; break;
+		case 2: *s = -ps; *c = -pc; break;
+		default: *s = -pc; *c = ps; break;
+	}
+}
+
+static void sincos_scalar(float *s, float *c, const float *angles, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		math_sincos(angles[i], &s[i], &c[i]);
+}
+
+MATH_API void math_sincos_batch(float *s, float *c, const float *angles, size_t count)
+{
+	void (*kernel)(float *, float *, const float *, size_t) = MATH_KERNEL(sincos, sincos_scalar);
+	MATH_BATCH(count, first, n, kernel(s + first, c + first, angles + first, n));
+}
+
+MATH_API void math_mat4_rotate_axis(mat4 mat, vec3 axis, float angle)
 {
-	float c = cos(angle);
-	float s = sin(angle);
+	float s, c;
+	math_sincos(angle, &s, &c);
 	float t = 1.0f - c;
 
 	float x = axis[0];
@@ -425,13 +491,13 @@ void math_mat4_rotate_axis(mat4 mat, vec3 axis, float angle)
 	mat[3][3] = 1.0f;
 }
 
-void math_mat4_rotate_x(mat4 result, mat4 mat, float angle)
+MATH_API void math_mat4_rotate_x(mat4 result, mat4 mat, float angle)
 {
-	float s = sinf(angle);
-	float c = cosf(angle);
+	float s, c;
+	math_sincos(angle, &s, &c);
 
 	mat4 aux;
-	math_mat4_identity(result);
+	math_mat4_identity(aux);
 	aux[1][1] = c;
 	aux[1][2] = s;
 	aux[2][1] = -s;
@@ -440,13 +506,13 @@ void math_mat4_rotate_x(mat4 result, mat4 mat, float angle)
 	math_mat4_mul(result, mat, aux);
 }
 
-void math_mat4_rotate_y(mat4 result, mat4 mat, float angle)
+MATH_API void math_mat4_rotate_y(mat4 result, mat4 mat, float angle)
 {
-	float s = sinf(angle);
-	float c = cosf(angle);
+	float s, c;
+	math_sincos(angle, &s, &c);
 
 	mat4 aux;
-	math_mat4_identity(result);
+	math_mat4_identity(aux);
 	aux[0][0] = c;
 	aux[0][2] = -s;
 	aux[2][0] = s;
@@ -455,13 +521,13 @@ void math_mat4_rotate_y(mat4 result, mat4 mat, float angle)
 	math_mat4_mul(result, mat, aux);
 }
 
-void math_mat4_rotate_z(mat4 result, mat4 mat, float angle)
+MATH_API void math_mat4_rotate_z(mat4 result, mat4 mat, float angle)
 {
-	float s = sinf(angle);
-	float c = cosf(angle);
+	float s, c;
+	math_sincos(angle, &s, &c);
 
 	mat4 aux;
-	math_mat4_identity(result);
+	math_mat4_identity(aux);
 	aux[0][0] = c;
 	aux[0][1] = s;
 	aux[1][0] = -s;
@@ -470,98 +536,2148 @@ void math_mat4_rotate_z(mat4 result, mat4 mat, float angle)
 	math_mat4_mul(result, mat, aux);
 }
 
-void math_quat_zero(quat qt)
+MATH_API void math_mat4_transpose(mat4 result, mat4 mat)
 {
-	qt[0] = qt[1] = qt[2] = qt[3] = 0.0f;
+	mat4 aux;
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 4; j++)
+			aux[i][j] = mat[j][i];
+	math_mat4_copy(result, aux);
+}
+
+static void mat4_inverse_scalar(float *result, const float *m)
+{
+	float inv[16];
+
+	//cofactors, works the same for row or column-major storage
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15]
+		+ m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15]
+		- m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15]
+		+ m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14]
+		- m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15]
+		- m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15]
+		+ m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15]
+		- m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14]
+		+ m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15]
+		+ m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15]
+		- m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15]
+		+ m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14]
+		- m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11]
+		- m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11]
+		+ m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11]
+		- m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10]
+		+ m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if(det == 0.0f)
+	{
+		for(int i = 0; i < 16; i++)
+			result[i] = 0.0f;
+		return;
+	}
+
+	det = 1.0f / det;
+	for(int i = 0; i < 16; i++)
+		result[i] = inv[i] * det;
 }
 
-void math_quat_identity(quat qt)
+/*
+ * Rows of the inverse of the upper 3x3 (columns c0, c1, c2) are
+ * c1 x c2, c2 x c0 and c0 x c1 over the determinant.
+ * Returns 0 if singular.
+*/
+//stride is the distance between columns, 4 for mat4 and 3 for mat4x3
+static int mat4_inverse_rows3(vec3 rows[3], const float *m, int stride)
 {
-	qt[0] = qt[1] = qt[2] = 0.0f;
-	qt[3] = 1.0f;
+	vec3 c0 = {m[0], m[1], m[2]};
+	vec3 c1 = {m[stride], m[stride + 1], m[stride + 2]};
+	vec3 c2 = {m[2 * stride], m[2 * stride + 1], m[2 * stride + 2]};
+
+	math_vec3_cross(rows[0], c1, c2);
+	math_vec3_cross(rows[1], c2, c0);
+	math_vec3_cross(rows[2], c0, c1);
+
+	float det = math_vec3_dot(c0, rows[0]);
+	if(det == 0.0f)
+		return 0;
+
+	det = 1.0f / det;
+	for(int i = 0; i < 3; i++)
+		math_vec3_scale(rows[i], rows[i], det);
+	return 1;
 }
 
-void math_quat_add(quat result, quat qt_a, quat qt_b)
+static void mat4_inverse_affine_scalar(float *result, const float *m)
 {
-	math_vec4_add(result, qt_a, qt_b);
+	vec3 rows[3];
+	vec3 t = {m[12], m[13], m[14]};
+
+	if(!mat4_inverse_rows3(rows, m, 4))
+	{
+		for(int i = 0; i < 16; i++)
+			result[i] = 0.0f;
+		return;
+	}
+
+	for(int i = 0; i < 3; i++)
+	{
+		for(int j = 0; j < 3; j++)
+			result[j * 4 + i] = rows[i][j];
+		result[12 + i] = -math_vec3_dot(rows[i], t);
+	}
+	result[3] = result[7] = result[11] = 0.0f;
+	result[15] = 1.0f;
 }
 
-void math_quat_sub(quat result, quat qt_a, quat qt_b)
+static void mat4_normal_matrix_scalar(float *result, const float *m)
 {
-	math_vec4_sub(result, qt_a, qt_b);
+	vec3 rows[3];
+
+	if(!mat4_inverse_rows3(rows, m, 4))
+	{
+		for(int i = 0; i < 16; i++)
+			result[i] = 0.0f;
+		return;
+	}
+
+	//transposed inverse: rows of the inverse become columns
+	for(int i = 0; i < 3; i++)
+	{
+		for(int j = 0; j < 3; j++)
+			result[i * 4 + j] = rows[i][j];
+		result[i * 4 + 3] = 0.0f;
+	}
+	result[12] = result[13] = result[14] = 0.0f;
+	result[15] = 1.0f;
 }
 
-void math_quat_scale(quat result, quat qt, float scalar)
+MATH_API void math_mat4_inverse(mat4 result, mat4 mat)
 {
-	result[0] = qt[0] * scalar;
-	result[1] = qt[1] * scalar;
-	result[2] = qt[2] * scalar;
-	result[3] = qt[3] * scalar;
+	MATH_DISPATCH(mat4_inverse, &result[0][0], &mat[0][0]);
+	mat4_inverse_scalar(&result[0][0], &mat[0][0]);
 }
 
-void math_quat_norm(quat result, quat qt)
+MATH_API void math_mat4_inverse_affine(mat4 result, mat4 mat)
 {
-	float k = 1.0f / math_vec4_len(qt); //quat is literally vec4 here
-	math_quat_scale(result, qt, k);
+	MATH_DISPATCH(mat4_inverse_affine, &result[0][0], &mat[0][0]);
+	mat4_inverse_affine_scalar(&result[0][0], &mat[0][0]);
 }
 
-void math_lookat(mat4 result, vec3 position, vec3 target, vec3 up)
+MATH_API void math_mat4_inverse_transpose(mat4 result, mat4 mat)
 {
-	vec3 f;
-	vec3 u;
-	vec3 s;
+	math_mat4_inverse(result, mat);
+	math_mat4_transpose(result, result);
+}
 
-	math_vec3_sub(f, target, position);
-	math_vec3_normalize(f);
+MATH_API void math_mat4_normal_matrix(mat4 result, mat4 model)
+{
+	MATH_DISPATCH(mat4_normal_matrix, &result[0][0], &model[0][0]);
+	mat4_normal_matrix_scalar(&result[0][0], &model[0][0]);
+}
 
-	math_vec3_cross(s, f, up);
-	math_vec3_normalize(s);
-	math_vec3_cross(u, s, f);
+static void transform_aos_scalar
+(
+	float *result,
+	size_t result_stride,
+	const float *mat,
+	const float *points,
+	size_t stride,
+	size_t count,
+	int translate
+)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *p = points + i * stride;
+		float *r = result + i * result_stride;
+		float x = p[0], y = p[1], z = p[2];
 
-	result[0][0] = s[0];
-	result[0][1] = u[0];
-	result[0][2] =-f[0];
-	result[1][0] = s[1];
-	result[1][1] = u[1];
-	result[1][2] =-f[1];
-	result[2][0] = s[2];
-	result[2][1] = u[2];
-	result[2][2] =-f[2];
-	result[3][0] = -math_vec3_dot(s, position);
-	result[3][1] = -math_vec3_dot(u, position);
-	result[3][2] = math_vec3_dot(f, position);
-	result[0][3] = result[1][3] = result[2][3] = 0.0f;
+		for(int j = 0; j < 3; j++)
+		{
+			float v = mat[j] * x + mat[4 + j] * y + mat[8 + j] * z;
+			r[j] = translate ? v + mat[12 + j] : v;
+		}
+	}
+}
+
+static void transform_soa_scalar
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	const float *mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count,
+	int translate
+)
+{
+	float tx = translate ? mat[12] : 0.0f;
+	float ty = translate ? mat[13] : 0.0f;
+	float tz = translate ? mat[14] : 0.0f;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		result_x[i] = mat[0] * px + mat[4] * py + mat[8] * pz + tx;
+		result_y[i] = mat[1] * px + mat[5] * py + mat[9] * pz + ty;
+		result_z[i] = mat[2] * px + mat[6] * py + mat[10] * pz + tz;
+	}
+}
+
+static void transform_aos
+(
+	float *result,
+	size_t result_stride,
+	mat4 mat,
+	const float *points,
+	size_t stride,
+	size_t count,
+	int translate
+)
+{
+	void (*kernel)(float *, size_t, const float *, const float *, size_t, size_t, int);
+	kernel = MATH_KERNEL(transform_aos, transform_aos_scalar);
+
+	MATH_BATCH(count, first, n, kernel(result + first * result_stride, result_stride,
+		&mat[0][0], points + first * stride, stride, n, translate));
+}
+
+static void transform_soa
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	mat4 mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count,
+	int translate
+)
+{
+	void (*kernel)(float *, float *, float *, const float *, const float *, const float *, const float *, size_t, int);
+	kernel = MATH_KERNEL(transform_soa, transform_soa_scalar);
+
+	MATH_BATCH(count, first, n, kernel(result_x + first, result_y + first, result_z + first,
+		&mat[0][0], x + first, y + first, z + first, n, translate));
+}
+
+MATH_API void math_mat4_transform_points
+(
+	float *result,
+	size_t result_stride,
+	mat4 mat,
+	const float *points,
+	size_t stride,
+	size_t count
+)
+{
+	transform_aos(result, result_stride, mat, points, stride, count, 1);
+}
+
+MATH_API void math_mat4_transform_dirs
+(
+	float *result,
+	size_t result_stride,
+	mat4 mat,
+	const float *dirs,
+	size_t stride,
+	size_t count
+)
+{
+	transform_aos(result, result_stride, mat, dirs, stride, count, 0);
+}
+
+MATH_API void math_mat4_transform_points_soa
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	mat4 mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count
+)
+{
+	transform_soa(result_x, result_y, result_z, mat, x, y, z, count, 1);
+}
+
+MATH_API void math_mat4_transform_dirs_soa
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	mat4 mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count
+)
+{
+	transform_soa(result_x, result_y, result_z, mat, x, y, z, count, 0);
+}
+
+static void mat4_batch(void (*kernel)(float *, const float *), mat4 *result, mat4 *mats, size_t count)
+{
+	MATH_BATCH(count, first, n,
+		for(size_t i = first; i < first + n; i++)
+			kernel(&result[i][0][0], &mats[i][0][0]));
+}
+
+MATH_API void math_mat4_inverse_batch(mat4 *result, mat4 *mats, size_t count)
+{
+	mat4_batch(MATH_KERNEL(mat4_inverse, mat4_inverse_scalar), result, mats, count);
+}
+
+MATH_API void math_mat4_inverse_affine_batch(mat4 *result, mat4 *mats, size_t count)
+{
+	mat4_batch(MATH_KERNEL(mat4_inverse_affine, mat4_inverse_affine_scalar), result, mats, count);
+}
+
+MATH_API void math_mat4_normal_matrix_batch(mat4 *result, mat4 *models, size_t count)
+{
+	mat4_batch(MATH_KERNEL(mat4_normal_matrix, mat4_normal_matrix_scalar), result, models, count);
+}
+
+static void normalize_approx_aos_scalar(float *result, size_t result_stride, const float *vecs, size_t stride, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *v = vecs + i * stride;
+		float *r = result + i * result_stride;
+		float len2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+		float inv = len2 >= FLT_MIN ? math_rsqrt(len2) : 0.0f;
+		r[0] = v[0] * inv;
+		r[1] = v[1] * inv;
+		r[2] = v[2] * inv;
+	}
+}
+
+MATH_API void math_vec3_normalize_approx_batch
+(
+	float *result,
+	size_t result_stride,
+	const float *vecs,
+	size_t stride,
+	size_t count
+)
+{
+	void (*kernel)(float *, size_t, const float *, size_t, size_t);
+	kernel = MATH_KERNEL(normalize_approx_aos, normalize_approx_aos_scalar);
+	MATH_BATCH(count, first, n,
+		kernel(result + first * result_stride, result_stride, vecs + first * stride, stride, n));
+}
+
+MATH_API void math_mat4x3_identity(mat4x3 mat)
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 3; j++)
+			mat[i][j] = i == j ? 1.0f : 0.0f;
+}
+
+MATH_API void math_mat4x3_copy(mat4x3 result, mat4x3 original)
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 3; j++)
+			result[i][j] = original[i][j];
+}
+
+MATH_API void math_mat4x3_from_mat4(mat4x3 result, mat4 mat)
+{
+	for(int i = 0; i < 4; i++)
+		for(int j = 0; j < 3; j++)
+			result[i][j] = mat[i][j];
+}
+
+MATH_API void math_mat4x3_to_mat4(mat4 result, mat4x3 mat)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 3; j++)
+			result[i][j] = mat[i][j];
+		result[i][3] = 0.0f;
+	}
 	result[3][3] = 1.0f;
 }
 
-void math_perspective(mat4 result, float fov, float aspect, float near, float far)
+static void mat4x3_mul_scalar(float *result, const float *mat_a, const float *mat_b)
 {
-	float f;
-	float fn;
+	float r[12];
 
-	math_mat4_zero(result);
+	//math_mat4_mul with the implicit (0, 0, 0, 1) row: 36 multiplies instead of 64
+	for(int j = 0; j < 3; j++)
+	{
+		float b0 = mat_b[j];
+		float b1 = mat_b[3 + j];
+		float b2 = mat_b[6 + j];
+		for(int i = 0; i < 4; i++)
+			r[3 * i + j] = mat_a[3 * i] * b0 + mat_a[3 * i + 1] * b1 + mat_a[3 * i + 2] * b2;
+		r[9 + j] += mat_b[9 + j];
+	}
+	for(int i = 0; i < 12; i++)
+		result[i] = r[i];
+}
 
-	f = 1.0f / tanf(fov * 0.5f);
-	fn = 1.0f / (near - far);
+static void mat4x3_inverse_scalar(float *result, const float *mat)
+{
+	vec3 rows[3];
+	vec3 t = {mat[9], mat[10], mat[11]};
 
-	result[0][0] = f / aspect;
-	result[1][1] = f;
-	result[2][2] = far * fn;
-	result[2][3] = -1.0f;
-	result[3][2] = near * far * fn;
+	if(!mat4_inverse_rows3(rows, mat, 3))
+	{
+		for(int i = 0; i < 12; i++)
+			result[i] = 0.0f;
+		return;
+	}
+
+	for(int i = 0; i < 3; i++)
+	{
+		for(int j = 0; j < 3; j++)
+			result[3 * j + i] = rows[i][j];
+		result[9 + i] = -math_vec3_dot(rows[i], t);
+	}
 }
 
-float deg_to_rad(float deg)
+MATH_API void math_mat4x3_mul(mat4x3 result, mat4x3 mat_a, mat4x3 mat_b)
 {
-	return deg * (M_PI / 180.0f);
+	MATH_DISPATCH(mat4x3_mul, &result[0][0], &mat_a[0][0], &mat_b[0][0]);
+	mat4x3_mul_scalar(&result[0][0], &mat_a[0][0], &mat_b[0][0]);
 }
 
-float rad_to_deg(float rad)
+MATH_API void math_mat4x3_inverse(mat4x3 result, mat4x3 mat)
 {
-	return rad * (180.0f / M_PI);
+	MATH_DISPATCH(mat4x3_inverse, &result[0][0], &mat[0][0]);
+	mat4x3_inverse_scalar(&result[0][0], &mat[0][0]);
 }
 
-float math_lerp(float v0, float v1, float t)
+MATH_API void math_mat4x3_compose(mat4x3 result, vec3 translation, quat rotation, vec3 scale)
 {
-	return (1 - t) * v0 + t * v1;
+	mat4 r;
+	math_quat_to_mat4(r, rotation);
+
+	for(int i = 0; i < 3; i++)
+		for(int j = 0; j < 3; j++)
+			result[i][j] = r[i][j] * scale[i];
+	for(int j = 0; j < 3; j++)
+		result[3][j] = translation[j];
+}
+
+MATH_API void math_mat4x3_transform_point(vec3 result, mat4x3 mat, vec3 point)
+{
+	vec3 r;
+	for(int j = 0; j < 3; j++)
+		r[j] = mat[0][j] * point[0] + mat[1][j] * point[1] + mat[2][j] * point[2] + mat[3][j];
+	math_vec3_copy(result, r);
+}
+
+MATH_API void math_mat4x3_transform_dir(vec3 result, mat4x3 mat, vec3 dir)
+{
+	vec3 r;
+	for(int j = 0; j < 3; j++)
+		r[j] = mat[0][j] * dir[0] + mat[1][j] * dir[1] + mat[2][j] * dir[2];
+	math_vec3_copy(result, r);
+}
+
+MATH_API void math_mat4x3_mul_batch(mat4x3 *result, mat4x3 *mat_a, mat4x3 *mat_b, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *) = MATH_KERNEL(mat4x3_mul, mat4x3_mul_scalar);
+
+	MATH_BATCH(count, first, n,
+		for(size_t i = first; i < first + n; i++)
+			kernel(&result[i][0][0], &mat_a[i][0][0], &mat_b[i][0][0]));
+}
+
+MATH_API void math_mat4x3_inverse_batch(mat4x3 *result, mat4x3 *mats, size_t count)
+{
+	void (*kernel)(float *, const float *) = MATH_KERNEL(mat4x3_inverse, mat4x3_inverse_scalar);
+
+	MATH_BATCH(count, first, n,
+		for(size_t i = first; i < first + n; i++)
+			kernel(&result[i][0][0], &mats[i][0][0]));
+}
+
+MATH_API void math_mat4x3_to_mat4_batch(mat4 *result, mat4x3 *mats, size_t count)
+{
+	MATH_BATCH(count, first, n,
+		for(size_t i = first; i < first + n; i++)
+			math_mat4x3_to_mat4(result[i], mats[i]));
+}
+
+static void stream_add_scalar(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		result[i] = a[i] + b[i];
+}
+
+static void stream_sub_scalar(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		result[i] = a[i] - b[i];
+}
+
+static void stream_scale_scalar(float *result, const float *a, float s, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		result[i] = a[i] * s;
+}
+
+static void stream_sqrt_scalar(float *result, const float *a, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		result[i] = sqrtf(a[i]);
+}
+
+static void stream_dot_scalar(float *result, const float *a, size_t capacity_a, const float *b, size_t capacity_b, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		float dot = 0.0f;
+		for(int k = 0; k < components; k++)
+			dot += a[k * capacity_a + i] * b[k * capacity_b + i];
+		result[i] = dot;
+	}
+}
+
+static void stream_cross_scalar(float *result, size_t capacity_r, const float *a, size_t capacity_a, const float *b, size_t capacity_b, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		vec3 va = {a[i], a[capacity_a + i], a[2 * capacity_a + i]};
+		vec3 vb = {b[i], b[capacity_b + i], b[2 * capacity_b + i]};
+		vec3 r;
+		math_vec3_cross(r, va, vb);
+		result[i] = r[0];
+		result[capacity_r + i] = r[1];
+		result[2 * capacity_r + i] = r[2];
+	}
+}
+
+static void stream_normalize_scalar(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		float len = 0.0f;
+		for(int k = 0; k < components; k++)
+			len += a[k * capacity_a + i] * a[k * capacity_a + i];
+		len = sqrtf(len);
+		float inv = len == 0.0f ? 0.0f : 1.0f / len;
+		for(int k = 0; k < components; k++)
+			result[k * capacity_r + i] = a[k * capacity_a + i] * inv;
+	}
+}
+
+static void stream_normalize_approx_scalar(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		float len2 = 0.0f;
+		for(int k = 0; k < components; k++)
+			len2 += a[k * capacity_a + i] * a[k * capacity_a + i];
+		float inv = len2 >= FLT_MIN ? math_rsqrt(len2) : 0.0f;
+		for(int k = 0; k < components; k++)
+			result[k * capacity_r + i] = a[k * capacity_a + i] * inv;
+	}
+}
+
+//padded element count, what the kernels run over
+static size_t stream_padded(size_t count)
+{
+	return (count + MATH_STREAM_WIDTH - 1) / MATH_STREAM_WIDTH * MATH_STREAM_WIDTH;
+}
+
+//one allocation for all components, component k at base + k * capacity
+static float *stream_alloc(size_t *capacity, int components)
+{
+	*capacity = stream_padded(*capacity);
+	if(*capacity == 0)
+		*capacity = MATH_STREAM_WIDTH;
+
+	size_t size = *capacity * components * sizeof(float);
+	float *base = aligned_alloc(32, size);
+	if(base != NULL)
+		memset(base, 0, size);
+	return base;
 }
+
+static int stream_from_aos(float *base, size_t capacity, int components, const float *vecs, size_t stride, size_t count)
+{
+	if(count > capacity)
+		return 0;
+
+	for(size_t i = 0; i < count; i++)
+		for(int k = 0; k < components; k++)
+			base[k * capacity + i] = vecs[i * stride + k];
+
+	//keep the padding zeroed, the kernels run over it
+	for(int k = 0; k < components; k++)
+		for(size_t i = count; i < stream_padded(count); i++)
+			base[k * capacity + i] = 0.0f;
+	return 1;
+}
+
+static void stream_to_aos(float *vecs, size_t stride, const float *base, size_t capacity, int components, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		for(int k = 0; k < components; k++)
+			vecs[i * stride + k] = base[k * capacity + i];
+}
+
+static void stream_binary(void (*kernel)(float *, const float *, const float *, size_t), float *const result[], float *const a[], float *const b[], int components, size_t count)
+{
+	size_t padded = stream_padded(count);
+	for(int k = 0; k < components; k++)
+		MATH_BATCH(padded, first, n, kernel(result[k] + first, a[k] + first, b[k] + first, n));
+}
+
+static void stream_scale(float *const result[], float *const a[], float s, int components, size_t count)
+{
+	void (*kernel)(float *, const float *, float, size_t) = MATH_KERNEL(stream_scale, stream_scale_scalar);
+	size_t padded = stream_padded(count);
+	for(int k = 0; k < components; k++)
+		MATH_BATCH(padded, first, n, kernel(result[k] + first, a[k] + first, s, n));
+}
+
+//result is a plain array of count floats, the unpadded tail goes scalar
+static void stream_dot(float *result, const float *a, size_t capacity_a, const float *b, size_t capacity_b, int components, size_t count)
+{
+	void (*kernel)(float *, const float *, size_t, const float *, size_t, int, size_t);
+	kernel = MATH_KERNEL(stream_dot, stream_dot_scalar);
+	size_t body = count / MATH_STREAM_WIDTH * MATH_STREAM_WIDTH;
+	MATH_BATCH(body, first, n,
+		kernel(result + first, a + first, capacity_a, b + first, capacity_b, components, n));
+	stream_dot_scalar(result + body, a + body, capacity_a, b + body, capacity_b, components, count - body);
+}
+
+static void stream_len(float *result, const float *a, size_t capacity, int components, size_t count)
+{
+	void (*root)(float *, const float *, size_t) = MATH_KERNEL(stream_sqrt, stream_sqrt_scalar);
+	size_t body = count / MATH_STREAM_WIDTH * MATH_STREAM_WIDTH;
+	stream_dot(result, a, capacity, a, capacity, components, count);
+	MATH_BATCH(body, first, n, root(result + first, result + first, n));
+	stream_sqrt_scalar(result + body, result + body, count - body);
+}
+
+static void stream_normalize(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t count, int approx)
+{
+	void (*kernel)(float *, size_t, const float *, size_t, int, size_t);
+	if(approx)
+		kernel = MATH_KERNEL(stream_normalize_approx, stream_normalize_approx_scalar);
+	else
+		kernel = MATH_KERNEL(stream_normalize, stream_normalize_scalar);
+	MATH_BATCH(stream_padded(count), first, n,
+		kernel(result + first, capacity_r, a + first, capacity_a, components, n));
+}
+
+MATH_API int math_vec3_stream_alloc(vec3_stream *stream, size_t capacity)
+{
+	stream->x = stream_alloc(&capacity, 3);
+	if(stream->x == NULL)
+	{
+		stream->y = stream->z = NULL;
+		stream->count = stream->capacity = 0;
+		return 0;
+	}
+	stream->y = stream->x + capacity;
+	stream->z = stream->y + capacity;
+	stream->count = 0;
+	stream->capacity = capacity;
+	return 1;
+}
+
+MATH_API void math_vec3_stream_free(vec3_stream *stream)
+{
+	free(stream->x);
+	stream->x = stream->y = stream->z = NULL;
+	stream->count = stream->capacity = 0;
+}
+
+MATH_API int math_vec3_stream_from_aos(vec3_stream *stream, const float *vecs, size_t stride, size_t count)
+{
+	if(!stream_from_aos(stream->x, stream->capacity, 3, vecs, stride, count))
+		return 0;
+	stream->count = count;
+	return 1;
+}
+
+MATH_API void math_vec3_stream_to_aos(float *vecs, size_t stride, vec3_stream *stream)
+{
+	stream_to_aos(vecs, stride, stream->x, stream->capacity, 3, stream->count);
+}
+
+MATH_API void math_vec3_stream_add(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b)
+{
+	float *const r[3] = {result->x, result->y, result->z};
+	float *const a[3] = {stream_a->x, stream_a->y, stream_a->z};
+	float *const b[3] = {stream_b->x, stream_b->y, stream_b->z};
+	stream_binary(MATH_KERNEL(stream_add, stream_add_scalar), r, a, b, 3, stream_a->count);
+	result->count = stream_a->count;
+}
+
+MATH_API void math_vec3_stream_sub(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b)
+{
+	float *const r[3] = {result->x, result->y, result->z};
+	float *const a[3] = {stream_a->x, stream_a->y, stream_a->z};
+	float *const b[3] = {stream_b->x, stream_b->y, stream_b->z};
+	stream_binary(MATH_KERNEL(stream_sub, stream_sub_scalar), r, a, b, 3, stream_a->count);
+	result->count = stream_a->count;
+}
+
+MATH_API void math_vec3_stream_scale(vec3_stream *result, vec3_stream *stream, float scalar)
+{
+	float *const r[3] = {result->x, result->y, result->z};
+	float *const a[3] = {stream->x, stream->y, stream->z};
+	stream_scale(r, a, scalar, 3, stream->count);
+	result->count = stream->count;
+}
+
+MATH_API void math_vec3_stream_dot(float *result, vec3_stream *stream_a, vec3_stream *stream_b)
+{
+	stream_dot(result, stream_a->x, stream_a->capacity, stream_b->x, stream_b->capacity, 3, stream_a->count);
+}
+
+MATH_API void math_vec3_stream_cross(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b)
+{
+	void (*kernel)(float *, size_t, const float *, size_t, const float *, size_t, size_t);
+	kernel = MATH_KERNEL(stream_cross, stream_cross_scalar);
+	MATH_BATCH(stream_padded(stream_a->count), first, n,
+		kernel(result->x + first, result->capacity, stream_a->x + first, stream_a->capacity,
+			stream_b->x + first, stream_b->capacity, n));
+	result->count = stream_a->count;
+}
+
+MATH_API void math_vec3_stream_len(float *result, vec3_stream *stream)
+{
+	stream_len(result, stream->x, stream->capacity, 3, stream->count);
+}
+
+MATH_API void math_vec3_stream_normalize(vec3_stream *result, vec3_stream *stream)
+{
+	stream_normalize(result->x, result->capacity, stream->x, stream->capacity, 3, stream->count, 0);
+	result->count = stream->count;
+}
+
+MATH_API void math_vec3_stream_normalize_approx(vec3_stream *result, vec3_stream *stream)
+{
+	stream_normalize(result->x, result->capacity, stream->x, stream->capacity, 3, stream->count, 1);
+	result->count = stream->count;
+}
+
+MATH_API int math_vec4_stream_alloc(vec4_stream *stream, size_t capacity)
+{
+	stream->x = stream_alloc(&capacity, 4);
+	if(stream->x == NULL)
+	{
+		stream->y = stream->z = stream->w = NULL;
+		stream->count = stream->capacity = 0;
+		return 0;
+	}
+	stream->y = stream->x + capacity;
+	stream->z = stream->y + capacity;
+	stream->w = stream->z + capacity;
+	stream->count = 0;
+	stream->capacity = capacity;
+	return 1;
+}
+
+MATH_API void math_vec4_stream_free(vec4_stream *stream)
+{
+	free(stream->x);
+	stream->x = stream->y = stream->z = stream->w = NULL;
+	stream->count = stream->capacity = 0;
+}
+
+MATH_API int math_vec4_stream_from_aos(vec4_stream *stream, const float *vecs, size_t stride, size_t count)
+{
+	if(!stream_from_aos(stream->x, stream->capacity, 4, vecs, stride, count))
+		return 0;
+	stream->count = count;
+	return 1;
+}
+
+MATH_API void math_vec4_stream_to_aos(float *vecs, size_t stride, vec4_stream *stream)
+{
+	stream_to_aos(vecs, stride, stream->x, stream->capacity, 4, stream->count);
+}
+
+MATH_API void math_vec4_stream_add(vec4_stream *result, vec4_stream *stream_a, vec4_stream *stream_b)
+{
+	float *const r[4] = {result->x, result->y, result->z, result->w};
+	float *const a[4] = {stream_a->x, stream_a->y, stream_a->z, stream_a->w};
+	float *const b[4] = {stream_b->x, stream_b->y, stream_b->z, stream_b->w};
+	stream_binary(MATH_KERNEL(stream_add, stream_add_scalar), r, a, b, 4, stream_a->count);
+	result->count = stream_a->count;
+}
+
+MATH_API void math_vec4_stream_sub(vec4_stream *result, vec4_stream *stream_a, vec4_stream *stream_b)
+{
+	float *const r[4] = {result->x, result->y, result->z, result->w};
+	float *const a[4] = {stream_a->x, stream_a->y, stream_a->z, stream_a->w};
+	float *const b[4] = {stream_b->x, stream_b->y, stream_b->z, stream_b->w};
+	stream_binary(MATH_KERNEL(stream_sub, stream_sub_scalar), r, a, b, 4, stream_a->count);
+	result->count = stream_a->count;
+}
+
+MATH_API void math_vec4_stream_scale(vec4_stream *result, vec4_stream *stream, float scalar)
+{
+	float *const r[4] = {result->x, result->y, result->z, result->w};
+	float *const a[4] = {stream->x, stream->y, stream->z, stream->w};
+	stream_scale(r, a, scalar, 4, stream->count);
+	result->count = stream->count;
+}
+
+MATH_API void math_vec4_stream_dot(float *result, vec4_stream *stream_a, vec4_stream *stream_b)
+{
+	stream_dot(result, stream_a->x, stream_a->capacity, stream_b->x, stream_b->capacity, 4, stream_a->count);
+}
+
+MATH_API void math_vec4_stream_len(float *result, vec4_stream *stream)
+{
+	stream_len(result, stream->x, stream->capacity, 4, stream->count);
+}
+
+MATH_API void math_vec4_stream_normalize(vec4_stream *result, vec4_stream *stream)
+{
+	stream_normalize(result->x, result->capacity, stream->x, stream->capacity, 4, stream->count, 0);
+	result->count = stream->count;
+}
+
+MATH_API void math_vec4_stream_normalize_approx(vec4_stream *result, vec4_stream *stream)
+{
+	stream_normalize(result->x, result->capacity, stream->x, stream->capacity, 4, stream->count, 1);
+	result->count = stream->count;
+}
+
+static uint32_t float_bits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+MATH_API uint16_t math_float_to_half(float value)
+{
+	uint32_t x = float_bits(value);
+	uint32_t sign = (x >> 16) & 0x8000;
+	x &= 0x7fffffff;
+
+	if(x >= 0x7f800000) //inf, nan stays nan (quiet)
+		return sign | (x > 0x7f800000 ? 0x7e00 | ((x >> 13) & 0x3ff) : 0x7c00);
+	if(x >= 0x477ff000) //rounds past 65504
+		return sign | 0x7c00;
+	if(x < 0x38800000) //half subnormal, let the float add do the rounding
+		return sign | (float_bits(bits_float(x) + 0.5f) - 0x3f000000);
+
+	//rebias the exponent, round to nearest even
+	x += 0xc8000fff + ((x >> 13) & 1);
+	return sign | (x >> 13);
+}
+
+MATH_API float math_half_to_float(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	if(exponent == 0x1f)
+		return bits_float(sign | 0x7f800000 | (mantissa << 13));
+	if(exponent == 0) //zero or subnormal, exact in float
+		return bits_float(sign) + (sign ? -1.0f : 1.0f) * (float)mantissa * (1.0f / 16777216.0f);
+	return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+MATH_API int16_t math_snorm16(float value)
+{
+	//nan ends up as -1, same as the kernels
+	value = value > -1.0f ? value : -1.0f;
+	value = value < 1.0f ? value : 1.0f;
+	return (int16_t)((value * 32767.0f + MATH_ROUND_MAGIC) - MATH_ROUND_MAGIC);
+}
+
+MATH_API void math_octahedral_encode(int16_t result[2], vec3 normal)
+{
+	float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	float inv = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+	float x = normal[0] * inv;
+	float y = normal[1] * inv;
+
+	//lower hemisphere folds over the diagonals
+	if(normal[2] < 0.0f)
+	{
+		float fold_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float fold_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = fold_x;
+		y = fold_y;
+	}
+
+	result[0] = math_snorm16(x);
+	result[1] = math_snorm16(y);
+}
+
+MATH_API void math_octahedral_decode(vec3 result, const int16_t packed[2])
+{
+	float x = packed[0] * (1.0f / 32767.0f);
+	float y = packed[1] * (1.0f / 32767.0f);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = z < 0.0f ? -z : 0.0f;
+
+	result[0] = x + (x >= 0.0f ? -t : t);
+	result[1] = y + (y >= 0.0f ? -t : t);
+	result[2] = z;
+	math_vec3_normalize(result);
+}
+
+static void float_to_half_scalar(uint16_t *result, const float *values, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		result[i] = math_float_to_half(values[i]);
+}
+
+static void octahedral_encode_scalar(int16_t *result, const float *normals, size_t stride, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *n = normals + i * stride;
+		math_octahedral_encode(result + i * 2, (vec3){n[0], n[1], n[2]});
+	}
+}
+
+static void snorm16_scalar(int16_t *result, const float *values, float scale, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		result[i] = math_snorm16(values[i] * scale);
+}
+
+MATH_API void math_float_to_half_batch(uint16_t *result, const float *values, size_t count)
+{
+	void (*kernel)(uint16_t *, const float *, size_t) = MATH_KERNEL(float_to_half, float_to_half_scalar);
+	MATH_BATCH(count, first, n, kernel(result + first, values + first, n));
+}
+
+MATH_API void math_octahedral_encode_batch(int16_t *result, const float *normals, size_t stride, size_t count)
+{
+	void (*kernel)(int16_t *, const float *, size_t, size_t) = MATH_KERNEL(octahedral_encode, octahedral_encode_scalar);
+	MATH_BATCH(count, first, n, kernel(result + first * 2, normals + first * stride, stride, n));
+}
+
+//a block at a time through small SoA buffers, so the kernels see contiguous data
+static void pack_vertices_block
+(
+	vertex_packed *result,
+	const float *positions,
+	const float *normals,
+	const float *texcoords,
+	size_t stride,
+	float uv_scale,
+	size_t count
+)
+{
+	void (*to_half)(uint16_t *, const float *, size_t) = MATH_KERNEL(float_to_half, float_to_half_scalar);
+	void (*encode)(int16_t *, const float *, size_t, size_t) = MATH_KERNEL(octahedral_encode, octahedral_encode_scalar);
+	void (*snorm16)(int16_t *, const float *, float, size_t) = MATH_KERNEL(snorm16, snorm16_scalar);
+	float inv_scale = uv_scale > 0.0f ? 1.0f / uv_scale : 0.0f;
+	float position[64 * 4];
+	float texcoord[64 * 2];
+	uint16_t half[64 * 4];
+	int16_t normal[64 * 2];
+	int16_t uv[64 * 2];
+
+	for(size_t first = 0; first < count; first += 64)
+	{
+		size_t n = count - first < 64 ? count - first : 64;
+		for(size_t i = 0; i < n; i++)
+		{
+			const float *p = positions + (first + i) * stride;
+			position[i * 4] = p[0];
+			position[i * 4 + 1] = p[1];
+			position[i * 4 + 2] = p[2];
+			position[i * 4 + 3] = 1.0f;
+			texcoord[i * 2] = texcoords[(first + i) * stride];
+			texcoord[i * 2 + 1] = texcoords[(first + i) * stride + 1];
+		}
+		to_half(half, position, n * 4);
+		encode(normal, normals + first * stride, stride, n);
+		snorm16(uv, texcoord, inv_scale, n * 2);
+
+		for(size_t i = 0; i < n; i++)
+		{
+			vertex_packed *v = &result[first + i];
+			memcpy(v->position, half + i * 4, sizeof(v->position));
+			v->normal[0] = normal[i * 2];
+			v->normal[1] = normal[i * 2 + 1];
+			v->texcoord[0] = uv[i * 2];
+			v->texcoord[1] = uv[i * 2 + 1];
+		}
+	}
+}
+
+MATH_API void math_pack_vertices
+(
+	vertex_packed *result,
+	const float *positions,
+	const float *normals,
+	const float *texcoords,
+	size_t stride,
+	float uv_scale,
+	size_t count
+)
+{
+	MATH_BATCH(count, first, n,
+		pack_vertices_block(result + first, positions + first * stride, normals + first * stride,
+			texcoords + first * stride, stride, uv_scale, n));
+}
+
+MATH_API void math_quat_zero(quat qt)
+{
+	qt[0] = qt[1] = qt[2] = qt[3] = 0.0f;
+}
+
+MATH_API void math_quat_identity(quat qt)
+{
+	qt[0] = qt[1] = qt[2] = 0.0f;
+	qt[3] = 1.0f;
+}
+
+MATH_API void math_quat_add(quat result, quat qt_a, quat qt_b)
+{
+	math_vec4_add(result, qt_a, qt_b);
+}
+
+MATH_API void math_quat_sub(quat result, quat qt_a, quat qt_b)
+{
+	math_vec4_sub(result, qt_a, qt_b);
+}
+
+MATH_API void math_quat_scale(quat result, quat qt, float scalar)
+{
+	result[0] = qt[0] * scalar;
+	result[1] = qt[1] * scalar;
+	result[2] = qt[2] * scalar;
+	result[3] = qt[3] * scalar;
+}
+
+MATH_API void math_quat_norm(quat result, quat qt)
+{
+	float k = 1.0f / math_vec4_len(qt); //quat is literally vec4 here
+	math_quat_scale(result, qt, k);
+}
+
+MATH_API void math_quat_copy(quat result, quat original)
+{
+	math_vec4_copy(result, original);
+}
+
+MATH_API float math_quat_dot(quat qt_a, quat qt_b)
+{
+	return math_vec4_dot(qt_a, qt_b);
+}
+
+MATH_API void math_quat_conjugate(quat result, quat qt)
+{
+	result[0] = -qt[0];
+	result[1] = -qt[1];
+	result[2] = -qt[2];
+	result[3] = qt[3];
+}
+
+MATH_API void math_quat_inverse(quat result, quat qt)
+{
+	float dot = math_quat_dot(qt, qt);
+
+	if(dot == 0.0f)
+	{
+		math_quat_zero(result);
+		return;
+	}
+	math_quat_conjugate(result, qt);
+	math_quat_scale(result, result, 1.0f / dot);
+}
+
+static void quat_mul_scalar(float *result, const float *qt_a, const float *qt_b, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *a = qt_a + i * 4;
+		const float *b = qt_b + i * 4;
+		float x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+		float y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+		float z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+		float w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+		result[i * 4] = x;
+		result[i * 4 + 1] = y;
+		result[i * 4 + 2] = z;
+		result[i * 4 + 3] = w;
+	}
+}
+
+static void quat_rotate_scalar(float *result, const float *qts, const float *vecs, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *q = qts + i * 4;
+		vec3 v = {vecs[i * 3], vecs[i * 3 + 1], vecs[i * 3 + 2]};
+		vec3 u = {q[0], q[1], q[2]};
+		vec3 t, c;
+
+		//v + w * t + u x t, with t = 2 * (u x v)
+		math_vec3_cross(t, u, v);
+		math_vec3_scale(t, t, 2.0f);
+		math_vec3_cross(c, u, t);
+		result[i * 3] = v[0] + q[3] * t[0] + c[0];
+		result[i * 3 + 1] = v[1] + q[3] * t[1] + c[1];
+		result[i * 3 + 2] = v[2] + q[3] * t[2] + c[2];
+	}
+}
+
+static void quat_to_mat4_scalar(float *result, const float *qts, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *q = qts + i * 4;
+		float *m = result + i * 16;
+		float xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+		float xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+		float wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+
+		m[0] = 1.0f - 2.0f * (yy + zz);
+		m[1] = 2.0f * (xy + wz);
+		m[2] = 2.0f * (xz - wy);
+		m[3] = 0.0f;
+		m[4] = 2.0f * (xy - wz);
+		m[5] = 1.0f - 2.0f * (xx + zz);
+		m[6] = 2.0f * (yz + wx);
+		m[7] = 0.0f;
+		m[8] = 2.0f * (xz + wy);
+		m[9] = 2.0f * (yz - wx);
+		m[10] = 1.0f - 2.0f * (xx + yy);
+		m[11] = 0.0f;
+		m[12] = m[13] = m[14] = 0.0f;
+		m[15] = 1.0f;
+	}
+}
+
+static void quat_nlerp_scalar(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *a = qt_a + i * 4;
+		const float *b = qt_b + i * 4;
+		float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		float wa = 1.0f - t[i];
+		float wb = dot < 0.0f ? -t[i] : t[i];
+		quat r;
+
+		for(int j = 0; j < 4; j++)
+			r[j] = wa * a[j] + wb * b[j];
+		math_vec4_normalize(r);
+		math_vec4_copy(result + i * 4, r);
+	}
+}
+
+static void quat_slerp_scalar(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *a = qt_a + i * 4;
+		const float *b = qt_b + i * 4;
+		float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float wa, wb;
+
+		dot *= sign;
+		if(dot > 0.9995f)
+		{
+			//nearly the same rotation, sin(theta) is too small to divide by
+			quat_nlerp_scalar(result + i * 4, a, b, t + i, 1);
+			continue;
+		}
+
+		float theta = acosf(dot);
+		float inv_sin = 1.0f / sinf(theta);
+		wa = sinf((1.0f - t[i]) * theta) * inv_sin;
+		wb = sinf(t[i] * theta) * inv_sin * sign;
+
+		quat r;
+		for(int j = 0; j < 4; j++)
+			r[j] = wa * a[j] + wb * b[j];
+		math_vec4_copy(result + i * 4, r);
+	}
+}
+
+MATH_API void math_quat_mul(quat result, quat qt_a, quat qt_b)
+{
+	quat_mul_scalar(result, qt_a, qt_b, 1);
+}
+
+MATH_API void math_quat_from_axis_angle(quat result, vec3 axis, float angle)
+{
+	float s, c;
+	math_sincos(angle * 0.5f, &s, &c);
+	result[0] = axis[0] * s;
+	result[1] = axis[1] * s;
+	result[2] = axis[2] * s;
+	result[3] = c;
+}
+
+MATH_API void math_quat_rotate_vec3(vec3 result, quat qt, vec3 vec)
+{
+	quat_rotate_scalar(result, qt, vec, 1);
+}
+
+MATH_API void math_quat_to_mat4(mat4 result, quat qt)
+{
+	quat_to_mat4_scalar(&result[0][0], qt, 1);
+}
+
+MATH_API void math_quat_from_mat4(quat result, mat4 mat)
+{
+	//Shepperd: pick the biggest of w, x, y, z to divide by
+	float trace = mat[0][0] + mat[1][1] + mat[2][2];
+	float s;
+
+	if(trace > 0.0f)
+	{
+		s = sqrtf(trace + 1.0f) * 2.0f;
+		result[0] = (mat[1][2] - mat[2][1]) / s;
+		result[1] = (mat[2][0] - mat[0][2]) / s;
+		result[2] = (mat[0][1] - mat[1][0]) / s;
+		result[3] = 0.25f * s;
+	}
+	else if(mat[0][0] > mat[1][1] && mat[0][0] > mat[2][2])
+	{
+		s = sqrtf(1.0f + mat[0][0] - mat[1][1] - mat[2][2]) * 2.0f;
+		result[0] = 0.25f * s;
+		result[1] = (mat[1][0] + mat[0][1]) / s;
+		result[2] = (mat[2][0] + mat[0][2]) / s;
+		result[3] = (mat[1][2] - mat[2][1]) / s;
+	}
+	else if(mat[1][1] > mat[2][2])
+	{
+		s = sqrtf(1.0f + mat[1][1] - mat[0][0] - mat[2][2]) * 2.0f;
+		result[0] = (mat[1][0] + mat[0][1]) / s;
+		result[1] = 0.25f * s;
+		result[2] = (mat[2][1] + mat[1][2]) / s;
+		result[3] = (mat[2][0] - mat[0][2]) / s;
+	}
+	else
+	{
+		s = sqrtf(1.0f + mat[2][2] - mat[0][0] - mat[1][1]) * 2.0f;
+		result[0] = (mat[2][0] + mat[0][2]) / s;
+		result[1] = (mat[2][1] + mat[1][2]) / s;
+		result[2] = 0.25f * s;
+		result[3] = (mat[0][1] - mat[1][0]) / s;
+	}
+}
+
+MATH_API void math_quat_nlerp(quat result, quat qt_a, quat qt_b, float t)
+{
+	quat_nlerp_scalar(result, qt_a, qt_b, &t, 1);
+}
+
+MATH_API void math_quat_slerp(quat result, quat qt_a, quat qt_b, float t)
+{
+	quat_slerp_scalar(result, qt_a, qt_b, &t, 1);
+}
+
+MATH_API void math_quat_mul_batch(quat *result, quat *qt_a, quat *qt_b, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *, size_t);
+	kernel = MATH_KERNEL(quat_mul, quat_mul_scalar);
+	MATH_BATCH(count, first, n, kernel(result[first], qt_a[first], qt_b[first], n));
+}
+
+static void quat_from_axis_angle_block(quat *result, vec3 *axes, const float *angles, size_t count)
+{
+	void (*kernel)(float *, float *, const float *, size_t) = MATH_KERNEL(sincos, sincos_scalar);
+	float half[256];
+	float s[256];
+	float c[256];
+
+	for(size_t first = 0; first < count; first += 256)
+	{
+		size_t n = count - first < 256 ? count - first : 256;
+		for(size_t i = 0; i < n; i++)
+			half[i] = angles[first + i] * 0.5f;
+		kernel(s, c, half, n);
+		for(size_t i = 0; i < n; i++)
+		{
+			float *r = result[first + i];
+			float *axis = axes[first + i];
+			r[0] = axis[0] * s[i];
+			r[1] = axis[1] * s[i];
+			r[2] = axis[2] * s[i];
+			r[3] = c[i];
+		}
+	}
+}
+
+MATH_API void math_quat_from_axis_angle_batch(quat *result, vec3 *axes, const float *angles, size_t count)
+{
+	MATH_BATCH(count, first, n, quat_from_axis_angle_block(result + first, axes + first, angles + first, n));
+}
+
+MATH_API void math_quat_rotate_vec3_batch(vec3 *result, quat *qts, vec3 *vecs, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *, size_t);
+	kernel = MATH_KERNEL(quat_rotate, quat_rotate_scalar);
+	MATH_BATCH(count, first, n, kernel(result[first], qts[first], vecs[first], n));
+}
+
+MATH_API void math_quat_to_mat4_batch(mat4 *result, quat *qts, size_t count)
+{
+	void (*kernel)(float *, const float *, size_t);
+	kernel = MATH_KERNEL(quat_to_mat4, quat_to_mat4_scalar);
+	MATH_BATCH(count, first, n, kernel(&result[first][0][0], qts[first], n));
+}
+
+MATH_API void math_quat_nlerp_batch(quat *result, quat *qt_a, quat *qt_b, const float *t, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *, const float *, size_t);
+	kernel = MATH_KERNEL(quat_nlerp, quat_nlerp_scalar);
+	MATH_BATCH(count, first, n, kernel(result[first], qt_a[first], qt_b[first], t + first, n));
+}
+
+MATH_API void math_quat_slerp_batch(quat *result, quat *qt_a, quat *qt_b, const float *t, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *, const float *, size_t);
+	kernel = MATH_KERNEL(quat_slerp, quat_slerp_scalar);
+	MATH_BATCH(count, first, n, kernel(result[first], qt_a[first], qt_b[first], t + first, n));
+}
+
+MATH_API void math_lookat(mat4 result, vec3 position, vec3 target, vec3 up)
+{
+	vec3 f;
+	vec3 u;
+	vec3 s;
+
+	math_vec3_sub(f, target, position);
+	MATH_NORMALIZE_HOT(f, f);
+
+	math_vec3_cross(s, f, up);
+	MATH_NORMALIZE_HOT(s, s);
+	math_vec3_cross(u, s, f);
+
+	result[0][0] = s[0];
+	result[0][1] = u[0];
+	result[0][2] =-f[0];
+	result[1][0] = s[1];
+	result[1][1] = u[1];
+	result[1][2] =-f[1];
+	result[2][0] = s[2];
+	result[2][1] = u[2];
+	result[2][2] =-f[2];
+	result[3][0] = -math_vec3_dot(s, position);
+	result[3][1] = -math_vec3_dot(u, position);
+	result[3][2] = math_vec3_dot(f, position);
+	result[0][3] = result[1][3] = result[2][3] = 0.0f;
+	result[3][3] = 1.0f;
+}
+
+MATH_API void math_perspective(mat4 result, float fov, float aspect, float near, float far)
+{
+	float f;
+	float fn;
+
+	math_mat4_zero(result);
+
+	f = 1.0f / tanf(fov * 0.5f);
+	fn = 1.0f / (near - far);
+
+	result[0][0] = f / aspect;
+	result[1][1] = f;
+	result[2][2] = far * fn;
+	result[2][3] = -1.0f;
+	result[3][2] = near * far * fn;
+}
+
+MATH_API void math_perspective_reverse(mat4 result, float fov, float aspect, float near, float far)
+{
+	float f;
+	float fn;
+
+	math_mat4_zero(result);
+
+	f = 1.0f / tanf(fov * 0.5f);
+	fn = 1.0f / (far - near);
+
+	result[0][0] = f / aspect;
+	result[1][1] = f;
+	result[2][2] = near * fn;
+	result[2][3] = -1.0f;
+	result[3][2] = near * far * fn;
+}
+
+MATH_API void math_perspective_reverse_infinite(mat4 result, float fov, float aspect, float near)
+{
+	float f;
+
+	math_mat4_zero(result);
+
+	f = 1.0f / tanf(fov * 0.5f);
+
+	result[0][0] = f / aspect;
+	result[1][1] = f;
+	result[2][3] = -1.0f;
+	result[3][2] = near;
+}
+
+MATH_API void math_mat4_mul_perspective(mat4 result, mat4 view, mat4 perspective)
+{
+#ifdef __SSE__
+	//each column: (x, y, z, w) * diagonal + (-, -, w, z) * off diagonal
+	__m128 diagonal = _mm_setr_ps(perspective[0][0], perspective[1][1], perspective[2][2], 0.0f);
+	__m128 off = _mm_setr_ps(0.0f, 0.0f, perspective[3][2], perspective[2][3]);
+	for(int i = 0; i < 4; i++)
+	{
+		__m128 column = _mm_loadu_ps(view[i]);
+		__m128 swapped = _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 3, 0, 0));
+		_mm_storeu_ps(result[i], _mm_add_ps(_mm_mul_ps(column, diagonal), _mm_mul_ps(swapped, off)));
+	}
+#else
+	for(int i = 0; i < 4; i++)
+	{
+		float x = view[i][0];
+		float y = view[i][1];
+		float z = view[i][2];
+		float w = view[i][3];
+		result[i][0] = x * perspective[0][0];
+		result[i][1] = y * perspective[1][1];
+		result[i][2] = z * perspective[2][2] + w * perspective[3][2];
+		result[i][3] = z * perspective[2][3];
+	}
+#endif
+}
+
+static void lookat_block(mat4 *views, mat4 *view_projections, vec3 *positions, vec3 *targets, vec3 *ups, mat4 *projections, size_t projection_stride, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		mat4 view;
+		math_lookat(view, positions[i], targets[i], ups[i]);
+		if(views != NULL)
+			math_mat4_copy(views[i], view);
+		if(view_projections != NULL)
+			math_mat4_mul_perspective(view_projections[i], view, projections[i * projection_stride]);
+	}
+}
+
+MATH_API void math_mat4_jitter(mat4 result, mat4 mat, float x, float y)
+{
+	//the NDC shift times w, added to clip x and y
+	for(int i = 0; i < 4; i++)
+	{
+		float w = mat[i][3];
+		result[i][0] = mat[i][0] + x * w;
+		result[i][1] = mat[i][1] + y * w;
+		result[i][2] = mat[i][2];
+		result[i][3] = w;
+	}
+}
+
+MATH_API void math_lookat_batch
+(
+	mat4 *views,
+	mat4 *view_projections,
+	vec3 *positions,
+	vec3 *targets,
+	vec3 *ups,
+	mat4 *projections,
+	size_t projection_stride,
+	size_t count
+)
+{
+	MATH_BATCH(count, first, n, lookat_block
+	(
+		views != NULL ? views + first : NULL,
+		view_projections != NULL ? view_projections + first : NULL,
+		positions + first,
+		targets + first,
+		ups + first,
+		projections + first * projection_stride,
+		projection_stride,
+		n
+	));
+}
+
+static void perspective_block(mat4 *result, const float *fovs, const float *aspects, const float *nears, const float *fars, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		math_perspective(result[i], fovs[i], aspects[i], nears[i], fars[i]);
+}
+
+MATH_API void math_perspective_batch
+(
+	mat4 *result,
+	const float *fovs,
+	const float *aspects,
+	const float *nears,
+	const float *fars,
+	size_t count
+)
+{
+	MATH_BATCH(count, first, n, perspective_block(result + first, fovs + first, aspects + first, nears + first, fars + first, n));
+}
+
+//face directions and ups of GL_TEXTURE_CUBE_MAP_POSITIVE_X onwards
+static const float cubemap_faces[6][2][3] =
+{
+	{{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+	{{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+	{{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+	{{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+	{{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}},
+	{{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}}
+};
+
+static void cubemap_block(mat4 *views, mat4 *view_projections, vec3 *positions, mat4 projection, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		vec3 position[6];
+		vec3 targets[6];
+		vec3 ups[6];
+		for(int face = 0; face < 6; face++)
+		{
+			for(int k = 0; k < 3; k++)
+			{
+				position[face][k] = positions[i][k];
+				targets[face][k] = positions[i][k] + cubemap_faces[face][0][k];
+				ups[face][k] = cubemap_faces[face][1][k];
+			}
+		}
+		lookat_block
+		(
+			views != NULL ? views + 6 * i : NULL,
+			view_projections != NULL ? view_projections + 6 * i : NULL,
+			position,
+			targets,
+			ups,
+			(mat4 *)projection,
+			0,
+			6
+		);
+	}
+}
+
+MATH_API void math_cubemap_lookat(mat4 *views, mat4 *view_projections, vec3 *positions, float near, float far, size_t count)
+{
+	mat4 projection;
+	math_perspective(projection, (float)M_PI * 0.5f, 1.0f, near, far);
+	MATH_BATCH(count, first, n, cubemap_block
+	(
+		views != NULL ? views + 6 * first : NULL,
+		view_projections != NULL ? view_projections + 6 * first : NULL,
+		positions + first,
+		projection,
+		n
+	));
+}
+
+MATH_API void math_frustum_planes(vec4 planes[6], mat4 view_projection)
+{
+	//Gribb-Hartmann: rows of the matrix added to/subtracted from row 3
+	for(int i = 0; i < 2; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			planes[i * 2][j] = view_projection[j][3] + view_projection[j][i];
+			planes[i * 2 + 1][j] = view_projection[j][3] - view_projection[j][i];
+		}
+	}
+
+	//math_perspective maps depth to [0, 1], so near is z >= 0
+	for(int j = 0; j < 4; j++)
+	{
+		planes[4][j] = view_projection[j][2];
+		planes[5][j] = view_projection[j][3] - view_projection[j][2];
+	}
+
+	for(int i = 0; i < 6; i++)
+	{
+		float len = math_vec3_len(planes[i]);
+		if(len != 0.0f)
+			math_vec4_scale(planes[i], planes[i], 1.0f / len);
+	}
+}
+
+MATH_API int math_frustum_test_aabb(vec4 planes[6], vec3 center, vec3 extent)
+{
+	for(int i = 0; i < 6; i++)
+	{
+		float d = math_vec3_dot(planes[i], center) + planes[i][3];
+		float r = fabsf(planes[i][0]) * extent[0] + fabsf(planes[i][1]) * extent[1]
+			+ fabsf(planes[i][2]) * extent[2];
+		if(d + r < 0.0f)
+			return 0;
+	}
+	return 1;
+}
+
+MATH_API int math_frustum_test_sphere(vec4 planes[6], vec3 center, float radius)
+{
+	for(int i = 0; i < 6; i++)
+	{
+		if(math_vec3_dot(planes[i], center) + planes[i][3] < -radius)
+			return 0;
+	}
+	return 1;
+}
+
+static void cull_aabbs_scalar(uint32_t *visible, const float *planes, const float *const bounds[6], size_t first, size_t count)
+{
+	for(size_t i = first; i < count; i++)
+	{
+		vec3 center = {bounds[0][i], bounds[1][i], bounds[2][i]};
+		vec3 extent = {bounds[3][i], bounds[4][i], bounds[5][i]};
+		if(i % 32 == 0)
+			visible[i / 32] = 0;
+		if(math_frustum_test_aabb((vec4 *)planes, center, extent))
+			visible[i / 32] |= 1u << (i % 32);
+	}
+}
+
+static void cull_spheres_scalar(uint32_t *visible, const float *planes, const float *const bounds[4], size_t first, size_t count)
+{
+	for(size_t i = first; i < count; i++)
+	{
+		vec3 center = {bounds[0][i], bounds[1][i], bounds[2][i]};
+		if(i % 32 == 0)
+			visible[i / 32] = 0;
+		if(math_frustum_test_sphere((vec4 *)planes, center, bounds[3][i]))
+			visible[i / 32] |= 1u << (i % 32);
+	}
+}
+
+static void frustum_cull
+(
+	void (*kernel)(uint32_t *, const float *, const float *const *, size_t, size_t),
+	uint32_t *visible,
+	vec4 planes[6],
+	const float *const *bounds,
+	size_t count
+)
+{
+	//MATH_BATCH_CHUNK is a multiple of 32, so threads never share a word
+	MATH_BATCH(count, first, n, kernel(visible, &planes[0][0], bounds, first, first + n));
+}
+
+MATH_API void math_frustum_cull_aabbs
+(
+	uint32_t *visible,
+	vec4 planes[6],
+	const float *center_x,
+	const float *center_y,
+	const float *center_z,
+	const float *extent_x,
+	const float *extent_y,
+	const float *extent_z,
+	size_t count
+)
+{
+	const float *const bounds[6] = {center_x, center_y, center_z, extent_x, extent_y, extent_z};
+	frustum_cull(MATH_KERNEL(cull_aabbs, cull_aabbs_scalar), visible, planes, bounds, count);
+}
+
+MATH_API void math_frustum_cull_spheres
+(
+	uint32_t *visible,
+	vec4 planes[6],
+	const float *center_x,
+	const float *center_y,
+	const float *center_z,
+	const float *radius,
+	size_t count
+)
+{
+	const float *const bounds[4] = {center_x, center_y, center_z, radius};
+	frustum_cull(MATH_KERNEL(cull_spheres, cull_spheres_scalar), visible, planes, bounds, count);
+}
+
+MATH_API void math_aabb_empty(aabb *box)
+{
+	for(int k = 0; k < 3; k++)
+	{
+		box->min[k] = FLT_MAX;
+		box->max[k] = -FLT_MAX;
+	}
+}
+
+MATH_API void math_aabb_merge(aabb *result, const aabb *box_a, const aabb *box_b)
+{
+	for(int k = 0; k < 3; k++)
+	{
+		result->min[k] = box_a->min[k] < box_b->min[k] ? box_a->min[k] : box_b->min[k];
+		result->max[k] = box_a->max[k] > box_b->max[k] ? box_a->max[k] : box_b->max[k];
+	}
+}
+
+//boxes are 6 floats, mats 12 (mat4x3). Same operation order as the kernels.
+//Halving first keeps empty boxes from overflowing to infinities (and 0 * inf)
+static void aabb_transform_scalar(float *result, const float *boxes, const float *mats, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *box = boxes + i * 6;
+		const float *m = mats + i * 12;
+		float center[3], half[3];
+		for(int k = 0; k < 3; k++)
+		{
+			center[k] = box[k] * 0.5f + box[k + 3] * 0.5f;
+			half[k] = box[k + 3] * 0.5f - box[k] * 0.5f;
+		}
+		for(int j = 0; j < 3; j++)
+		{
+			float c = m[j] * center[0] + m[3 + j] * center[1] + m[6 + j] * center[2] + m[9 + j];
+			float h = fabsf(m[j]) * half[0] + fabsf(m[3 + j]) * half[1] + fabsf(m[6 + j]) * half[2];
+			result[i * 6 + j] = c - h;
+			result[i * 6 + 3 + j] = c + h;
+		}
+	}
+}
+
+MATH_API void math_aabb_transform(aabb *result, const aabb *box, mat4x3 mat)
+{
+	aabb_transform_scalar(result->min, box->min, &mat[0][0], 1);
+}
+
+MATH_API void math_aabb_transform_batch(aabb *result, const aabb *boxes, mat4x3 *mats, size_t count)
+{
+	void (*kernel)(float *, const float *, const float *, size_t) = MATH_KERNEL(aabb_transform, aabb_transform_scalar);
+	MATH_BATCH(count, first, n, kernel(result[first].min, boxes[first].min, &mats[first][0][0], n));
+}
+
+MATH_API int math_triangle_stream_alloc(triangle_stream *tris, size_t capacity)
+{
+	if(math_vec3_stream_alloc(&tris->v0, capacity) && math_vec3_stream_alloc(&tris->e1, capacity) &&
+		math_vec3_stream_alloc(&tris->e2, capacity))
+		return 1;
+	math_triangle_stream_free(tris);
+	return 0;
+}
+
+MATH_API void math_triangle_stream_free(triangle_stream *tris)
+{
+	math_vec3_stream_free(&tris->v0);
+	math_vec3_stream_free(&tris->e1);
+	math_vec3_stream_free(&tris->e2);
+}
+
+MATH_API int math_triangle_stream_from_aos(triangle_stream *tris, const float *vertices, size_t stride, size_t count)
+{
+	vec3_stream *streams[3] = {&tris->v0, &tris->e1, &tris->e2};
+	if(count > tris->v0.capacity || count > tris->e1.capacity || count > tris->e2.capacity)
+		return 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *v0 = vertices + 3 * i * stride;
+		for(int k = 0; k < 3; k++)
+		{
+			tris->v0.x[k * tris->v0.capacity + i] = v0[k];
+			tris->e1.x[k * tris->e1.capacity + i] = v0[stride + k] - v0[k];
+			tris->e2.x[k * tris->e2.capacity + i] = v0[2 * stride + k] - v0[k];
+		}
+	}
+	//zeroed padding is degenerate triangles, which never get hit
+	for(int s = 0; s < 3; s++)
+	{
+		for(int k = 0; k < 3; k++)
+			for(size_t i = count; i < stream_padded(count); i++)
+				streams[s]->x[k * streams[s]->capacity + i] = 0.0f;
+		streams[s]->count = count;
+	}
+	return 1;
+}
+
+/*
+ * One Moller-Trumbore test, written out so the kernels can follow the
+ * same operations. Misses are the comparisons coming out false, so the
+ * NaNs of degenerate triangles (and zeroed padding) miss too.
+*/
+static int ray_triangle_test(float *result, const float *ray, const float *v0, const float *e1, const float *e2, float t_max)
+{
+	const float *o = ray;
+	const float *d = ray + 3;
+	float p[3], s[3], q[3];
+
+	p[0] = d[1] * e2[2] - d[2] * e2[1];
+	p[1] = d[2] * e2[0] - d[0] * e2[2];
+	p[2] = d[0] * e2[1] - d[1] * e2[0];
+	float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	float inv = 1.0f / det;
+
+	s[0] = o[0] - v0[0];
+	s[1] = o[1] - v0[1];
+	s[2] = o[2] - v0[2];
+	float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+
+	q[0] = s[1] * e1[2] - s[2] * e1[1];
+	q[1] = s[2] * e1[0] - s[0] * e1[2];
+	q[2] = s[0] * e1[1] - s[1] * e1[0];
+	float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+	float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+
+	if(!(fabsf(det) >= MATH_RAY_EPSILON && u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= ray[6] && t < t_max))
+		return 0;
+	result[0] = t;
+	result[1] = u;
+	result[2] = v;
+	return 1;
+}
+
+//same operand order as minps/maxps: a NaN in a gives b
+static float ray_min(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static float ray_max(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+//NaN slabs (origin on the plane, zero direction) are skipped
+static int ray_aabb_test(float *t_near, const float *ray, const float *box)
+{
+	float near = ray[6];
+	float far = ray[7];
+	for(int k = 0; k < 3; k++)
+	{
+		float inv = 1.0f / ray[3 + k];
+		float t0 = (box[k] - ray[k]) * inv;
+		float t1 = (box[3 + k] - ray[k]) * inv;
+		near = ray_max(ray_min(t0, t1), near);
+		far = ray_min(ray_max(t0, t1), far);
+	}
+	*t_near = near;
+	return near <= far;
+}
+
+static int ray_triangles_scalar(float *hit, uint32_t *primitive, const float *ray, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	int found = 0;
+	for(size_t i = first; i < end; i++)
+	{
+		vec3 a = {v0[i], v0[capacity + i], v0[2 * capacity + i]};
+		vec3 b = {e1[i], e1[capacity + i], e1[2 * capacity + i]};
+		vec3 c = {e2[i], e2[capacity + i], e2[2 * capacity + i]};
+		if(ray_triangle_test(hit, ray, a, b, c, hit[0]))
+		{
+			*primitive = (uint32_t)i;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+static void ray_packet_lane(float *ray, const float *rays, int lane)
+{
+	for(int k = 0; k < 8; k++)
+		ray[k] = rays[k * MATH_RAY_PACKET + lane];
+}
+
+static uint32_t ray_packet_triangles_scalar(float *hit, uint32_t *primitive, const float *rays, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	uint32_t mask = 0;
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+	{
+		float ray[8];
+		float lane_hit[3] = {hit[lane], hit[MATH_RAY_PACKET + lane], hit[2 * MATH_RAY_PACKET + lane]};
+		ray_packet_lane(ray, rays, lane);
+		if(ray_triangles_scalar(lane_hit, &primitive[lane], ray, v0, e1, e2, capacity, first, end))
+		{
+			for(int k = 0; k < 3; k++)
+				hit[k * MATH_RAY_PACKET + lane] = lane_hit[k];
+			mask |= 1u << lane;
+		}
+	}
+	return mask;
+}
+
+static uint32_t ray_packet_aabb_scalar(float *t_near, const float *rays, const float *box)
+{
+	uint32_t mask = 0;
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+	{
+		float ray[8];
+		ray_packet_lane(ray, rays, lane);
+		if(ray_aabb_test(&t_near[lane], ray, box))
+			mask |= 1u << lane;
+	}
+	return mask;
+}
+
+MATH_API void math_ray_from_screen(ray *result, mat4 inverse_view_projection, float x, float y)
+{
+	//points at depth 0 and 1, still homogeneous: with reverse-Z depth 1 is
+	//the near plane, and depth 0 of an infinite projection has w = 0
+	vec4 ends[2] = {{0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}};
+	for(int p = 0; p < 2; p++)
+	{
+		vec4 ndc = {x, y, (float)p, 1.0f};
+		for(int i = 0; i < 4; i++)
+			for(int j = 0; j < 4; j++)
+				ends[p][j] += inverse_view_projection[i][j] * ndc[i];
+	}
+
+	//every perspective sends the eye to clip (0, 0, 1, 0), the end closer
+	//to it is on the near plane
+	vec3 eye;
+	math_vec3_scale(eye, inverse_view_projection[2], 1.0f / inverse_view_projection[2][3]);
+	for(int p = 0; p < 2; p++)
+		if(ends[p][3] != 0.0f)
+			math_vec3_scale(ends[p], ends[p], 1.0f / ends[p][3]);
+	int near;
+	if(ends[1][3] == 0.0f)
+		near = 0;
+	else if(ends[0][3] == 0.0f)
+		near = 1;
+	else
+	{
+		vec3 to_near, to_far;
+		math_vec3_sub(to_near, ends[0], eye);
+		math_vec3_sub(to_far, ends[1], eye);
+		near = math_vec3_dot(to_far, to_far) < math_vec3_dot(to_near, to_near);
+	}
+	float *far = ends[1 - near];
+	math_vec3_copy(result->origin, ends[near]);
+
+	result->t_min = 0.0f;
+	if(far[3] == 0.0f)
+	{
+		//point at infinity, only a direction (sign unknown)
+		vec3 away;
+		math_vec3_sub(away, result->origin, eye);
+		math_vec3_copy(result->direction, far);
+		if(math_vec3_dot(result->direction, away) < 0.0f)
+			math_vec3_scale(result->direction, result->direction, -1.0f);
+		math_vec3_normalize(result->direction);
+		result->t_max = INFINITY;
+	}
+	else
+	{
+		math_vec3_sub(result->direction, far, result->origin);
+		float len = math_vec3_len(result->direction);
+		math_vec3_scale(result->direction, result->direction, 1.0f / len);
+		result->t_max = len;
+	}
+}
+
+MATH_API void math_ray_packet_from_rays(ray_packet *packet, const ray *rays, size_t count)
+{
+	float *lanes = &packet->origin_x[0];
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+	{
+		for(int k = 0; k < 8; k++)
+			lanes[k * MATH_RAY_PACKET + lane] = (size_t)lane < count ? (&rays[lane].origin[0])[k] : 0.0f;
+		if((size_t)lane >= count)
+			packet->t_min[lane] = 1.0f; //t_max < t_min, never hits
+	}
+}
+
+MATH_API int math_ray_triangle(ray_hit *hit, const ray *r, vec3 v0, vec3 v1, vec3 v2)
+{
+	vec3 e1, e2;
+	math_vec3_sub(e1, v1, v0);
+	math_vec3_sub(e2, v2, v0);
+	return ray_triangle_test(&hit->t, &r->origin[0], v0, e1, e2, r->t_max);
+}
+
+MATH_API int math_ray_aabb(float *t_near, const ray *r, vec3 min, vec3 max)
+{
+	float box[6] = {min[0], min[1], min[2], max[0], max[1], max[2]};
+	float t;
+	int result = ray_aabb_test(&t, &r->origin[0], box);
+	if(t_near != NULL)
+		*t_near = t;
+	return result;
+}
+
+MATH_API int math_ray_nearest_triangle(ray_hit *hit, const ray *r, triangle_stream *tris)
+{
+	hit->t = r->t_max;
+	hit->u = hit->v = 0.0f;
+	hit->primitive = MATH_RAY_MISS;
+	return math_ray_nearest_triangle_range(hit, r, tris, 0, tris->v0.count);
+}
+
+MATH_API void math_ray_nearest_triangle_batch(ray_hit *hits, const ray *rays, size_t count, triangle_stream *tris)
+{
+	//every ray already walks all the triangles, so thread over rays
+	MATH_PARALLEL_FOR(count * tris->v0.count > MATH_BATCH_CHUNK)
+	for(long i = 0; i < (long)count; i++)
+		math_ray_nearest_triangle(&hits[i], &rays[i], tris);
+}
+
+MATH_API void math_ray_packet_nearest_triangle(ray_packet_hit *hit, const ray_packet *rays, triangle_stream *tris)
+{
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+	{
+		hit->t[lane] = rays->t_max[lane];
+		hit->u[lane] = hit->v[lane] = 0.0f;
+		hit->primitive[lane] = MATH_RAY_MISS;
+	}
+	math_ray_packet_nearest_triangle_range(hit, rays, tris, 0, tris->v0.count);
+}
+
+MATH_API int math_ray_nearest_triangle_range(ray_hit *hit, const ray *r, const triangle_stream *tris, size_t first, size_t count)
+{
+	int (*kernel)(float *, uint32_t *, const float *, const float *, const float *, const float *, size_t, size_t, size_t);
+	kernel = MATH_KERNEL(ray_triangles, ray_triangles_scalar);
+	return kernel(&hit->t, &hit->primitive, &r->origin[0], tris->v0.x, tris->e1.x, tris->e2.x,
+		tris->v0.capacity, first, first + count);
+}
+
+MATH_API uint32_t math_ray_packet_nearest_triangle_range(ray_packet_hit *hit, const ray_packet *rays, const triangle_stream *tris, size_t first, size_t count)
+{
+	uint32_t (*kernel)(float *, uint32_t *, const float *, const float *, const float *, const float *, size_t, size_t, size_t);
+	kernel = MATH_KERNEL(ray_packet_triangles, ray_packet_triangles_scalar);
+	return kernel(hit->t, hit->primitive, rays->origin_x, tris->v0.x, tris->e1.x, tris->e2.x,
+		tris->v0.capacity, first, first + count);
+}
+
+MATH_API uint32_t math_ray_packet_aabb(float *t_near, const ray_packet *rays, vec3 min, vec3 max)
+{
+	float box[6] = {min[0], min[1], min[2], max[0], max[1], max[2]};
+	float t[MATH_RAY_PACKET];
+	uint32_t (*kernel)(float *, const float *, const float *) = MATH_KERNEL(ray_packet_aabb, ray_packet_aabb_scalar);
+	uint32_t mask = kernel(t, rays->origin_x, box);
+	if(t_near != NULL)
+		memcpy(t_near, t, sizeof(t));
+	return mask;
+}
+
+MATH_API float math_rsqrt(float x)
+{
+#ifdef __SSE__
+	float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+	//bit trick estimate, about as good as rsqrtss after one more step
+	union { float f; uint32_t i; } bits = {x};
+	bits.i = 0x5f375a86 - (bits.i >> 1);
+	float y = bits.f;
+	y = y * (1.5f - 0.5f * x * y * y);
+#endif
+	return y * (1.5f - 0.5f * x * y * y);
+}
+
+//min xyz and cells per unit xyz, both forms quantize with these
+static void morton_setup(float *min_scale, vec3 min, vec3 max)
+{
+	for(int i = 0; i < 3; i++)
+	{
+		float extent = max[i] - min[i];
+		min_scale[i] = min[i];
+		min_scale[i + 3] = extent > 0.0f ? 1024.0f / extent : 0.0f;
+	}
+}
+
+//spread the low 10 bits of v to every third bit
+static uint32_t morton_expand(uint32_t v)
+{
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+//same compare order as maxps/minps, NaN ends up in cell 0
+static uint32_t morton_cell(float v, float min, float scale)
+{
+	float f = (v - min) * scale;
+	f = f > 0.0f ? f : 0.0f;
+	f = f < 1023.0f ? f : 1023.0f;
+	return (uint32_t)f;
+}
+
+static void morton3_scalar(uint32_t *result, const float *x, const float *y, const float *z, const float *min_scale, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		result[i] = (morton_expand(morton_cell(x[i], min_scale[0], min_scale[3])) << 2) |
+			(morton_expand(morton_cell(y[i], min_scale[1], min_scale[4])) << 1) |
+			morton_expand(morton_cell(z[i], min_scale[2], min_scale[5]));
+	}
+}
+
+MATH_API uint32_t math_morton3(vec3 point, vec3 min, vec3 max)
+{
+	float min_scale[6];
+	uint32_t code;
+	morton_setup(min_scale, min, max);
+	morton3_scalar(&code, &point[0], &point[1], &point[2], min_scale, 1);
+	return code;
+}
+
+MATH_API void math_morton3_batch(uint32_t *result, const float *x, const float *y, const float *z, vec3 min, vec3 max, size_t count)
+{
+	float min_scale[6];
+	morton_setup(min_scale, min, max);
+	void (*kernel)(uint32_t *, const float *, const float *, const float *, const float *, size_t) = MATH_KERNEL(morton3, morton3_scalar);
+	MATH_BATCH(count, first, n, kernel(result + first, x + first, y + first, z + first, min_scale, n));
+}
+
+MATH_API float math_halton(uint32_t index, uint32_t base)
+{
+	float result = 0.0f;
+	float digit_scale = 1.0f / (float)base;
+	float scale = digit_scale;
+	for(; index > 0; index /= base)
+	{
+		result += (float)(index % base) * scale;
+		scale *= digit_scale;
+	}
+	return result;
+}
+
+MATH_API void math_r2(vec2 result, uint32_t index)
+{
+	//0.5 + index / plastic number (and its square), in 32-bit fixed point
+	//so it wraps exactly instead of losing the fraction to big indices
+	uint32_t x = index * 3242174889u + 2147483648u;
+	uint32_t y = index * 2447445414u + 2147483648u;
+	result[0] = (float)(x >> 8) * (1.0f / 16777216.0f);
+	result[1] = (float)(y >> 8) * (1.0f / 16777216.0f);
+}
+
+MATH_API float deg_to_rad(float deg)
+{
+	return deg * (M_PI / 180.0f);
+}
+
+MATH_API float rad_to_deg(float rad)
+{
+	return rad * (180.0f / M_PI);
+}
+
+MATH_API float math_lerp(float v0, float v1, float t)
+{
+	return (1 - t) * v0 + t * v1;
+}
+
+#endif
@@ -11,8 +11,10 @@
  * @file 3d_math.h
  * @brief Math functionalities
  * 
- * Simplistic math functionalities, without using SIMD stuff, for OpenGL
- * and other libraries/APIs
+ * Simplistic math functionalities for OpenGL and other libraries/APIs.
+ * Scalar by default. Building with MATH_SIMD defined makes some of these
+ * functions use SSE2/AVX/AVX2 kernels picked at startup (see
+ * 3d_math_simd.h), without changing anything in this API.
  * 
  * @author
  * - Matheus Klein Schaefer
@@ -27,38 +29,53 @@
 #define THREEDMATH
 
 #include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * Define MATH_INLINE (before including, or for the whole build) to get
+ * every function here as static inline, defined in this header. Same
+ * names and results, but the compiler can inline the small helpers into
+ * hot paths like camera_update and math_lookat. 3d_math.c doesn't need
+ * to be compiled then, 3d_math_simd.c still does.
+*/
+#ifdef MATH_INLINE
+	#define MATH_API static inline
+#else
+	#define MATH_API
+#endif
 
 typedef float vec2[2];
 typedef float vec3[3];
 typedef float vec4[4];
 typedef float mat4[4][4];
+typedef float mat4x3[4][3]; //affine, 4 columns of 3 rows
 typedef float quat[4];
 
 /*
  * VEC2 BEGIN
 */
 
-void math_vec2_zero(vec2 vec);
+MATH_API void math_vec2_zero(vec2 vec);
 
-void math_vec2_min(vec2 result, vec2 vec_a, vec2 vec_b);
+MATH_API void math_vec2_min(vec2 result, vec2 vec_a, vec2 vec_b);
 
-void math_vec2_max(vec2 result, vec2 vec_a, vec2 vec_b);
+MATH_API void math_vec2_max(vec2 result, vec2 vec_a, vec2 vec_b);
 
-void math_vec2_copy(vec2 result, vec2 original);
+MATH_API void math_vec2_copy(vec2 result, vec2 original);
 
-void math_vec2_add(vec2 result, vec2 vec_a, vec2 vec_b);
+MATH_API void math_vec2_add(vec2 result, vec2 vec_a, vec2 vec_b);
 
-void math_vec2_sub(vec2 result, vec2 vec_a, vec2 vec_b);
+MATH_API void math_vec2_sub(vec2 result, vec2 vec_a, vec2 vec_b);
 
-void math_vec2_scale(vec2 result, vec2 vec, float scalar);
+MATH_API void math_vec2_scale(vec2 result, vec2 vec, float scalar);
 
-float math_vec2_dot(vec2 vec_a, vec2 vec_b);
+MATH_API float math_vec2_dot(vec2 vec_a, vec2 vec_b);
 
-float math_vec2_cross(vec2 vec_a, vec2 vec_b);
+MATH_API float math_vec2_cross(vec2 vec_a, vec2 vec_b);
 
-float math_vec2_len(vec2 vec);
+MATH_API float math_vec2_len(vec2 vec);
 
-void math_vec2_normalize(vec2 result, vec2 vec);
+MATH_API void math_vec2_normalize(vec2 result, vec2 vec);
 
 // VEC2 END
 
@@ -66,33 +83,45 @@ void math_vec2_normalize(vec2 result, vec2 vec);
  * VEC3 BEGIN
 */
 
-void math_vec3_zero(vec3 vec);
+MATH_API void math_vec3_zero(vec3 vec);
+
+MATH_API void math_vec3_min(vec3 result, vec3 vec_a, vec3 vec_b);
 
-void math_vec3_min(vec3 result, vec3 vec_a, vec3 vec_b);
+MATH_API void math_vec3_max(vec3 result, vec3 vec_a, vec3 vec_b);
 
-void math_vec3_max(vec3 result, vec3 vec_a, vec3 vec_b);
+MATH_API void math_vec3_copy(vec3 result, vec3 original);
 
-void math_vec3_copy(vec3 result, vec3 original);
+MATH_API void math_vec3_negate(vec3 result, vec3 vec);
 
-void math_vec3_negate(vec3 result, vec3 vec);
+MATH_API void math_vec3_add(vec3 result, vec3 vec_a, vec3 vec_b);
 
-void math_vec3_add(vec3 result, vec3 vec_a, vec3 vec_b);
+MATH_API void math_vec3_sub(vec3 result, vec3 vec_a, vec3 vec_b);
 
-void math_vec3_sub(vec3 result, vec3 vec_a, vec3 vec_b);
+MATH_API void math_vec3_div(vec3 result, vec3 vec, float div);
 
-void math_vec3_div(vec3 result, vec3 vec, float div);
+MATH_API void math_vec3_scale(vec3 result, vec3 vec, float scalar);
 
-void math_vec3_scale(vec3 result, vec3 vec, float scalar);
+MATH_API float math_vec3_dot(vec3 vec_a, vec3 vec_b);
 
-float math_vec3_dot(vec3 vec_a, vec3 vec_b);
+MATH_API void math_vec3_cross(vec3 result, vec3 vec_a, vec3 vec_b);
 
-void math_vec3_cross(vec3 result, vec3 vec_a, vec3 vec_b);
+MATH_API float math_vec3_len(vec3 vec);
 
-float math_vec3_len(vec3 vec);
+MATH_API void math_vec3_normalize(vec3 vec);
 
-void math_vec3_normalize(vec3 vec);
+MATH_API void math_vec3_normalize_to(vec3 result, vec3 vec);
 
-void math_vec3_normalize_to(vec3 result, vec3 vec);
+MATH_API void math_vec3_normalize_approx(vec3 result, vec3 vec); //see math_rsqrt
+
+/*
+ * Normalize used by the hot paths (math_lookat, camera updates). Define
+ * MATH_APPROX_NORMALIZE to switch them to the rsqrt approximation.
+*/
+#ifdef MATH_APPROX_NORMALIZE
+	#define MATH_NORMALIZE_HOT(result, vec) math_vec3_normalize_approx(result, vec)
+#else
+	#define MATH_NORMALIZE_HOT(result, vec) math_vec3_normalize_to(result, vec)
+#endif
 
 // VEC3 END
 
@@ -100,27 +129,29 @@ void math_vec3_normalize_to(vec3 result, vec3 vec);
  * VEC4 BEGIN
 */
 
-void math_vec4_zero(vec4 vec);
+MATH_API void math_vec4_zero(vec4 vec);
 
-void math_vec4_min(vec4 result, vec4 vec_a, vec4 vec_b);
+MATH_API void math_vec4_min(vec4 result, vec4 vec_a, vec4 vec_b);
 
-void math_vec4_max(vec4 result, vec4 vec_a, vec4 vec_b);
+MATH_API void math_vec4_max(vec4 result, vec4 vec_a, vec4 vec_b);
 
-void math_vec4_copy(vec4 result, vec4 original);
+MATH_API void math_vec4_copy(vec4 result, vec4 original);
 
-void math_vec4_add(vec4 result, vec4 vec_a, vec4 vec_b);
+MATH_API void math_vec4_add(vec4 result, vec4 vec_a, vec4 vec_b);
 
-void math_vec4_sub(vec4 result, vec4 vec_a, vec4 vec_b);
+MATH_API void math_vec4_sub(vec4 result, vec4 vec_a, vec4 vec_b);
 
-void math_vec4_div(vec4 result, vec4 vec, float div);
+MATH_API void math_vec4_div(vec4 result, vec4 vec, float div);
 
-void math_vec4_scale(vec4 result, vec4 vec, float scalar);
+MATH_API void math_vec4_scale(vec4 result, vec4 vec, float scalar);
 
-float math_vec4_dot(vec4 vec_a, vec4 vec_b);
+MATH_API float math_vec4_dot(vec4 vec_a, vec4 vec_b);
 
-float math_vec4_len(vec4 vec);
+MATH_API float math_vec4_len(vec4 vec);
 
-void math_vec4_normalize(vec4 vec);
+MATH_API void math_vec4_normalize(vec4 vec);
+
+MATH_API void math_vec4_normalize_approx(vec4 result, vec4 vec); //see math_rsqrt
 
 // VEC4 END
 
@@ -128,53 +159,360 @@ void math_vec4_normalize(vec4 vec);
  * MAT4 BEGIN
 */
 
-void math_mat4_zero(mat4 mat);
+MATH_API void math_mat4_zero(mat4 mat);
+
+MATH_API void math_mat4_identity(mat4 mat);
 
-void math_mat4_identity(mat4 mat);
+MATH_API void math_mat4_add(mat4 result, mat4 mat_a, mat4 mat_b);
 
-void math_mat4_add(mat4 result, mat4 mat_a, mat4 mat_b);
+MATH_API void math_mat4_sub(mat4 result, mat4 mat_a, mat4 mat_b);
 
-void math_mat4_sub(mat4 result, mat4 mat_a, mat4 mat_b);
+MATH_API void math_mat4_scale(mat4 result, mat4 mat, float s);
 
-void math_mat4_scale(mat4 result, mat4 mat, float s);
+MATH_API void math_mat4_row(vec4 result, mat4 mat, uint8_t index);
 
-void math_mat4_row(vec4 result, mat4 mat, uint8_t index);
+MATH_API void math_mat4_col(vec4 result, mat4 mat, uint8_t index);
 
-void math_mat4_col(vec4 result, mat4 mat, uint8_t index);
+MATH_API void math_mat4_scale_xyz(mat4 mat, float scalar); //do the same as math_mat4_scale
 
-void math_mat4_scale_xyz(mat4 mat, float scalar); //do the same as math_mat4_scale
+MATH_API void math_mat4_mul(mat4 result, mat4 mat_a, mat4 mat_b); //result may be mat_a or mat_b
 
-void math_mat4_mul(mat4 result, mat4 mat_a, mat4 mat_b);
+MATH_API void math_mat4_copy(mat4 result, mat4 original);
 
-void math_mat4_copy(mat4 result, mat4 original);
+MATH_API void math_mat4_translate(mat4 mat, vec3 vec);
 
-void math_mat4_translate(mat4 mat, vec3 vec);
+MATH_API void math_mat4_rotate_axis(mat4 mat, vec3 axis, float angle);
 
-void math_mat4_rotate_axis(mat4 mat, vec3 axis, float angle);
+MATH_API void math_mat4_rotate_x(mat4 result, mat4 mat, float angle);
 
-void math_mat4_rotate_x(mat4 result, mat4 mat, float angle);
+MATH_API void math_mat4_rotate_y(mat4 result, mat4 mat, float angle);
 
-void math_mat4_rotate_y(mat4 result, mat4 mat, float angle);
+MATH_API void math_mat4_rotate_z(mat4 result, mat4 mat, float angle);
 
-void math_mat4_rotate_z(mat4 result, mat4 mat, float angle);
+MATH_API void math_mat4_transpose(mat4 result, mat4 mat);
+
+/*
+ * Inverses give a zero matrix when mat is singular. The _affine ones
+ * assume the last row is (0, 0, 0, 1) (rotation, scale, shear and
+ * translation only) and are a lot cheaper than the general one.
+ * The normal matrix is the inverse-transpose of the model's upper 3x3,
+ * returned as a mat4 with no translation (use mat3(normal_matrix) in GLSL).
+*/
+
+MATH_API void math_mat4_inverse(mat4 result, mat4 mat);
+
+MATH_API void math_mat4_inverse_affine(mat4 result, mat4 mat);
+
+MATH_API void math_mat4_inverse_transpose(mat4 result, mat4 mat);
+
+MATH_API void math_mat4_normal_matrix(mat4 result, mat4 model);
 
 // MAT4 END
 
+/*
+ * MAT4X3 BEGIN
+ * Affine transforms without the constant (0, 0, 0, 1) row: 48 bytes
+ * instead of 64. Same column-major layout as mat4, the fourth column is
+ * the translation, so it matches GLSL's mat4x3 (glUniformMatrix4x3fv).
+ * math_mat4x3_mul has the same argument order as math_mat4_mul.
+ * compose builds translation * rotation * scale. The inverse gives a zero
+ * matrix when mat is singular. Expand with to_mat4 only where a full
+ * mat4 is needed (uploads, projection).
+*/
+
+MATH_API void math_mat4x3_identity(mat4x3 mat);
+
+MATH_API void math_mat4x3_copy(mat4x3 result, mat4x3 original);
+
+MATH_API void math_mat4x3_from_mat4(mat4x3 result, mat4 mat); //drops the last row
+
+MATH_API void math_mat4x3_to_mat4(mat4 result, mat4x3 mat);
+
+MATH_API void math_mat4x3_mul(mat4x3 result, mat4x3 mat_a, mat4x3 mat_b);
+
+MATH_API void math_mat4x3_inverse(mat4x3 result, mat4x3 mat);
+
+MATH_API void math_mat4x3_compose(mat4x3 result, vec3 translation, quat rotation, vec3 scale);
+
+MATH_API void math_mat4x3_transform_point(vec3 result, mat4x3 mat, vec3 point);
+
+MATH_API void math_mat4x3_transform_dir(vec3 result, mat4x3 mat, vec3 dir);
+
+MATH_API void math_mat4x3_mul_batch(mat4x3 *result, mat4x3 *mat_a, mat4x3 *mat_b, size_t count);
+
+MATH_API void math_mat4x3_inverse_batch(mat4x3 *result, mat4x3 *mats, size_t count);
+
+MATH_API void math_mat4x3_to_mat4_batch(mat4 *result, mat4x3 *mats, size_t count);
+
+//MAT4X3 END
+
+/*
+ * BATCH BEGIN
+ * Transform many vec3 with one column-major mat4 (the same layout that
+ * gets uploaded to OpenGL): result = mat * (x, y, z, 1) for points and
+ * mat * (x, y, z, 0) for directions. There's no w divide, use these with
+ * affine matrices. Strides are counted in floats, so the 8-float vertex
+ * layout in main.c is stride 8. result may be the same array as the input
+ * only when result_stride == stride, so every element is read before it
+ * is written and threads never touch each other's elements. Any other
+ * overlap between result and the input is not allowed.
+ * Big batches are split across threads when building with -fopenmp.
+*/
+
+MATH_API void math_mat4_transform_points
+(
+	float *result,
+	size_t result_stride,
+	mat4 mat,
+	const float *points,
+	size_t stride,
+	size_t count
+);
+
+MATH_API void math_mat4_transform_dirs
+(
+	float *result,
+	size_t result_stride,
+	mat4 mat,
+	const float *dirs,
+	size_t stride,
+	size_t count
+);
+
+MATH_API void math_mat4_transform_points_soa
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	mat4 mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count
+);
+
+MATH_API void math_mat4_transform_dirs_soa
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	mat4 mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count
+);
+
+MATH_API void math_mat4_inverse_batch(mat4 *result, mat4 *mats, size_t count);
+
+MATH_API void math_mat4_inverse_affine_batch(mat4 *result, mat4 *mats, size_t count);
+
+MATH_API void math_mat4_normal_matrix_batch(mat4 *result, mat4 *models, size_t count);
+
+//renormalize many vec3 (e.g. normals after a transform), see math_rsqrt
+MATH_API void math_vec3_normalize_approx_batch
+(
+	float *result,
+	size_t result_stride,
+	const float *vecs,
+	size_t stride,
+	size_t count
+);
+
+//BATCH END
+
+/*
+ * STREAM BEGIN
+ * SoA arrays of vectors: every component has its own array, 32-byte
+ * aligned and padded with zeros to a multiple of MATH_STREAM_WIDTH, so
+ * the SIMD kernels never need a scalar tail. Allocation returns 0 when
+ * out of memory. from_aos returns 0 and leaves the stream as it was
+ * when count is over its capacity. The result stream needs at least
+ * the capacity of the inputs and may be one of them. Normalizing a zero
+ * vector gives zero. dot and len write count floats to a plain array.
+*/
+
+#define MATH_STREAM_WIDTH 8
+
+typedef struct vec3_stream
+{
+	float *x;
+	float *y;
+	float *z;
+	size_t count;
+	size_t capacity;
+} vec3_stream;
+
+typedef struct vec4_stream
+{
+	float *x;
+	float *y;
+	float *z;
+	float *w;
+	size_t count;
+	size_t capacity;
+} vec4_stream;
+
+MATH_API int math_vec3_stream_alloc(vec3_stream *stream, size_t capacity);
+
+MATH_API void math_vec3_stream_free(vec3_stream *stream);
+
+MATH_API int math_vec3_stream_from_aos(vec3_stream *stream, const float *vecs, size_t stride, size_t count);
+
+MATH_API void math_vec3_stream_to_aos(float *vecs, size_t stride, vec3_stream *stream);
+
+MATH_API void math_vec3_stream_add(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b);
+
+MATH_API void math_vec3_stream_sub(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b);
+
+MATH_API void math_vec3_stream_scale(vec3_stream *result, vec3_stream *stream, float scalar);
+
+MATH_API void math_vec3_stream_dot(float *result, vec3_stream *stream_a, vec3_stream *stream_b);
+
+MATH_API void math_vec3_stream_cross(vec3_stream *result, vec3_stream *stream_a, vec3_stream *stream_b);
+
+MATH_API void math_vec3_stream_len(float *result, vec3_stream *stream);
+
+MATH_API void math_vec3_stream_normalize(vec3_stream *result, vec3_stream *stream);
+
+MATH_API void math_vec3_stream_normalize_approx(vec3_stream *result, vec3_stream *stream);
+
+MATH_API int math_vec4_stream_alloc(vec4_stream *stream, size_t capacity);
+
+MATH_API void math_vec4_stream_free(vec4_stream *stream);
+
+MATH_API int math_vec4_stream_from_aos(vec4_stream *stream, const float *vecs, size_t stride, size_t count);
+
+MATH_API void math_vec4_stream_to_aos(float *vecs, size_t stride, vec4_stream *stream);
+
+MATH_API void math_vec4_stream_add(vec4_stream *result, vec4_stream *stream_a, vec4_stream *stream_b);
+
+MATH_API void math_vec4_stream_sub(vec4_stream *result, vec4_stream *stream_a, vec4_stream *stream_b);
+
+MATH_API void math_vec4_stream_scale(vec4_stream *result, vec4_stream *stream, float scalar);
+
+MATH_API void math_vec4_stream_dot(float *result, vec4_stream *stream_a, vec4_stream *stream_b);
+
+MATH_API void math_vec4_stream_len(float *result, vec4_stream *stream);
+
+MATH_API void math_vec4_stream_normalize(vec4_stream *result, vec4_stream *stream);
+
+MATH_API void math_vec4_stream_normalize_approx(vec4_stream *result, vec4_stream *stream);
+
+//STREAM END
+
+/*
+ * PACK BEGIN
+ * Compressed vertex attributes. Halves round to nearest even like F16C
+ * and keep about 3 significant digits, fine for object-space positions
+ * within a few hundred units and for texcoords. Octahedral normals are
+ * two snorm16 (under 0.04 degrees of error, decode with oct_decode in
+ * main.c's shader). snorm16 clamps to [-1, 1] and maps to +-32767.
+ * The batch forms use SSE2/F16C kernels with the same results.
+*/
+
+typedef struct vertex_packed
+{
+	uint16_t position[4]; //half floats, w = 1
+	int16_t normal[2]; //octahedral snorm16
+	int16_t texcoord[2]; //snorm16 of texcoord / uv_scale
+} vertex_packed; //16 bytes, down from 32
+
+MATH_API uint16_t math_float_to_half(float value);
+
+MATH_API float math_half_to_float(uint16_t half);
+
+MATH_API int16_t math_snorm16(float value);
+
+MATH_API void math_octahedral_encode(int16_t result[2], vec3 normal);
+
+MATH_API void math_octahedral_decode(vec3 result, const int16_t packed[2]);
+
+MATH_API void math_float_to_half_batch(uint16_t *result, const float *values, size_t count);
+
+//normals every stride floats, two int16 per normal in result
+MATH_API void math_octahedral_encode_batch(int16_t *result, const float *normals, size_t stride, size_t count);
+
+/**
+ * Strides are in floats, like the batch transforms, so main.c's
+ * interleaved layout is positions = vertices, normals = vertices + 3,
+ * texcoords = vertices + 6, stride 8.
+ * @brief Pack vertices into vertex_packed
+ * @param uv_scale (float) biggest absolute texcoord value, the shader multiplies it back
+*/
+MATH_API void math_pack_vertices
+(
+	vertex_packed *result,
+	const float *positions,
+	const float *normals,
+	const float *texcoords,
+	size_t stride,
+	float uv_scale,
+	size_t count
+);
+
+//PACK END
+
 /*
  * QUAT BEGIN
 */
 
-void math_quat_zero(quat qt);
+MATH_API void math_quat_zero(quat qt);
+
+MATH_API void math_quat_identity(quat qt);
+
+MATH_API void math_quat_add(quat result, quat qt_a, quat qt_b);
 
-void math_quat_identity(quat qt);
+MATH_API void math_quat_sub(quat result, quat qt_a, quat qt_b);
 
-void math_quat_add(quat result, quat qt_a, quat qt_b);
+MATH_API void math_quat_scale(quat result, quat qt, float scalar);
 
-void math_quat_sub(quat result, quat qt_a, quat qt_b);
+MATH_API void math_quat_norm(quat result, quat qt);
 
-void math_quat_scale(quat result, quat qt, float scalar);
+/*
+ * Quaternions are (x, y, z, w) and expected to be unit length unless
+ * said otherwise. math_quat_mul(result, a, b) is a * b: rotating by the
+ * result rotates by b first, then by a. Interpolations take the
+ * shortest path. Angles are in radians.
+*/
 
-void math_quat_norm(quat result, quat qt);
+MATH_API void math_quat_copy(quat result, quat original);
+
+MATH_API float math_quat_dot(quat qt_a, quat qt_b);
+
+MATH_API void math_quat_conjugate(quat result, quat qt);
+
+MATH_API void math_quat_inverse(quat result, quat qt); //works for any length
+
+MATH_API void math_quat_mul(quat result, quat qt_a, quat qt_b);
+
+MATH_API void math_quat_from_axis_angle(quat result, vec3 axis, float angle); //axis normalized
+
+MATH_API void math_quat_rotate_vec3(vec3 result, quat qt, vec3 vec);
+
+MATH_API void math_quat_to_mat4(mat4 result, quat qt);
+
+MATH_API void math_quat_from_mat4(quat result, mat4 mat); //rotation part only
+
+MATH_API void math_quat_nlerp(quat result, quat qt_a, quat qt_b, float t);
+
+MATH_API void math_quat_slerp(quat result, quat qt_a, quat qt_b, float t);
+
+/*
+ * Batched forms, element i of every array goes together.
+*/
+
+MATH_API void math_quat_mul_batch(quat *result, quat *qt_a, quat *qt_b, size_t count);
+
+MATH_API void math_quat_from_axis_angle_batch(quat *result, vec3 *axes, const float *angles, size_t count);
+
+MATH_API void math_quat_rotate_vec3_batch(vec3 *result, quat *qts, vec3 *vecs, size_t count);
+
+MATH_API void math_quat_to_mat4_batch(mat4 *result, quat *qts, size_t count);
+
+MATH_API void math_quat_nlerp_batch(quat *result, quat *qt_a, quat *qt_b, const float *t, size_t count);
+
+MATH_API void math_quat_slerp_batch(quat *result, quat *qt_a, quat *qt_b, const float *t, size_t count);
 
 //QUAT END
 
@@ -182,22 +520,310 @@ void math_quat_norm(quat result, quat qt);
  * CAM BEGIN
 */
 
-void math_lookat(mat4 result, vec3 position, vec3 target, vec3 up);
+MATH_API void math_lookat(mat4 result, vec3 position, vec3 target, vec3 up);
+
+MATH_API void math_perspective(mat4 result, float fov, float aspect, float near, float far);
 
-void math_perspective(mat4 result, float fov, float aspect, float near, float far);
+/*
+ * Reverse-Z: near maps to depth 1 and far to 0. Float depth is most
+ * precise near 0, where the perspective divide squeezes distant depths,
+ * so the two errors cancel and distant surfaces don't z-fight. Needs a
+ * [0, 1] clip range (glClipControl), a 32-bit float depth buffer, a
+ * depth clear of 0 and GL_GREATER. The infinite version has no far
+ * plane at all, depth goes to 0 at infinity.
+*/
+
+MATH_API void math_perspective_reverse(mat4 result, float fov, float aspect, float near, float far);
+
+MATH_API void math_perspective_reverse_infinite(mat4 result, float fov, float aspect, float near);
+
+/**
+ * Skips the zeros of a projection from any math_perspective*: 24 multiplies
+ * and 8 adds instead of 64 and 48. Same argument order as
+ * math_mat4_mul, result may be the same matrix as view.
+ * @brief perspective * view
+*/
+MATH_API void math_mat4_mul_perspective(mat4 result, mat4 view, mat4 perspective);
+
+/**
+ * Shifts everything drawn with the matrix by (x, y) in NDC, 2 / width
+ * per pixel, for any projection. Works on projection * view too, so
+ * the math_mat4_mul_perspective shortcut can stay on the plain
+ * projection. result may be mat.
+ * @brief Sub-pixel offset of a projection
+*/
+MATH_API void math_mat4_jitter(mat4 result, mat4 mat, float x, float y);
+
+/*
+ * Many views at once, for cube map faces, shadow cascades or viewports.
+ * Element i of every array goes together and matches a math_lookat /
+ * math_perspective call. lookat_batch can write the views, the
+ * view-projections (math_mat4_mul_perspective) or both, pass NULL for
+ * the one not needed. projection_stride is 1 for one projection per
+ * view or 0 to share projections[0]. Big batches are split across threads.
+ * cubemap_lookat gives the six faces (+X, -X, +Y, -Y, +Z, -Z, OpenGL
+ * orientation, 90 degrees square) of each position, views[6 * i + face].
+*/
+
+MATH_API void math_lookat_batch
+(
+	mat4 *views,
+	mat4 *view_projections,
+	vec3 *positions,
+	vec3 *targets,
+	vec3 *ups,
+	mat4 *projections,
+	size_t projection_stride,
+	size_t count
+);
+
+MATH_API void math_perspective_batch
+(
+	mat4 *result,
+	const float *fovs,
+	const float *aspects,
+	const float *nears,
+	const float *fars,
+	size_t count
+);
+
+MATH_API void math_cubemap_lookat(mat4 *views, mat4 *view_projections, vec3 *positions, float near, float far, size_t count);
 
 //CAM END
 
+/*
+ * FRUSTUM BEGIN
+ * Planes are (a, b, c, d) with normals pointing inside, in the order
+ * left, right, bottom, top, near, far. Get them from projection * view,
+ * which is math_mat4_mul(view_projection, view, projection). With
+ * reverse-Z the last two swap (far, near), with an infinite far plane
+ * that one lets everything through.
+ * Boxes are center/half-extent. The batch versions take SoA arrays and
+ * set one bit per object in visible, (count + 31) / 32 words.
+*/
+
+MATH_API void math_frustum_planes(vec4 planes[6], mat4 view_projection);
+
+MATH_API int math_frustum_test_aabb(vec4 planes[6], vec3 center, vec3 extent);
+
+MATH_API int math_frustum_test_sphere(vec4 planes[6], vec3 center, float radius);
+
+MATH_API void math_frustum_cull_aabbs
+(
+	uint32_t *visible,
+	vec4 planes[6],
+	const float *center_x,
+	const float *center_y,
+	const float *center_z,
+	const float *extent_x,
+	const float *extent_y,
+	const float *extent_z,
+	size_t count
+);
+
+MATH_API void math_frustum_cull_spheres
+(
+	uint32_t *visible,
+	vec4 planes[6],
+	const float *center_x,
+	const float *center_y,
+	const float *center_z,
+	const float *radius,
+	size_t count
+);
+
+//FRUSTUM END
+
+/*
+ * AABB BEGIN
+ * Axis aligned boxes as min/max corners. Empty is min FLT_MAX, max
+ * -FLT_MAX, merging with it changes nothing. transform takes an affine
+ * matrix (e.g. a world matrix) and gives the tightest box around the
+ * transformed box (Arvo, "Transforming Axis-Aligned Bounding Boxes"):
+ * new center from the matrix, new half-extent from its absolute values.
+ * Empty boxes stay empty unless the matrix has a zero row. result may
+ * be the same box as the input. The batch form goes with
+ * SSE2 kernels (same results) and threads.
+*/
+
+typedef struct aabb
+{
+	vec3 min;
+	vec3 max;
+} aabb;
+
+MATH_API void math_aabb_empty(aabb *box);
+
+MATH_API void math_aabb_merge(aabb *result, const aabb *box_a, const aabb *box_b);
+
+MATH_API void math_aabb_transform(aabb *result, const aabb *box, mat4x3 mat);
+
+MATH_API void math_aabb_transform_batch(aabb *result, const aabb *boxes, mat4x3 *mats, size_t count);
+
+//AABB END
+
+/*
+ * RAY BEGIN
+ * Rays hit in [t_min, t_max), t in units of direction (which doesn't
+ * have to be normalized). Triangle tests are Moller-Trumbore and two
+ * sided, u and v are the barycentrics of the second and third vertex.
+ * Boxes are min/max here, the slab test. Ties between triangles at the
+ * same t go to the lowest index. The stream and packet forms use 4/8
+ * wide SSE2/AVX kernels with the same results as the scalar code.
+*/
+
+#define MATH_RAY_MISS UINT32_MAX
+#define MATH_RAY_PACKET 8
+
+typedef struct ray
+{
+	vec3 origin;
+	vec3 direction;
+	float t_min;
+	float t_max;
+} ray; //8 floats in a row, the kernels read it like that
+
+typedef struct ray_hit
+{
+	float t;
+	float u;
+	float v;
+	uint32_t primitive; //MATH_RAY_MISS if nothing was hit
+} ray_hit;
+
+//SoA, lane i of every array is ray i. t_max < t_min marks an unused lane
+typedef struct ray_packet
+{
+	float origin_x[MATH_RAY_PACKET];
+	float origin_y[MATH_RAY_PACKET];
+	float origin_z[MATH_RAY_PACKET];
+	float direction_x[MATH_RAY_PACKET];
+	float direction_y[MATH_RAY_PACKET];
+	float direction_z[MATH_RAY_PACKET];
+	float t_min[MATH_RAY_PACKET];
+	float t_max[MATH_RAY_PACKET];
+} ray_packet;
+
+typedef struct ray_packet_hit
+{
+	float t[MATH_RAY_PACKET];
+	float u[MATH_RAY_PACKET];
+	float v[MATH_RAY_PACKET];
+	uint32_t primitive[MATH_RAY_PACKET];
+} ray_packet_hit;
+
+//triangle soup as SoA: first vertex and the two edges leaving it
+typedef struct triangle_stream
+{
+	vec3_stream v0;
+	vec3_stream e1; //v1 - v0
+	vec3_stream e2; //v2 - v0
+} triangle_stream;
+
+MATH_API int math_triangle_stream_alloc(triangle_stream *tris, size_t capacity);
+
+MATH_API void math_triangle_stream_free(triangle_stream *tris);
+
+//three vertices per triangle, every stride floats (main.c's layout is stride 8).
+//0 when count is over the capacity, like the vec3 streams
+MATH_API int math_triangle_stream_from_aos(triangle_stream *tris, const float *vertices, size_t stride, size_t count);
+
+/**
+ * x and y are in NDC ([-1, 1], y up). The ray starts on the near plane
+ * with a normalized direction, t_max is the distance to the far plane
+ * (INFINITY for math_perspective_reverse_infinite). Works with any of
+ * the math_perspective* projections.
+ * @brief Picking ray through a point of the screen
+ * @param inverse_view_projection (mat4) inverse of projection * view
+*/
+MATH_API void math_ray_from_screen(ray *result, mat4 inverse_view_projection, float x, float y);
+
+MATH_API void math_ray_packet_from_rays(ray_packet *packet, const ray *rays, size_t count); //count <= 8
+
+MATH_API int math_ray_triangle(ray_hit *hit, const ray *r, vec3 v0, vec3 v1, vec3 v2); //primitive untouched
+
+MATH_API int math_ray_aabb(float *t_near, const ray *r, vec3 min, vec3 max);
+
+MATH_API int math_ray_nearest_triangle(ray_hit *hit, const ray *r, triangle_stream *tris);
+
+MATH_API void math_ray_nearest_triangle_batch(ray_hit *hits, const ray *rays, size_t count, triangle_stream *tris);
+
+MATH_API void math_ray_packet_nearest_triangle(ray_packet_hit *hit, const ray_packet *rays, triangle_stream *tris);
+
+/*
+ * Range forms for acceleration structure leaves: test triangles
+ * first..first + count, keeping hit (closest so far) unless something is
+ * closer. Return whether (which lanes) got a closer hit.
+*/
+
+MATH_API int math_ray_nearest_triangle_range(ray_hit *hit, const ray *r, const triangle_stream *tris, size_t first, size_t count);
+
+MATH_API uint32_t math_ray_packet_nearest_triangle_range(ray_packet_hit *hit, const ray_packet *rays, const triangle_stream *tris, size_t first, size_t count);
+
+//bit i set if ray i enters the box, t_near (may be NULL) gets the entry t
+MATH_API uint32_t math_ray_packet_aabb(float *t_near, const ray_packet *rays, vec3 min, vec3 max);
+
+//RAY END
+
 /*
  * OTHER BEGIN
 */
 
-float deg_to_rad(float deg);
+MATH_API float deg_to_rad(float deg);
 
-float rad_to_deg(float rad);
+MATH_API float rad_to_deg(float rad);
 
-float math_lerp(float v0, float v1, float t);
+MATH_API float math_lerp(float v0, float v1, float t);
+
+/**
+ * Hardware estimate (rsqrtss/rsqrtps) refined with one Newton step. Max
+ * error is 5 ulp (relative 3e-7) over all normal floats. Without SSE it
+ * falls back to a bit trick estimate with two Newton steps, 74 ulp
+ * (relative 5e-6). Components from the *_normalize_approx functions are
+ * within 6 ulp of the exact result with SSE. Squared lengths below
+ * FLT_MIN (zero included) normalize to zero. For a single vector this
+ * is about as fast as sqrtf plus a divide on recent CPUs, the gain is in
+ * the batch and stream forms.
+ * @brief Approximate 1 / sqrt(x), x > 0
+*/
+MATH_API float math_rsqrt(float x);
+
+/**
+ * Polynomial approximation, not libm. Absolute error below 1e-7 (about
+ * 1.5 ulp away from zero) for |angle| <= 8192, it degrades past that.
+ * The batch form uses SSE2/AVX2 kernels with the same results.
+ * @brief Sine and cosine of angle (radians) in one go
+*/
+MATH_API void math_sincos(float angle, float *s, float *c);
+
+MATH_API void math_sincos_batch(float *s, float *c, const float *angles, size_t count);
+
+/**
+ * 10 bits per axis, x in the highest bits, over the box min..max (points
+ * outside are clamped). Sorting by code orders points along a Z curve,
+ * which is what bvh_build_lbvh does. The batch form takes SoA arrays and
+ * uses SSE2/AVX2 kernels with the same results.
+ * @brief 30-bit Morton code of a point
+*/
+MATH_API uint32_t math_morton3(vec3 point, vec3 min, vec3 max);
+
+MATH_API void math_morton3_batch(uint32_t *result, const float *x, const float *y, const float *z, vec3 min, vec3 max, size_t count);
+
+/*
+ * Low-discrepancy sequences in [0, 1): consecutive points spread out
+ * evenly, for sub-pixel jitter and sampling. Halton is the radical
+ * inverse of index in a prime base (2 and 3 for 2D, start at 1 since 0
+ * gives 0). R2 (Roberts) is one multiply per axis, any index.
+*/
+
+MATH_API float math_halton(uint32_t index, uint32_t base);
+
+MATH_API void math_r2(vec2 result, uint32_t index);
 
 //OTHER END
 
+#ifdef MATH_INLINE
+	#include "3d_math.c"
+#endif
+
 #endif
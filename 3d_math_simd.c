@@ -0,0 +1,2271 @@
+/**
+ * Matheus' Simple 3D Math
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file 3d_math_simd.c
+ * @brief 3d_math_simd.h implementation file
+ *
+ * Every kernel carries its own target attribute, so this file builds
+ * with plain flags and only runs AVX code on CPUs that have it.
+ *
+ * The SSE2 and AVX kernels do the same operations in the same order as
+ * the scalar code, so their results are bit-exact. Two exceptions:
+ * mat4_inverse_sse2 is a 2x2 block adjugate instead of the scalar
+ * cofactors (a few ulp apart on well conditioned matrices, more as the
+ * conditioning gets worse), and quat_slerp_sse2 uses polynomial acos and
+ * sin instead of libm (within 3e-7). The AVX2 kernels use
+ * FMA, which skips one rounding per multiply-add: they match a scalar
+ * build with -mfma -ffp-contract=fast, not the default one.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "3d_math_simd.h"
+
+math_simd_table math_simd;
+
+static int math_simd_level = MATH_SIMD_SCALAR;
+
+#if defined(MATH_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define MATH_SIMD_X86
+#endif
+
+#ifdef MATH_SIMD_X86
+
+#include <immintrin.h>
+
+#define MATH_TARGET_SSE2 __attribute__((target("sse2")))
+#define MATH_TARGET_AVX __attribute__((target("avx")))
+#define MATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+/*
+ * SSE2 BEGIN
+*/
+
+MATH_TARGET_SSE2 static void mat4_mul_sse2(float *result, const float *mat_a, const float *mat_b)
+{
+	__m128 b0 = _mm_loadu_ps(mat_b);
+	__m128 b1 = _mm_loadu_ps(mat_b + 4);
+	__m128 b2 = _mm_loadu_ps(mat_b + 8);
+	__m128 b3 = _mm_loadu_ps(mat_b + 12);
+	__m128 rows[4];
+
+	for(int i = 0; i < 4; i++)
+	{
+		__m128 a = _mm_loadu_ps(mat_a + 4 * i);
+		//start from zero like the scalar loop, keeps -0.0f results identical
+		__m128 acc = _mm_setzero_ps();
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), b0));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x55), b1));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xaa), b2));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xff), b3));
+		rows[i] = acc;
+	}
+
+	for(int i = 0; i < 4; i++)
+		_mm_storeu_ps(result + 4 * i, rows[i]);
+}
+
+MATH_TARGET_SSE2 static void mat4_add_sse2(float *result, const float *mat_a, const float *mat_b)
+{
+	for(int i = 0; i < 16; i += 4)
+		_mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(mat_a + i), _mm_loadu_ps(mat_b + i)));
+}
+
+MATH_TARGET_SSE2 static void mat4_sub_sse2(float *result, const float *mat_a, const float *mat_b)
+{
+	for(int i = 0; i < 16; i += 4)
+		_mm_storeu_ps(result + i, _mm_sub_ps(_mm_loadu_ps(mat_a + i), _mm_loadu_ps(mat_b + i)));
+}
+
+MATH_TARGET_SSE2 static void mat4_scale_sse2(float *result, const float *mat, float s)
+{
+	__m128 k = _mm_set1_ps(s);
+	for(int i = 0; i < 16; i += 4)
+		_mm_storeu_ps(result + i, _mm_mul_ps(_mm_loadu_ps(mat + i), k));
+}
+
+/*
+ * scalar tail for the SoA kernels, same formula as 3d_math.c
+*/
+static void transform_soa_tail
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	const float *mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t first,
+	size_t count,
+	int translate
+)
+{
+	float tx = translate ? mat[12] : 0.0f;
+	float ty = translate ? mat[13] : 0.0f;
+	float tz = translate ? mat[14] : 0.0f;
+
+	for(size_t i = first; i < count; i++)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		result_x[i] = mat[0] * px + mat[4] * py + mat[8] * pz + tx;
+		result_y[i] = mat[1] * px + mat[5] * py + mat[9] * pz + ty;
+		result_z[i] = mat[2] * px + mat[6] * py + mat[10] * pz + tz;
+	}
+}
+
+/*
+ * scalar tails for the culling kernels, same tests as 3d_math.c
+*/
+static void cull_aabbs_tail(uint32_t *visible, const float *planes, const float *const bounds[6], size_t first, size_t count)
+{
+	for(size_t i = first; i < count; i++)
+	{
+		int inside = 1;
+		for(int j = 0; j < 6 && inside; j++)
+		{
+			const float *p = planes + j * 4;
+			float d = p[0] * bounds[0][i] + p[1] * bounds[1][i] + p[2] * bounds[2][i] + p[3];
+			float r = fabsf(p[0]) * bounds[3][i] + fabsf(p[1]) * bounds[4][i] + fabsf(p[2]) * bounds[5][i];
+			inside = !(d + r < 0.0f);
+		}
+		if(i % 32 == 0)
+			visible[i / 32] = 0;
+		if(inside)
+			visible[i / 32] |= 1u << (i % 32);
+	}
+}
+
+static void cull_spheres_tail(uint32_t *visible, const float *planes, const float *const bounds[4], size_t first, size_t count)
+{
+	for(size_t i = first; i < count; i++)
+	{
+		int inside = 1;
+		for(int j = 0; j < 6 && inside; j++)
+		{
+			const float *p = planes + j * 4;
+			float d = p[0] * bounds[0][i] + p[1] * bounds[1][i] + p[2] * bounds[2][i] + p[3];
+			inside = !(d < -bounds[3][i]);
+		}
+		if(i % 32 == 0)
+			visible[i / 32] = 0;
+		if(inside)
+			visible[i / 32] |= 1u << (i % 32);
+	}
+}
+
+MATH_TARGET_SSE2 static void transform_aos_sse2
+(
+	float *result,
+	size_t result_stride,
+	const float *mat,
+	const float *points,
+	size_t stride,
+	size_t count,
+	int translate
+)
+{
+	__m128 c0 = _mm_loadu_ps(mat);
+	__m128 c1 = _mm_loadu_ps(mat + 4);
+	__m128 c2 = _mm_loadu_ps(mat + 8);
+	__m128 c3 = _mm_loadu_ps(mat + 12);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *p = points + i * stride;
+		float *r = result + i * result_stride;
+
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(p[0]));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+		if(translate)
+			v = _mm_add_ps(v, c3);
+
+		//only xyz, the fourth float belongs to the next attribute
+		_mm_storel_pi((__m64 *)r, v);
+		_mm_store_ss(r + 2, _mm_movehl_ps(v, v));
+	}
+}
+
+MATH_TARGET_SSE2 static void transform_soa_sse2
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	const float *mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count,
+	int translate
+)
+{
+	__m128 m[12];
+	for(int j = 0; j < 12; j++)
+		m[j] = _mm_set1_ps(mat[j]);
+	__m128 tx = _mm_set1_ps(translate ? mat[12] : 0.0f);
+	__m128 ty = _mm_set1_ps(translate ? mat[13] : 0.0f);
+	__m128 tz = _mm_set1_ps(translate ? mat[14] : 0.0f);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pz = _mm_loadu_ps(z + i);
+
+		__m128 rx = _mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[4], py));
+		__m128 ry = _mm_add_ps(_mm_mul_ps(m[1], px), _mm_mul_ps(m[5], py));
+		__m128 rz = _mm_add_ps(_mm_mul_ps(m[2], px), _mm_mul_ps(m[6], py));
+		rx = _mm_add_ps(_mm_add_ps(rx, _mm_mul_ps(m[8], pz)), tx);
+		ry = _mm_add_ps(_mm_add_ps(ry, _mm_mul_ps(m[9], pz)), ty);
+		rz = _mm_add_ps(_mm_add_ps(rz, _mm_mul_ps(m[10], pz)), tz);
+
+		_mm_storeu_ps(result_x + i, rx);
+		_mm_storeu_ps(result_y + i, ry);
+		_mm_storeu_ps(result_z + i, rz);
+	}
+	transform_soa_tail(result_x, result_y, result_z, mat, x, y, z, i, count, translate);
+}
+
+/*
+ * General inverse by 2x2 blocks: with M = | A B |, the inverse is
+ *                                        | C D |
+ * built from adjugates of the 2x2 blocks, no cofactor expansion.
+ * inv(transpose(M)) == transpose(inv(M)), so the storage order of the
+ * matrix doesn't matter here.
+*/
+#define MATH_SWIZZLE(v, x, y, z, w) \
+	_mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), _MM_SHUFFLE(w, z, y, x)))
+#define MATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+//2x2 blocks stored as (m00, m01, m10, m11)
+MATH_TARGET_SSE2 static inline __m128 mat2_mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 0, 3, 0, 3)),
+		_mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+//adj(a) * b
+MATH_TARGET_SSE2 static inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(MATH_SWIZZLE(a, 3, 3, 0, 0), b),
+		_mm_mul_ps(MATH_SWIZZLE(a, 1, 1, 2, 2), MATH_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+//a * adj(b)
+MATH_TARGET_SSE2 static inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 3, 0, 3, 0)),
+		_mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+MATH_TARGET_SSE2 static void mat4_inverse_sse2(float *result, const float *mat)
+{
+	__m128 m0 = _mm_loadu_ps(mat);
+	__m128 m1 = _mm_loadu_ps(mat + 4);
+	__m128 m2 = _mm_loadu_ps(mat + 8);
+	__m128 m3 = _mm_loadu_ps(mat + 12);
+
+	__m128 a = _mm_movelh_ps(m0, m1);
+	__m128 b = _mm_movehl_ps(m1, m0);
+	__m128 c = _mm_movelh_ps(m2, m3);
+	__m128 d = _mm_movehl_ps(m3, m2);
+
+	//(|A|, |B|, |C|, |D|)
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(MATH_SHUFFLE(m0, m2, 0, 2, 0, 2), MATH_SHUFFLE(m1, m3, 1, 3, 1, 3)),
+		_mm_mul_ps(MATH_SHUFFLE(m0, m2, 1, 3, 1, 3), MATH_SHUFFLE(m1, m3, 0, 2, 0, 2)));
+	__m128 det_a = MATH_SWIZZLE(det_sub, 0, 0, 0, 0);
+	__m128 det_b = MATH_SWIZZLE(det_sub, 1, 1, 1, 1);
+	__m128 det_c = MATH_SWIZZLE(det_sub, 2, 2, 2, 2);
+	__m128 det_d = MATH_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+	__m128 d_c = mat2_adj_mul(d, c);
+	__m128 a_b = mat2_adj_mul(a, b);
+	__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+	//|M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	__m128 tr = _mm_mul_ps(a_b, MATH_SWIZZLE(d_c, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 2, 3, 0, 1));
+	tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 1, 0, 3, 2));
+	det = _mm_sub_ps(det, tr);
+
+	if(_mm_cvtss_f32(det) == 0.0f)
+	{
+		for(int i = 0; i < 16; i += 4)
+			_mm_storeu_ps(result + i, _mm_setzero_ps());
+		return;
+	}
+
+	__m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+	x = _mm_mul_ps(x, rdet);
+	y = _mm_mul_ps(y, rdet);
+	z = _mm_mul_ps(z, rdet);
+	w = _mm_mul_ps(w, rdet);
+
+	_mm_storeu_ps(result, MATH_SHUFFLE(x, y, 3, 1, 3, 1));
+	_mm_storeu_ps(result + 4, MATH_SHUFFLE(x, y, 2, 0, 2, 0));
+	_mm_storeu_ps(result + 8, MATH_SHUFFLE(z, w, 3, 1, 3, 1));
+	_mm_storeu_ps(result + 12, MATH_SHUFFLE(z, w, 2, 0, 2, 0));
+}
+
+MATH_TARGET_SSE2 static inline __m128 cross_sse2(__m128 a, __m128 b)
+{
+	__m128 a_yzx = MATH_SWIZZLE(a, 1, 2, 0, 3);
+	__m128 b_yzx = MATH_SWIZZLE(b, 1, 2, 0, 3);
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return MATH_SWIZZLE(c, 1, 2, 0, 3);
+}
+
+MATH_TARGET_SSE2 static inline __m128 dot3_sse2(__m128 a, __m128 b)
+{
+	__m128 p = _mm_mul_ps(a, b);
+	return _mm_add_ps(_mm_add_ps(MATH_SWIZZLE(p, 0, 0, 0, 0), MATH_SWIZZLE(p, 1, 1, 1, 1)),
+		MATH_SWIZZLE(p, 2, 2, 2, 2));
+}
+
+/*
+ * Rows of the inverse of the upper 3x3, w lanes zero.
+ * stride is 4 for mat4 and 3 for mat4x3. Returns 0 if singular.
+*/
+MATH_TARGET_SSE2 static inline int inverse_rows3_sse2(__m128 rows[3], const float *mat, int stride)
+{
+	__m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 c0 = _mm_and_ps(_mm_loadu_ps(mat), mask);
+	__m128 c1 = _mm_and_ps(_mm_loadu_ps(mat + stride), mask);
+	__m128 c2 = _mm_and_ps(_mm_loadu_ps(mat + 2 * stride), mask);
+
+	rows[0] = cross_sse2(c1, c2);
+	rows[1] = cross_sse2(c2, c0);
+	rows[2] = cross_sse2(c0, c1);
+
+	__m128 det = dot3_sse2(c0, rows[0]);
+	if(_mm_cvtss_f32(det) == 0.0f)
+		return 0;
+
+	__m128 rdet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+	for(int i = 0; i < 3; i++)
+		rows[i] = _mm_mul_ps(rows[i], rdet);
+	return 1;
+}
+
+MATH_TARGET_SSE2 static void mat4_inverse_affine_sse2(float *result, const float *mat)
+{
+	__m128 rows[3];
+	__m128 t = _mm_loadu_ps(mat + 12);
+
+	if(!inverse_rows3_sse2(rows, mat, 4))
+	{
+		for(int i = 0; i < 16; i += 4)
+			_mm_storeu_ps(result + i, _mm_setzero_ps());
+		return;
+	}
+
+	__m128 r0 = rows[0], r1 = rows[1], r2 = rows[2];
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	__m128 tr = _mm_mul_ps(r0, MATH_SWIZZLE(t, 0, 0, 0, 0));
+	tr = _mm_add_ps(tr, _mm_mul_ps(r1, MATH_SWIZZLE(t, 1, 1, 1, 1)));
+	tr = _mm_add_ps(tr, _mm_mul_ps(r2, MATH_SWIZZLE(t, 2, 2, 2, 2)));
+	tr = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tr);
+
+	_mm_storeu_ps(result, r0);
+	_mm_storeu_ps(result + 4, r1);
+	_mm_storeu_ps(result + 8, r2);
+	_mm_storeu_ps(result + 12, tr);
+}
+
+/*
+ * mat4x3 columns are 3 floats apart. The fourth column is loaded from
+ * mat + 8 and moved down so nothing past the 12 floats is read, the
+ * w lanes are garbage and get dropped by the store.
+*/
+MATH_TARGET_SSE2 static inline __m128 mat4x3_col3_sse2(const float *mat)
+{
+	return MATH_SWIZZLE(_mm_loadu_ps(mat + 8), 1, 2, 3, 3);
+}
+
+MATH_TARGET_SSE2 static inline void mat4x3_store_sse2(float *result, __m128 c0, __m128 c1, __m128 c2, __m128 c3)
+{
+	__m128 t0 = MATH_SHUFFLE(c0, c1, 2, 2, 0, 0);
+	__m128 t2 = MATH_SHUFFLE(c2, c3, 2, 2, 0, 0);
+	_mm_storeu_ps(result, MATH_SHUFFLE(c0, t0, 0, 1, 0, 2));
+	_mm_storeu_ps(result + 4, MATH_SHUFFLE(c1, c2, 1, 2, 0, 1));
+	_mm_storeu_ps(result + 8, MATH_SHUFFLE(t2, c3, 0, 2, 1, 2));
+}
+
+MATH_TARGET_SSE2 static void mat4x3_mul_sse2(float *result, const float *mat_a, const float *mat_b)
+{
+	__m128 b0 = _mm_loadu_ps(mat_b);
+	__m128 b1 = _mm_loadu_ps(mat_b + 3);
+	__m128 b2 = _mm_loadu_ps(mat_b + 6);
+	__m128 b3 = mat4x3_col3_sse2(mat_b);
+	__m128 cols[4];
+
+	for(int i = 0; i < 4; i++)
+	{
+		const float *a = mat_a + 3 * i;
+		__m128 acc = _mm_mul_ps(_mm_set1_ps(a[0]), b0);
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[1]), b1));
+		cols[i] = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[2]), b2));
+	}
+	cols[3] = _mm_add_ps(cols[3], b3);
+
+	mat4x3_store_sse2(result, cols[0], cols[1], cols[2], cols[3]);
+}
+
+MATH_TARGET_SSE2 static void mat4x3_inverse_sse2(float *result, const float *mat)
+{
+	__m128 rows[3];
+	__m128 t = mat4x3_col3_sse2(mat);
+
+	if(!inverse_rows3_sse2(rows, mat, 3))
+	{
+		for(int i = 0; i < 12; i += 4)
+			_mm_storeu_ps(result + i, _mm_setzero_ps());
+		return;
+	}
+
+	__m128 r0 = rows[0], r1 = rows[1], r2 = rows[2];
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	//-dot(rows[i], t) per lane, the negation flips the sign bit like the scalar one
+	__m128 tr = _mm_mul_ps(r0, MATH_SWIZZLE(t, 0, 0, 0, 0));
+	tr = _mm_add_ps(tr, _mm_mul_ps(r1, MATH_SWIZZLE(t, 1, 1, 1, 1)));
+	tr = _mm_add_ps(tr, _mm_mul_ps(r2, MATH_SWIZZLE(t, 2, 2, 2, 2)));
+	tr = _mm_xor_ps(tr, _mm_set1_ps(-0.0f));
+
+	mat4x3_store_sse2(result, r0, r1, r2, tr);
+}
+
+MATH_TARGET_SSE2 static void mat4_normal_matrix_sse2(float *result, const float *model)
+{
+	__m128 rows[3];
+
+	if(!inverse_rows3_sse2(rows, model, 4))
+	{
+		for(int i = 0; i < 16; i += 4)
+			_mm_storeu_ps(result + i, _mm_setzero_ps());
+		return;
+	}
+
+	_mm_storeu_ps(result, rows[0]);
+	_mm_storeu_ps(result + 4, rows[1]);
+	_mm_storeu_ps(result + 8, rows[2]);
+	_mm_storeu_ps(result + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+MATH_TARGET_SSE2 static void cull_aabbs_sse2(uint32_t *visible, const float *planes, const float *const bounds[6], size_t first, size_t count)
+{
+	__m128 p[6][4];
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	for(int j = 0; j < 6; j++)
+		for(int k = 0; k < 4; k++)
+			p[j][k] = _mm_set1_ps(planes[j * 4 + k]);
+
+	size_t i = first;
+	for(; i + 32 <= count; i += 32)
+	{
+		uint32_t bits = 0;
+		for(size_t k = i; k < i + 32; k += 4)
+		{
+			__m128 cx = _mm_loadu_ps(bounds[0] + k);
+			__m128 cy = _mm_loadu_ps(bounds[1] + k);
+			__m128 cz = _mm_loadu_ps(bounds[2] + k);
+			__m128 ex = _mm_loadu_ps(bounds[3] + k);
+			__m128 ey = _mm_loadu_ps(bounds[4] + k);
+			__m128 ez = _mm_loadu_ps(bounds[5] + k);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for(int j = 0; j < 6; j++)
+			{
+				__m128 d = _mm_add_ps(_mm_mul_ps(p[j][0], cx), _mm_mul_ps(p[j][1], cy));
+				d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(p[j][2], cz)), p[j][3]);
+				__m128 r = _mm_add_ps(_mm_mul_ps(_mm_and_ps(p[j][0], abs_mask), ex),
+					_mm_mul_ps(_mm_and_ps(p[j][1], abs_mask), ey));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_and_ps(p[j][2], abs_mask), ez));
+				inside = _mm_and_ps(inside, _mm_cmpnlt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+			}
+			bits |= (uint32_t)_mm_movemask_ps(inside) << (k - i);
+		}
+		visible[i / 32] = bits;
+	}
+	cull_aabbs_tail(visible, planes, bounds, i, count);
+}
+
+MATH_TARGET_SSE2 static void cull_spheres_sse2(uint32_t *visible, const float *planes, const float *const bounds[4], size_t first, size_t count)
+{
+	__m128 p[6][4];
+	__m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	for(int j = 0; j < 6; j++)
+		for(int k = 0; k < 4; k++)
+			p[j][k] = _mm_set1_ps(planes[j * 4 + k]);
+
+	size_t i = first;
+	for(; i + 32 <= count; i += 32)
+	{
+		uint32_t bits = 0;
+		for(size_t k = i; k < i + 32; k += 4)
+		{
+			__m128 cx = _mm_loadu_ps(bounds[0] + k);
+			__m128 cy = _mm_loadu_ps(bounds[1] + k);
+			__m128 cz = _mm_loadu_ps(bounds[2] + k);
+			__m128 neg_r = _mm_xor_ps(_mm_loadu_ps(bounds[3] + k), sign_mask);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for(int j = 0; j < 6; j++)
+			{
+				__m128 d = _mm_add_ps(_mm_mul_ps(p[j][0], cx), _mm_mul_ps(p[j][1], cy));
+				d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(p[j][2], cz)), p[j][3]);
+				inside = _mm_and_ps(inside, _mm_cmpnlt_ps(d, neg_r));
+			}
+			bits |= (uint32_t)_mm_movemask_ps(inside) << (k - i);
+		}
+		visible[i / 32] = bits;
+	}
+	cull_spheres_tail(visible, planes, bounds, i, count);
+}
+
+/*
+ * Quaternion kernels work on 4 quaternions at a time, transposed to SoA
+ * (all x, all y, ...). Leftovers are copied into a padded group of 4.
+*/
+MATH_TARGET_SSE2 static inline void quat_load4(__m128 q[4], const float *qts)
+{
+	q[0] = _mm_loadu_ps(qts);
+	q[1] = _mm_loadu_ps(qts + 4);
+	q[2] = _mm_loadu_ps(qts + 8);
+	q[3] = _mm_loadu_ps(qts + 12);
+	_MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+}
+
+MATH_TARGET_SSE2 static inline void quat_store4(float *qts, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(qts, x);
+	_mm_storeu_ps(qts + 4, y);
+	_mm_storeu_ps(qts + 8, z);
+	_mm_storeu_ps(qts + 12, w);
+}
+
+//pads the last count % 4 quaternions (and their t) with identities
+static size_t quat_tail(float pad[3][16], float pad_t[4], const float *qt_a, const float *qt_b, const float *t, size_t first, size_t count)
+{
+	size_t left = count - first;
+	for(size_t i = 0; i < 4; i++)
+	{
+		for(int j = 0; j < 4; j++)
+		{
+			pad[0][i * 4 + j] = i < left ? qt_a[(first + i) * 4 + j] : (j == 3 ? 1.0f : 0.0f);
+			pad[1][i * 4 + j] = i < left && qt_b != NULL ? qt_b[(first + i) * 4 + j] : (j == 3 ? 1.0f : 0.0f);
+		}
+		if(pad_t != NULL)
+			pad_t[i] = i < left && t != NULL ? t[first + i] : 0.0f;
+	}
+	return left;
+}
+
+MATH_TARGET_SSE2 static void quat_mul_sse2(float *result, const float *qt_a, const float *qt_b, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 a[4], b[4];
+		quat_load4(a, qt_a + i * 4);
+		quat_load4(b, qt_b + i * 4);
+
+		__m128 x = _mm_add_ps(_mm_mul_ps(a[3], b[0]), _mm_mul_ps(a[0], b[3]));
+		x = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(a[1], b[2])), _mm_mul_ps(a[2], b[1]));
+		__m128 y = _mm_sub_ps(_mm_mul_ps(a[3], b[1]), _mm_mul_ps(a[0], b[2]));
+		y = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(a[1], b[3])), _mm_mul_ps(a[2], b[0]));
+		__m128 z = _mm_add_ps(_mm_mul_ps(a[3], b[2]), _mm_mul_ps(a[0], b[1]));
+		z = _mm_add_ps(_mm_sub_ps(z, _mm_mul_ps(a[1], b[0])), _mm_mul_ps(a[2], b[3]));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(a[3], b[3]), _mm_mul_ps(a[0], b[0]));
+		w = _mm_sub_ps(_mm_sub_ps(w, _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+
+		quat_store4(result + i * 4, x, y, z, w);
+	}
+	if(i < count)
+	{
+		float pad[3][16];
+		size_t left = quat_tail(pad, NULL, qt_a, qt_b, NULL, i, count);
+		quat_mul_sse2(pad[2], pad[0], pad[1], 4);
+		memcpy(result + i * 4, pad[2], left * 4 * sizeof(float));
+	}
+}
+
+MATH_TARGET_SSE2 static void quat_rotate_sse2(float *result, const float *qts, const float *vecs, size_t count)
+{
+	__m128 two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		const float *v = vecs + i * 3;
+		__m128 q[4];
+		quat_load4(q, qts + i * 4);
+		__m128 vx = _mm_setr_ps(v[0], v[3], v[6], v[9]);
+		__m128 vy = _mm_setr_ps(v[1], v[4], v[7], v[10]);
+		__m128 vz = _mm_setr_ps(v[2], v[5], v[8], v[11]);
+
+		//t = 2 * (u x v), result = v + w * t + u x t
+		__m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q[1], vz), _mm_mul_ps(q[2], vy)));
+		__m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q[2], vx), _mm_mul_ps(q[0], vz)));
+		__m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q[0], vy), _mm_mul_ps(q[1], vx)));
+		__m128 rx = _mm_add_ps(_mm_add_ps(vx, _mm_mul_ps(q[3], tx)), _mm_sub_ps(_mm_mul_ps(q[1], tz), _mm_mul_ps(q[2], ty)));
+		__m128 ry = _mm_add_ps(_mm_add_ps(vy, _mm_mul_ps(q[3], ty)), _mm_sub_ps(_mm_mul_ps(q[2], tx), _mm_mul_ps(q[0], tz)));
+		__m128 rz = _mm_add_ps(_mm_add_ps(vz, _mm_mul_ps(q[3], tz)), _mm_sub_ps(_mm_mul_ps(q[0], ty), _mm_mul_ps(q[1], tx)));
+
+		float out[3][4];
+		_mm_storeu_ps(out[0], rx);
+		_mm_storeu_ps(out[1], ry);
+		_mm_storeu_ps(out[2], rz);
+		for(int k = 0; k < 4; k++)
+		{
+			result[(i + k) * 3] = out[0][k];
+			result[(i + k) * 3 + 1] = out[1][k];
+			result[(i + k) * 3 + 2] = out[2][k];
+		}
+	}
+	if(i < count)
+	{
+		float pad[3][16];
+		float pad_v[12] = {0.0f};
+		float out[12];
+		size_t left = quat_tail(pad, NULL, qts, NULL, NULL, i, count);
+		memcpy(pad_v, vecs + i * 3, left * 3 * sizeof(float));
+		quat_rotate_sse2(out, pad[0], pad_v, 4);
+		memcpy(result + i * 3, out, left * 3 * sizeof(float));
+	}
+}
+
+MATH_TARGET_SSE2 static void quat_to_mat4_sse2(float *result, const float *qts, size_t count)
+{
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 q[4];
+		quat_load4(q, qts + i * 4);
+		__m128 xx = _mm_mul_ps(q[0], q[0]), yy = _mm_mul_ps(q[1], q[1]), zz = _mm_mul_ps(q[2], q[2]);
+		__m128 xy = _mm_mul_ps(q[0], q[1]), xz = _mm_mul_ps(q[0], q[2]), yz = _mm_mul_ps(q[1], q[2]);
+		__m128 wx = _mm_mul_ps(q[3], q[0]), wy = _mm_mul_ps(q[3], q[1]), wz = _mm_mul_ps(q[3], q[2]);
+
+		__m128 c0[4] = {
+			_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))),
+			_mm_mul_ps(two, _mm_add_ps(xy, wz)),
+			_mm_mul_ps(two, _mm_sub_ps(xz, wy)),
+			_mm_setzero_ps()};
+		__m128 c1[4] = {
+			_mm_mul_ps(two, _mm_sub_ps(xy, wz)),
+			_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))),
+			_mm_mul_ps(two, _mm_add_ps(yz, wx)),
+			_mm_setzero_ps()};
+		__m128 c2[4] = {
+			_mm_mul_ps(two, _mm_add_ps(xz, wy)),
+			_mm_mul_ps(two, _mm_sub_ps(yz, wx)),
+			_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))),
+			_mm_setzero_ps()};
+		_MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+		_MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+		_MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+
+		__m128 c3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+		for(int k = 0; k < 4; k++)
+		{
+			float *m = result + (i + k) * 16;
+			_mm_storeu_ps(m, c0[k]);
+			_mm_storeu_ps(m + 4, c1[k]);
+			_mm_storeu_ps(m + 8, c2[k]);
+			_mm_storeu_ps(m + 12, c3);
+		}
+	}
+	if(i < count)
+	{
+		float pad[3][16];
+		float out[64];
+		size_t left = quat_tail(pad, NULL, qts, NULL, NULL, i, count);
+		quat_to_mat4_sse2(out, pad[0], 4);
+		memcpy(result + i * 16, out, left * 16 * sizeof(float));
+	}
+}
+
+MATH_TARGET_SSE2 static inline void quat_normalize4(__m128 *x, __m128 *y, __m128 *z, __m128 *w)
+{
+	//summed left to right like math_vec4_dot
+	__m128 len = _mm_add_ps(_mm_mul_ps(*x, *x), _mm_mul_ps(*y, *y));
+	len = _mm_add_ps(len, _mm_mul_ps(*z, *z));
+	len = _mm_sqrt_ps(_mm_add_ps(len, _mm_mul_ps(*w, *w)));
+	//zero length gives zero like math_vec4_normalize
+	__m128 k = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), len), _mm_cmpneq_ps(len, _mm_setzero_ps()));
+	*x = _mm_mul_ps(*x, k);
+	*y = _mm_mul_ps(*y, k);
+	*z = _mm_mul_ps(*z, k);
+	*w = _mm_mul_ps(*w, k);
+}
+
+MATH_TARGET_SSE2 static void quat_nlerp_sse2(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	__m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 a[4], b[4];
+		quat_load4(a, qt_a + i * 4);
+		quat_load4(b, qt_b + i * 4);
+		__m128 dot = _mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1]));
+		dot = _mm_add_ps(dot, _mm_mul_ps(a[2], b[2]));
+		dot = _mm_add_ps(dot, _mm_mul_ps(a[3], b[3]));
+		__m128 tt = _mm_loadu_ps(t + i);
+		__m128 wa = _mm_sub_ps(_mm_set1_ps(1.0f), tt);
+		//shortest path, flip b when the dot is negative
+		__m128 wb = _mm_xor_ps(tt, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), sign_mask));
+
+		__m128 x = _mm_add_ps(_mm_mul_ps(wa, a[0]), _mm_mul_ps(wb, b[0]));
+		__m128 y = _mm_add_ps(_mm_mul_ps(wa, a[1]), _mm_mul_ps(wb, b[1]));
+		__m128 z = _mm_add_ps(_mm_mul_ps(wa, a[2]), _mm_mul_ps(wb, b[2]));
+		__m128 w = _mm_add_ps(_mm_mul_ps(wa, a[3]), _mm_mul_ps(wb, b[3]));
+		quat_normalize4(&x, &y, &z, &w);
+		quat_store4(result + i * 4, x, y, z, w);
+	}
+	if(i < count)
+	{
+		float pad[3][16];
+		float pad_t[4];
+		size_t left = quat_tail(pad, pad_t, qt_a, qt_b, t, i, count);
+		quat_nlerp_sse2(pad[2], pad[0], pad[1], pad_t, 4);
+		memcpy(result + i * 4, pad[2], left * 4 * sizeof(float));
+	}
+}
+
+/*
+ * sin for |x| <= pi/2 (Taylor to x^13, error < 1e-8)
+ * and acos for x in [0, 1] (Abramowitz-Stegun 4.4.46, error < 2e-8)
+*/
+MATH_TARGET_SSE2 static inline __m128 sin_half_pi_sse2(__m128 x)
+{
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 p = _mm_set1_ps(1.6059044e-10f);
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-2.5052108e-8f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(2.7557319e-6f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.9841270e-4f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(8.3333333e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.6666667e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(p, x);
+}
+
+MATH_TARGET_SSE2 static inline __m128 acos_unit_sse2(__m128 x)
+{
+	__m128 p = _mm_set1_ps(-0.0012624911f);
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0066700901f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0170881256f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0308918810f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0501743046f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0889789874f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.2145988016f));
+	p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(1.5707963050f));
+	return _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)));
+}
+
+MATH_TARGET_SSE2 static void quat_slerp_sse2(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	__m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	__m128 one = _mm_set1_ps(1.0f);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 a[4], b[4];
+		quat_load4(a, qt_a + i * 4);
+		quat_load4(b, qt_b + i * 4);
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+			_mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3])));
+		__m128 sign = _mm_and_ps(dot, sign_mask);
+		dot = _mm_min_ps(_mm_xor_ps(dot, sign), one);
+		__m128 tt = _mm_loadu_ps(t + i);
+
+		__m128 theta = acos_unit_sse2(dot);
+		__m128 inv_sin = _mm_div_ps(one, sin_half_pi_sse2(theta));
+		__m128 wa = _mm_mul_ps(sin_half_pi_sse2(_mm_mul_ps(_mm_sub_ps(one, tt), theta)), inv_sin);
+		__m128 wb = _mm_mul_ps(sin_half_pi_sse2(_mm_mul_ps(tt, theta)), inv_sin);
+
+		//nearly the same rotation: plain lerp weights, normalized below
+		__m128 near = _mm_cmpgt_ps(dot, _mm_set1_ps(0.9995f));
+		wa = _mm_or_ps(_mm_and_ps(near, _mm_sub_ps(one, tt)), _mm_andnot_ps(near, wa));
+		wb = _mm_or_ps(_mm_and_ps(near, tt), _mm_andnot_ps(near, wb));
+		wb = _mm_xor_ps(wb, sign);
+
+		__m128 x = _mm_add_ps(_mm_mul_ps(wa, a[0]), _mm_mul_ps(wb, b[0]));
+		__m128 y = _mm_add_ps(_mm_mul_ps(wa, a[1]), _mm_mul_ps(wb, b[1]));
+		__m128 z = _mm_add_ps(_mm_mul_ps(wa, a[2]), _mm_mul_ps(wb, b[2]));
+		__m128 w = _mm_add_ps(_mm_mul_ps(wa, a[3]), _mm_mul_ps(wb, b[3]));
+		quat_normalize4(&x, &y, &z, &w);
+		quat_store4(result + i * 4, x, y, z, w);
+	}
+	if(i < count)
+	{
+		float pad[3][16];
+		float pad_t[4];
+		size_t left = quat_tail(pad, pad_t, qt_a, qt_b, t, i, count);
+		quat_slerp_sse2(pad[2], pad[0], pad[1], pad_t, 4);
+		memcpy(result + i * 4, pad[2], left * 4 * sizeof(float));
+	}
+}
+
+MATH_TARGET_SSE2 static void stream_add_sse2(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+		_mm_store_ps(result + i, _mm_add_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+}
+
+MATH_TARGET_SSE2 static void stream_sub_sse2(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+		_mm_store_ps(result + i, _mm_sub_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+}
+
+MATH_TARGET_SSE2 static void stream_scale_sse2(float *result, const float *a, float s, size_t n)
+{
+	__m128 vs = _mm_set1_ps(s);
+	for(size_t i = 0; i < n; i += 4)
+		_mm_store_ps(result + i, _mm_mul_ps(_mm_load_ps(a + i), vs));
+}
+
+MATH_TARGET_SSE2 static void stream_sqrt_sse2(float *result, const float *a, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+		_mm_storeu_ps(result + i, _mm_sqrt_ps(_mm_loadu_ps(a + i)));
+}
+
+MATH_TARGET_SSE2 static void stream_dot_sse2(float *result, const float *a, size_t capacity_a, const float *b, size_t capacity_b, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+	{
+		__m128 dot = _mm_setzero_ps();
+		for(int k = 0; k < components; k++)
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_load_ps(a + k * capacity_a + i), _mm_load_ps(b + k * capacity_b + i)));
+		_mm_storeu_ps(result + i, dot);
+	}
+}
+
+MATH_TARGET_SSE2 static void stream_cross_sse2(float *result, size_t capacity_r, const float *a, size_t capacity_a, const float *b, size_t capacity_b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+	{
+		__m128 ax = _mm_load_ps(a + i);
+		__m128 ay = _mm_load_ps(a + capacity_a + i);
+		__m128 az = _mm_load_ps(a + 2 * capacity_a + i);
+		__m128 bx = _mm_load_ps(b + i);
+		__m128 by = _mm_load_ps(b + capacity_b + i);
+		__m128 bz = _mm_load_ps(b + 2 * capacity_b + i);
+		_mm_store_ps(result + i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+		_mm_store_ps(result + capacity_r + i, _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+		_mm_store_ps(result + 2 * capacity_r + i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+	}
+}
+
+MATH_TARGET_SSE2 static void stream_normalize_sse2(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+	{
+		__m128 len = _mm_setzero_ps();
+		for(int k = 0; k < components; k++)
+		{
+			__m128 c = _mm_load_ps(a + k * capacity_a + i);
+			len = _mm_add_ps(len, _mm_mul_ps(c, c));
+		}
+		len = _mm_sqrt_ps(len);
+		//zero length gives 1/0 = inf, masked back to zero
+		__m128 inv = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), len), _mm_cmpneq_ps(len, _mm_setzero_ps()));
+		for(int k = 0; k < components; k++)
+			_mm_store_ps(result + k * capacity_r + i, _mm_mul_ps(_mm_load_ps(a + k * capacity_a + i), inv));
+	}
+}
+
+//same steps as math_rsqrt, so the approx kernels match it bit for bit
+MATH_TARGET_SSE2 static inline __m128 rsqrt_sse2(__m128 x)
+{
+	__m128 y = _mm_rsqrt_ps(x);
+	__m128 t = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), y), y);
+	y = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), t));
+	return _mm_and_ps(y, _mm_cmpge_ps(x, _mm_set1_ps(FLT_MIN)));
+}
+
+MATH_TARGET_SSE2 static void normalize_approx_aos_sse2(float *result, size_t result_stride, const float *vecs, size_t stride, size_t count)
+{
+	size_t i = 0;
+
+	//the loads read one float past each vec3, never past the last one
+	for(; i + 4 < count; i += 4)
+	{
+		const float *v = vecs + i * stride;
+		__m128 x = _mm_loadu_ps(v);
+		__m128 y = _mm_loadu_ps(v + stride);
+		__m128 z = _mm_loadu_ps(v + 2 * stride);
+		__m128 w = _mm_loadu_ps(v + 3 * stride);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 inv = rsqrt_sse2(len2);
+		x = _mm_mul_ps(x, inv);
+		y = _mm_mul_ps(y, inv);
+		z = _mm_mul_ps(z, inv);
+		w = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 rows[4] = {x, y, z, w};
+		for(int k = 0; k < 4; k++)
+		{
+			float *r = result + (i + k) * result_stride;
+			_mm_storel_pi((__m64 *)r, rows[k]);
+			_mm_store_ss(r + 2, _mm_movehl_ps(rows[k], rows[k]));
+		}
+	}
+
+	for(; i < count; i++)
+	{
+		const float *v = vecs + i * stride;
+		float *r = result + i * result_stride;
+		float len2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+		float inv = _mm_cvtss_f32(rsqrt_sse2(_mm_set_ss(len2)));
+		r[0] = v[0] * inv;
+		r[1] = v[1] * inv;
+		r[2] = v[2] * inv;
+	}
+}
+
+MATH_TARGET_SSE2 static void stream_normalize_approx_sse2(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 4)
+	{
+		__m128 len2 = _mm_setzero_ps();
+		for(int k = 0; k < components; k++)
+		{
+			__m128 c = _mm_load_ps(a + k * capacity_a + i);
+			len2 = _mm_add_ps(len2, _mm_mul_ps(c, c));
+		}
+		__m128 inv = rsqrt_sse2(len2);
+		for(int k = 0; k < components; k++)
+			_mm_store_ps(result + k * capacity_r + i, _mm_mul_ps(_mm_load_ps(a + k * capacity_a + i), inv));
+	}
+}
+
+//same operations as math_sincos, so the results match it exactly
+MATH_TARGET_SSE2 static inline void sincos_sse2(__m128 angle, __m128 *s, __m128 *c)
+{
+	__m128 round = _mm_set1_ps(MATH_ROUND_MAGIC);
+	__m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(angle, _mm_set1_ps(MATH_SINCOS_2_PI)), round), round);
+	__m128i quadrant = _mm_cvttps_epi32(k);
+	__m128 r = _mm_sub_ps(angle, _mm_mul_ps(k, _mm_set1_ps(MATH_SINCOS_PIO2_1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(MATH_SINCOS_PIO2_2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(MATH_SINCOS_PIO2_3)));
+	__m128 r2 = _mm_mul_ps(r, r);
+
+	__m128 ps = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(MATH_SINCOS_S3)), _mm_set1_ps(MATH_SINCOS_S2));
+	ps = _mm_add_ps(_mm_mul_ps(r2, ps), _mm_set1_ps(MATH_SINCOS_S1));
+	ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+	__m128 pc = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(MATH_SINCOS_C3)), _mm_set1_ps(MATH_SINCOS_C2));
+	pc = _mm_add_ps(_mm_mul_ps(r2, pc), _mm_set1_ps(MATH_SINCOS_C1));
+	pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+	//odd quadrants swap sin and cos, bit 1 of quadrant (quadrant + 1 for cos) is the sign
+	__m128i one = _mm_set1_epi32(1);
+	__m128i two = _mm_set1_epi32(2);
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+	__m128 sign_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+	__m128 sign_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+	*s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), sign_s);
+	*c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), sign_c);
+}
+
+MATH_TARGET_SSE2 static void sincos_batch_sse2(float *s, float *c, const float *angles, size_t count)
+{
+	size_t i = 0;
+	__m128 vs, vc;
+
+	for(; i + 4 <= count; i += 4)
+	{
+		sincos_sse2(_mm_loadu_ps(angles + i), &vs, &vc);
+		_mm_storeu_ps(s + i, vs);
+		_mm_storeu_ps(c + i, vc);
+	}
+
+	if(i < count)
+	{
+		float pad[3][4] = {{0.0f}};
+		memcpy(pad[0], angles + i, (count - i) * sizeof(float));
+		sincos_sse2(_mm_loadu_ps(pad[0]), &vs, &vc);
+		_mm_storeu_ps(pad[1], vs);
+		_mm_storeu_ps(pad[2], vc);
+		memcpy(s + i, pad[1], (count - i) * sizeof(float));
+		memcpy(c + i, pad[2], (count - i) * sizeof(float));
+	}
+}
+
+//math_float_to_half on four floats, the same three cases selected by mask
+MATH_TARGET_SSE2 static inline __m128i float_to_half4_sse2(__m128 value)
+{
+	__m128i x = _mm_castps_si128(value);
+	__m128i sign = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0x8000));
+	x = _mm_and_si128(x, _mm_set1_epi32(0x7fffffff));
+
+	__m128i normal = _mm_add_epi32(x, _mm_set1_epi32((int)0xc8000fff));
+	normal = _mm_add_epi32(normal, _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1)));
+	normal = _mm_srli_epi32(normal, 13);
+
+	__m128 sub = _mm_add_ps(_mm_castsi128_ps(x), _mm_set1_ps(0.5f));
+	__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(sub), _mm_set1_epi32(0x3f000000));
+
+	__m128i nan = _mm_or_si128(_mm_set1_epi32(0x7e00), _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(0x3ff)));
+	__m128i is_nan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+	__m128i is_big = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x477fefff));
+	__m128i is_sub = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+
+	__m128i h = _mm_or_si128(_mm_and_si128(is_sub, subnormal), _mm_andnot_si128(is_sub, normal));
+	h = _mm_or_si128(_mm_and_si128(is_big, _mm_set1_epi32(0x7c00)), _mm_andnot_si128(is_big, h));
+	h = _mm_or_si128(_mm_and_si128(is_nan, nan), _mm_andnot_si128(is_nan, h));
+	h = _mm_or_si128(h, sign);
+
+	//sign extend so the signed saturating pack keeps the bits
+	h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+	return _mm_packs_epi32(h, h);
+}
+
+MATH_TARGET_SSE2 static void float_to_half_sse2(uint16_t *result, const float *values, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+		_mm_storel_epi64((__m128i *)(result + i), float_to_half4_sse2(_mm_loadu_ps(values + i)));
+
+	if(i < count)
+	{
+		float pad[4] = {0.0f};
+		uint16_t out[8];
+		memcpy(pad, values + i, (count - i) * sizeof(float));
+		_mm_storeu_si128((__m128i *)out, float_to_half4_sse2(_mm_loadu_ps(pad)));
+		memcpy(result + i, out, (count - i) * sizeof(uint16_t));
+	}
+}
+
+MATH_TARGET_SSE2 static inline __m128 snorm16_sse2(__m128 v)
+{
+	__m128 round = _mm_set1_ps(MATH_ROUND_MAGIC);
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+	return _mm_sub_ps(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(32767.0f)), round), round);
+}
+
+//four normals, four floats apart (x, y, z, anything)
+MATH_TARGET_SSE2 static inline __m128i octahedral4_sse2(const float *n, size_t stride)
+{
+	__m128 x = _mm_loadu_ps(n);
+	__m128 y = _mm_loadu_ps(n + stride);
+	__m128 z = _mm_loadu_ps(n + 2 * stride);
+	__m128 w = _mm_loadu_ps(n + 3 * stride);
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, abs_mask), _mm_and_ps(y, abs_mask)), _mm_and_ps(z, abs_mask));
+	__m128 inv = _mm_and_ps(_mm_div_ps(one, l1), _mm_cmpgt_ps(l1, zero));
+	__m128 px = _mm_mul_ps(x, inv);
+	__m128 py = _mm_mul_ps(y, inv);
+
+	//(1 - |other|) * (p >= 0 ? 1 : -1)
+	__m128 sign_x = _mm_andnot_ps(_mm_cmpge_ps(px, zero), _mm_set1_ps(-0.0f));
+	__m128 sign_y = _mm_andnot_ps(_mm_cmpge_ps(py, zero), _mm_set1_ps(-0.0f));
+	__m128 fold_x = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(py, abs_mask)), _mm_or_ps(one, sign_x));
+	__m128 fold_y = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(px, abs_mask)), _mm_or_ps(one, sign_y));
+	__m128 lower = _mm_cmplt_ps(z, zero);
+	px = _mm_or_ps(_mm_and_ps(lower, fold_x), _mm_andnot_ps(lower, px));
+	py = _mm_or_ps(_mm_and_ps(lower, fold_y), _mm_andnot_ps(lower, py));
+
+	__m128i ix = _mm_cvttps_epi32(snorm16_sse2(px));
+	__m128i iy = _mm_cvttps_epi32(snorm16_sse2(py));
+	return _mm_packs_epi32(_mm_unpacklo_epi32(ix, iy), _mm_unpackhi_epi32(ix, iy));
+}
+
+MATH_TARGET_SSE2 static void octahedral_encode_sse2(int16_t *result, const float *normals, size_t stride, size_t count)
+{
+	size_t i = 0;
+
+	//the loads read one float past each normal, never past the last one
+	for(; i + 4 < count; i += 4)
+		_mm_storeu_si128((__m128i *)(result + i * 2), octahedral4_sse2(normals + i * stride, stride));
+
+	float pad[16] = {0.0f};
+	int16_t out[8];
+	size_t left = count - i;
+	for(size_t k = 0; k < left; k++)
+		memcpy(pad + k * 4, normals + (i + k) * stride, 3 * sizeof(float));
+	_mm_storeu_si128((__m128i *)out, octahedral4_sse2(pad, 4));
+	memcpy(result + i * 2, out, left * 2 * sizeof(int16_t));
+}
+
+MATH_TARGET_SSE2 static void snorm16_batch_sse2(int16_t *result, const float *values, float scale, size_t count)
+{
+	__m128 s = _mm_set1_ps(scale);
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i lo = _mm_cvttps_epi32(snorm16_sse2(_mm_mul_ps(_mm_loadu_ps(values + i), s)));
+		__m128i hi = _mm_cvttps_epi32(snorm16_sse2(_mm_mul_ps(_mm_loadu_ps(values + i + 4), s)));
+		_mm_storeu_si128((__m128i *)(result + i), _mm_packs_epi32(lo, hi));
+	}
+
+	float pad[8] = {0.0f};
+	int16_t out[8];
+	size_t left = count - i;
+	memcpy(pad, values + i, left * sizeof(float));
+	__m128i lo = _mm_cvttps_epi32(snorm16_sse2(_mm_mul_ps(_mm_loadu_ps(pad), s)));
+	__m128i hi = _mm_cvttps_epi32(snorm16_sse2(_mm_mul_ps(_mm_loadu_ps(pad + 4), s)));
+	_mm_storeu_si128((__m128i *)out, _mm_packs_epi32(lo, hi));
+	memcpy(result + i, out, left * sizeof(int16_t));
+}
+
+/*
+ * Moller-Trumbore on 4 lanes, ray_triangle_test's operations in order.
+ * ray is origin, direction, t_min and tri is v0, e1, e2, one register
+ * per component. Returns the lanes that hit closer than t_max.
+*/
+MATH_TARGET_SSE2 static inline __m128 ray_triangle4_sse2(__m128 result[3], const __m128 *ray, const __m128 *tri, __m128 t_max)
+{
+	const __m128 *o = ray, *d = ray + 3;
+	const __m128 *v0 = tri, *e1 = tri + 3, *e2 = tri + 6;
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1]));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2]));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 sx = _mm_sub_ps(o[0], v0[0]);
+	__m128 sy = _mm_sub_ps(o[1], v0[1]);
+	__m128 sz = _mm_sub_ps(o[2], v0[2]);
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1[2]), _mm_mul_ps(sz, e1[1]));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1[0]), _mm_mul_ps(sx, e1[2]));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1[1]), _mm_mul_ps(sy, e1[0]));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), inv);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz)), inv);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 mask = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), det), _mm_set1_ps(MATH_RAY_EPSILON));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, ray[6]));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, t_max));
+	result[0] = t;
+	result[1] = u;
+	result[2] = v;
+	return mask;
+}
+
+MATH_TARGET_SSE2 static __m128 select_sse2(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+//closest of the per-lane hits, lowest index on ties like the scalar loop
+static int ray_hit_reduce(float *hit, uint32_t *primitive, const float *best, const int32_t *index, int lanes)
+{
+	int closest = -1;
+	for(int lane = 0; lane < lanes; lane++)
+	{
+		if(index[lane] < 0)
+			continue;
+		if(closest < 0 || best[lane] < best[closest] || (best[lane] == best[closest] && index[lane] < index[closest]))
+			closest = lane;
+	}
+	if(closest < 0)
+		return 0;
+	for(int k = 0; k < 3; k++)
+		hit[k] = best[k * lanes + closest];
+	*primitive = (uint32_t)index[closest];
+	return 1;
+}
+
+MATH_TARGET_SSE2 static int ray_triangles_sse2(float *hit, uint32_t *primitive, const float *ray, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	const float *const src[9] = {v0, v0 + capacity, v0 + 2 * capacity, e1, e1 + capacity, e1 + 2 * capacity, e2, e2 + capacity, e2 + 2 * capacity};
+	__m128 r[7];
+	for(int k = 0; k < 7; k++)
+		r[k] = _mm_set1_ps(ray[k]);
+	__m128 best[3] = {_mm_set1_ps(hit[0]), _mm_set1_ps(hit[1]), _mm_set1_ps(hit[2])};
+	__m128i best_index = _mm_set1_epi32(-1);
+
+	for(size_t i = first; i < end; i += 4)
+	{
+		__m128 tri[9];
+		if(end - i >= 4)
+		{
+			for(int k = 0; k < 9; k++)
+				tri[k] = _mm_loadu_ps(src[k] + i);
+		}
+		else
+		{
+			//zeros are degenerate triangles and miss
+			float pad[4] = {0.0f};
+			for(int k = 0; k < 9; k++)
+			{
+				memcpy(pad, src[k] + i, (end - i) * sizeof(float));
+				tri[k] = _mm_loadu_ps(pad);
+			}
+		}
+
+		__m128 found[3];
+		__m128 mask = ray_triangle4_sse2(found, r, tri, best[0]);
+		for(int k = 0; k < 3; k++)
+			best[k] = select_sse2(mask, found[k], best[k]);
+		__m128i index = _mm_add_epi32(_mm_set1_epi32((int32_t)i), _mm_setr_epi32(0, 1, 2, 3));
+		best_index = _mm_castps_si128(select_sse2(mask, _mm_castsi128_ps(index), _mm_castsi128_ps(best_index)));
+	}
+
+	float lanes[12];
+	int32_t indices[4];
+	for(int k = 0; k < 3; k++)
+		_mm_storeu_ps(lanes + k * 4, best[k]);
+	_mm_storeu_si128((__m128i *)indices, best_index);
+	return ray_hit_reduce(hit, primitive, lanes, indices, 4);
+}
+
+//the packet as two halves of 4 rays, every triangle broadcast to all lanes
+MATH_TARGET_SSE2 static uint32_t ray_packet_triangles_sse2(float *hit, uint32_t *primitive, const float *rays, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	const float *const src[9] = {v0, v0 + capacity, v0 + 2 * capacity, e1, e1 + capacity, e1 + 2 * capacity, e2, e2 + capacity, e2 + 2 * capacity};
+	uint32_t mask = 0;
+	for(int half = 0; half < 8; half += 4)
+	{
+		__m128 r[7], best[3];
+		for(int k = 0; k < 7; k++)
+			r[k] = _mm_loadu_ps(rays + k * 8 + half);
+		for(int k = 0; k < 3; k++)
+			best[k] = _mm_loadu_ps(hit + k * 8 + half);
+		__m128i best_index = _mm_loadu_si128((const __m128i *)(primitive + half));
+		__m128 any = _mm_setzero_ps();
+
+		for(size_t i = first; i < end; i++)
+		{
+			__m128 tri[9], found[3];
+			for(int k = 0; k < 9; k++)
+				tri[k] = _mm_set1_ps(src[k][i]);
+			__m128 closer = ray_triangle4_sse2(found, r, tri, best[0]);
+			for(int k = 0; k < 3; k++)
+				best[k] = select_sse2(closer, found[k], best[k]);
+			best_index = _mm_castps_si128(select_sse2(closer, _mm_castsi128_ps(_mm_set1_epi32((int32_t)i)), _mm_castsi128_ps(best_index)));
+			any = _mm_or_ps(any, closer);
+		}
+
+		for(int k = 0; k < 3; k++)
+			_mm_storeu_ps(hit + k * 8 + half, best[k]);
+		_mm_storeu_si128((__m128i *)(primitive + half), best_index);
+		mask |= (uint32_t)_mm_movemask_ps(any) << half;
+	}
+	return mask;
+}
+
+//minps/maxps with the running value second, so NaN slabs get skipped like ray_aabb_test
+MATH_TARGET_SSE2 static uint32_t ray_packet_aabb_sse2(float *t_near, const float *rays, const float *box)
+{
+	uint32_t mask = 0;
+	for(int half = 0; half < 8; half += 4)
+	{
+		__m128 near = _mm_loadu_ps(rays + 6 * 8 + half);
+		__m128 far = _mm_loadu_ps(rays + 7 * 8 + half);
+		for(int k = 0; k < 3; k++)
+		{
+			__m128 o = _mm_loadu_ps(rays + k * 8 + half);
+			__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(rays + (3 + k) * 8 + half));
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box[k]), o), inv);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box[3 + k]), o), inv);
+			near = _mm_max_ps(_mm_min_ps(t0, t1), near);
+			far = _mm_min_ps(_mm_max_ps(t0, t1), far);
+		}
+		_mm_storeu_ps(t_near + half, near);
+		mask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(near, far)) << half;
+	}
+	return mask;
+}
+
+//math_morton3 on four points per axis array
+MATH_TARGET_SSE2 static inline __m128i morton_expand_sse2(__m128i v)
+{
+	v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi32(0x030000FF));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)), _mm_set1_epi32(0x0300F00F));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 4)), _mm_set1_epi32(0x030C30C3));
+	v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 2)), _mm_set1_epi32(0x09249249));
+	return v;
+}
+
+MATH_TARGET_SSE2 static inline __m128i morton_cell_sse2(__m128 v, float min, float scale)
+{
+	__m128 f = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(min)), _mm_set1_ps(scale));
+	f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(1023.0f));
+	return morton_expand_sse2(_mm_cvttps_epi32(f));
+}
+
+MATH_TARGET_SSE2 static inline __m128i morton4_sse2(const float *x, const float *y, const float *z, const float *min_scale)
+{
+	__m128i cx = morton_cell_sse2(_mm_loadu_ps(x), min_scale[0], min_scale[3]);
+	__m128i cy = morton_cell_sse2(_mm_loadu_ps(y), min_scale[1], min_scale[4]);
+	__m128i cz = morton_cell_sse2(_mm_loadu_ps(z), min_scale[2], min_scale[5]);
+	return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(cx, 2), _mm_slli_epi32(cy, 1)), cz);
+}
+
+MATH_TARGET_SSE2 static void morton3_sse2(uint32_t *result, const float *x, const float *y, const float *z, const float *min_scale, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(result + i), morton4_sse2(x + i, y + i, z + i, min_scale));
+
+	if(i < count)
+	{
+		float pad[3][4] = {{0.0f}};
+		uint32_t out[4];
+		memcpy(pad[0], x + i, (count - i) * sizeof(float));
+		memcpy(pad[1], y + i, (count - i) * sizeof(float));
+		memcpy(pad[2], z + i, (count - i) * sizeof(float));
+		_mm_storeu_si128((__m128i *)out, morton4_sse2(pad[0], pad[1], pad[2], min_scale));
+		memcpy(result + i, out, (count - i) * sizeof(uint32_t));
+	}
+}
+
+/*
+ * One box per iteration, xyz in lanes 0-2. Loads never reach past the
+ * 6 floats of a box or the 12 of a matrix: the last column and the max
+ * corner are loaded one float early and shifted down a lane.
+*/
+MATH_TARGET_SSE2 static void aabb_transform_sse2(float *result, const float *boxes, const float *mats, size_t count)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const float *m = mats + i * 12;
+		__m128 box_min = _mm_loadu_ps(boxes + i * 6);
+		__m128 box_max = _mm_loadu_ps(boxes + i * 6 + 2);
+		box_max = _mm_shuffle_ps(box_max, box_max, _MM_SHUFFLE(3, 3, 2, 1));
+		box_min = _mm_mul_ps(box_min, half);
+		box_max = _mm_mul_ps(box_max, half);
+		__m128 center = _mm_add_ps(box_min, box_max);
+		__m128 extent = _mm_sub_ps(box_max, box_min);
+
+		__m128 col0 = _mm_loadu_ps(m);
+		__m128 col1 = _mm_loadu_ps(m + 3);
+		__m128 col2 = _mm_loadu_ps(m + 6);
+		__m128 col3 = _mm_loadu_ps(m + 8);
+		col3 = _mm_shuffle_ps(col3, col3, _MM_SHUFFLE(3, 3, 2, 1));
+
+		__m128 c = _mm_mul_ps(col0, _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0)));
+		c = _mm_add_ps(c, _mm_mul_ps(col1, _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1))));
+		c = _mm_add_ps(c, _mm_mul_ps(col2, _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))));
+		c = _mm_add_ps(c, col3);
+		__m128 h = _mm_mul_ps(_mm_and_ps(col0, abs_mask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0)));
+		h = _mm_add_ps(h, _mm_mul_ps(_mm_and_ps(col1, abs_mask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1))));
+		h = _mm_add_ps(h, _mm_mul_ps(_mm_and_ps(col2, abs_mask), _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		//min xyz + max x in one store, then max yz
+		__m128 lo = _mm_sub_ps(c, h);
+		__m128 hi = _mm_add_ps(c, h);
+		__m128 joint = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(0, 0, 2, 2));
+		_mm_storeu_ps(result + i * 6, _mm_shuffle_ps(lo, joint, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storel_pi((__m64 *)(result + i * 6 + 4), _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 1)));
+	}
+}
+
+// SSE2 END
+
+/*
+ * AVX BEGIN
+*/
+
+MATH_TARGET_AVX static void mat4_mul_avx(float *result, const float *mat_a, const float *mat_b)
+{
+	//every row of b in both lanes, two rows of a per register
+	__m256 b0 = _mm256_broadcast_ps((const __m128 *)mat_b);
+	__m256 b1 = _mm256_broadcast_ps((const __m128 *)(mat_b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128 *)(mat_b + 8));
+	__m256 b3 = _mm256_broadcast_ps((const __m128 *)(mat_b + 12));
+	__m256 a01 = _mm256_loadu_ps(mat_a);
+	__m256 a23 = _mm256_loadu_ps(mat_a + 8);
+
+	__m256 r01 = _mm256_setzero_ps();
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xff), b3));
+
+	__m256 r23 = _mm256_setzero_ps();
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xff), b3));
+
+	_mm256_storeu_ps(result, r01);
+	_mm256_storeu_ps(result + 8, r23);
+}
+
+MATH_TARGET_AVX static void mat4x3_mul_avx(float *result, const float *mat_a, const float *mat_b)
+{
+	//b columns in both lanes, columns 0 and 1 of a in r01, 2 and 3 in r23.
+	//only column 3 gets the translation, added after the split
+	__m128 c3 = mat4x3_col3_sse2(mat_b);
+	__m256 b0 = _mm256_broadcast_ps((const __m128 *)mat_b);
+	__m256 b1 = _mm256_broadcast_ps((const __m128 *)(mat_b + 3));
+	__m256 b2 = _mm256_broadcast_ps((const __m128 *)(mat_b + 6));
+	__m256 a01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(mat_a)), _mm_loadu_ps(mat_a + 3), 1);
+	__m256 a23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(mat_a + 6)), mat4x3_col3_sse2(mat_a), 1);
+
+	__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2));
+
+	__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2));
+
+	mat4x3_store_sse2(result, _mm256_castps256_ps128(r01), _mm256_extractf128_ps(r01, 1),
+		_mm256_castps256_ps128(r23), _mm_add_ps(_mm256_extractf128_ps(r23, 1), c3));
+}
+
+MATH_TARGET_AVX static void mat4_add_avx(float *result, const float *mat_a, const float *mat_b)
+{
+	__m256 lo = _mm256_add_ps(_mm256_loadu_ps(mat_a), _mm256_loadu_ps(mat_b));
+	__m256 hi = _mm256_add_ps(_mm256_loadu_ps(mat_a + 8), _mm256_loadu_ps(mat_b + 8));
+	_mm256_storeu_ps(result, lo);
+	_mm256_storeu_ps(result + 8, hi);
+}
+
+MATH_TARGET_AVX static void mat4_sub_avx(float *result, const float *mat_a, const float *mat_b)
+{
+	__m256 lo = _mm256_sub_ps(_mm256_loadu_ps(mat_a), _mm256_loadu_ps(mat_b));
+	__m256 hi = _mm256_sub_ps(_mm256_loadu_ps(mat_a + 8), _mm256_loadu_ps(mat_b + 8));
+	_mm256_storeu_ps(result, lo);
+	_mm256_storeu_ps(result + 8, hi);
+}
+
+MATH_TARGET_AVX static void mat4_scale_avx(float *result, const float *mat, float s)
+{
+	__m256 k = _mm256_set1_ps(s);
+	__m256 lo = _mm256_mul_ps(_mm256_loadu_ps(mat), k);
+	__m256 hi = _mm256_mul_ps(_mm256_loadu_ps(mat + 8), k);
+	_mm256_storeu_ps(result, lo);
+	_mm256_storeu_ps(result + 8, hi);
+}
+
+MATH_TARGET_AVX static void cull_aabbs_avx(uint32_t *visible, const float *planes, const float *const bounds[6], size_t first, size_t count)
+{
+	__m256 p[6][4];
+	__m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	for(int j = 0; j < 6; j++)
+		for(int k = 0; k < 4; k++)
+			p[j][k] = _mm256_set1_ps(planes[j * 4 + k]);
+
+	size_t i = first;
+	for(; i + 32 <= count; i += 32)
+	{
+		uint32_t bits = 0;
+		for(size_t k = i; k < i + 32; k += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(bounds[0] + k);
+			__m256 cy = _mm256_loadu_ps(bounds[1] + k);
+			__m256 cz = _mm256_loadu_ps(bounds[2] + k);
+			__m256 ex = _mm256_loadu_ps(bounds[3] + k);
+			__m256 ey = _mm256_loadu_ps(bounds[4] + k);
+			__m256 ez = _mm256_loadu_ps(bounds[5] + k);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for(int j = 0; j < 6; j++)
+			{
+				__m256 d = _mm256_add_ps(_mm256_mul_ps(p[j][0], cx), _mm256_mul_ps(p[j][1], cy));
+				d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(p[j][2], cz)), p[j][3]);
+				__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(p[j][0], abs_mask), ex),
+					_mm256_mul_ps(_mm256_and_ps(p[j][1], abs_mask), ey));
+				r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_and_ps(p[j][2], abs_mask), ez));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_NLT_UQ));
+			}
+			bits |= (uint32_t)_mm256_movemask_ps(inside) << (k - i);
+		}
+		visible[i / 32] = bits;
+	}
+	cull_aabbs_tail(visible, planes, bounds, i, count);
+}
+
+MATH_TARGET_AVX static void cull_spheres_avx(uint32_t *visible, const float *planes, const float *const bounds[4], size_t first, size_t count)
+{
+	__m256 p[6][4];
+	__m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	for(int j = 0; j < 6; j++)
+		for(int k = 0; k < 4; k++)
+			p[j][k] = _mm256_set1_ps(planes[j * 4 + k]);
+
+	size_t i = first;
+	for(; i + 32 <= count; i += 32)
+	{
+		uint32_t bits = 0;
+		for(size_t k = i; k < i + 32; k += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(bounds[0] + k);
+			__m256 cy = _mm256_loadu_ps(bounds[1] + k);
+			__m256 cz = _mm256_loadu_ps(bounds[2] + k);
+			__m256 neg_r = _mm256_xor_ps(_mm256_loadu_ps(bounds[3] + k), sign_mask);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for(int j = 0; j < 6; j++)
+			{
+				__m256 d = _mm256_add_ps(_mm256_mul_ps(p[j][0], cx), _mm256_mul_ps(p[j][1], cy));
+				d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(p[j][2], cz)), p[j][3]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_NLT_UQ));
+			}
+			bits |= (uint32_t)_mm256_movemask_ps(inside) << (k - i);
+		}
+		visible[i / 32] = bits;
+	}
+	cull_spheres_tail(visible, planes, bounds, i, count);
+}
+
+MATH_TARGET_AVX static void stream_add_avx(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+		_mm256_store_ps(result + i, _mm256_add_ps(_mm256_load_ps(a + i), _mm256_load_ps(b + i)));
+}
+
+MATH_TARGET_AVX static void stream_sub_avx(float *result, const float *a, const float *b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+		_mm256_store_ps(result + i, _mm256_sub_ps(_mm256_load_ps(a + i), _mm256_load_ps(b + i)));
+}
+
+MATH_TARGET_AVX static void stream_scale_avx(float *result, const float *a, float s, size_t n)
+{
+	__m256 vs = _mm256_set1_ps(s);
+	for(size_t i = 0; i < n; i += 8)
+		_mm256_store_ps(result + i, _mm256_mul_ps(_mm256_load_ps(a + i), vs));
+}
+
+MATH_TARGET_AVX static void stream_sqrt_avx(float *result, const float *a, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+		_mm256_storeu_ps(result + i, _mm256_sqrt_ps(_mm256_loadu_ps(a + i)));
+}
+
+MATH_TARGET_AVX static void stream_dot_avx(float *result, const float *a, size_t capacity_a, const float *b, size_t capacity_b, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+	{
+		__m256 dot = _mm256_setzero_ps();
+		for(int k = 0; k < components; k++)
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_load_ps(a + k * capacity_a + i), _mm256_load_ps(b + k * capacity_b + i)));
+		_mm256_storeu_ps(result + i, dot);
+	}
+}
+
+MATH_TARGET_AVX static void stream_cross_avx(float *result, size_t capacity_r, const float *a, size_t capacity_a, const float *b, size_t capacity_b, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+	{
+		__m256 ax = _mm256_load_ps(a + i);
+		__m256 ay = _mm256_load_ps(a + capacity_a + i);
+		__m256 az = _mm256_load_ps(a + 2 * capacity_a + i);
+		__m256 bx = _mm256_load_ps(b + i);
+		__m256 by = _mm256_load_ps(b + capacity_b + i);
+		__m256 bz = _mm256_load_ps(b + 2 * capacity_b + i);
+		_mm256_store_ps(result + i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+		_mm256_store_ps(result + capacity_r + i, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+		_mm256_store_ps(result + 2 * capacity_r + i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+	}
+}
+
+MATH_TARGET_AVX static void stream_normalize_avx(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+	{
+		__m256 len = _mm256_setzero_ps();
+		for(int k = 0; k < components; k++)
+		{
+			__m256 c = _mm256_load_ps(a + k * capacity_a + i);
+			len = _mm256_add_ps(len, _mm256_mul_ps(c, c));
+		}
+		len = _mm256_sqrt_ps(len);
+		//zero length gives 1/0 = inf, masked back to zero
+		__m256 inv = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), len), _mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_NEQ_UQ));
+		for(int k = 0; k < components; k++)
+			_mm256_store_ps(result + k * capacity_r + i, _mm256_mul_ps(_mm256_load_ps(a + k * capacity_a + i), inv));
+	}
+}
+
+MATH_TARGET_AVX static inline __m256 rsqrt_avx(__m256 x)
+{
+	__m256 y = _mm256_rsqrt_ps(x);
+	__m256 t = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), y), y);
+	y = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), t));
+	return _mm256_and_ps(y, _mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_GE_OQ));
+}
+
+MATH_TARGET_AVX static void stream_normalize_approx_avx(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n)
+{
+	for(size_t i = 0; i < n; i += 8)
+	{
+		__m256 len2 = _mm256_setzero_ps();
+		for(int k = 0; k < components; k++)
+		{
+			__m256 c = _mm256_load_ps(a + k * capacity_a + i);
+			len2 = _mm256_add_ps(len2, _mm256_mul_ps(c, c));
+		}
+		__m256 inv = rsqrt_avx(len2);
+		for(int k = 0; k < components; k++)
+			_mm256_store_ps(result + k * capacity_r + i, _mm256_mul_ps(_mm256_load_ps(a + k * capacity_a + i), inv));
+	}
+}
+
+//F16C rounds to nearest even like math_float_to_half, results match
+__attribute__((target("avx,f16c"))) static void float_to_half_f16c(uint16_t *result, const float *values, size_t count)
+{
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+		_mm_storeu_si128((__m128i *)(result + i), _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT));
+	if(i < count)
+		float_to_half_sse2(result + i, values + i, count - i);
+}
+
+//ray_triangle4_sse2 on 8 lanes
+MATH_TARGET_AVX static inline __m256 ray_triangle8_avx(__m256 result[3], const __m256 *ray, const __m256 *tri, __m256 t_max)
+{
+	const __m256 *o = ray, *d = ray + 3;
+	const __m256 *v0 = tri, *e1 = tri + 3, *e2 = tri + 6;
+
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(d[1], e2[2]), _mm256_mul_ps(d[2], e2[1]));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(d[2], e2[0]), _mm256_mul_ps(d[0], e2[2]));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(d[0], e2[1]), _mm256_mul_ps(d[1], e2[0]));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1[0], px), _mm256_mul_ps(e1[1], py)), _mm256_mul_ps(e1[2], pz));
+	__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+	__m256 sx = _mm256_sub_ps(o[0], v0[0]);
+	__m256 sy = _mm256_sub_ps(o[1], v0[1]);
+	__m256 sz = _mm256_sub_ps(o[2], v0[2]);
+	__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv);
+
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1[2]), _mm256_mul_ps(sz, e1[1]));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1[0]), _mm256_mul_ps(sx, e1[2]));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1[1]), _mm256_mul_ps(sy, e1[0]));
+	__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], qx), _mm256_mul_ps(d[1], qy)), _mm256_mul_ps(d[2], qz)), inv);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2[0], qx), _mm256_mul_ps(e2[1], qy)), _mm256_mul_ps(e2[2], qz)), inv);
+
+	__m256 zero = _mm256_setzero_ps();
+	__m256 mask = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), det), _mm256_set1_ps(MATH_RAY_EPSILON), _CMP_GE_OQ);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, ray[6], _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, t_max, _CMP_LT_OQ));
+	result[0] = t;
+	result[1] = u;
+	result[2] = v;
+	return mask;
+}
+
+MATH_TARGET_AVX static int ray_triangles_avx(float *hit, uint32_t *primitive, const float *ray, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	//BVH leaves are mostly this small, half the lanes would be padding
+	if(end - first <= 4)
+		return ray_triangles_sse2(hit, primitive, ray, v0, e1, e2, capacity, first, end);
+
+	const float *const src[9] = {v0, v0 + capacity, v0 + 2 * capacity, e1, e1 + capacity, e1 + 2 * capacity, e2, e2 + capacity, e2 + 2 * capacity};
+	__m256 r[7];
+	for(int k = 0; k < 7; k++)
+		r[k] = _mm256_set1_ps(ray[k]);
+	__m256 best[3] = {_mm256_set1_ps(hit[0]), _mm256_set1_ps(hit[1]), _mm256_set1_ps(hit[2])};
+	__m256 best_index = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+	for(size_t i = first; i < end; i += 8)
+	{
+		__m256 tri[9];
+		if(end - i >= 8)
+		{
+			for(int k = 0; k < 9; k++)
+				tri[k] = _mm256_loadu_ps(src[k] + i);
+		}
+		else
+		{
+			float pad[8] = {0.0f};
+			for(int k = 0; k < 9; k++)
+			{
+				memcpy(pad, src[k] + i, (end - i) * sizeof(float));
+				tri[k] = _mm256_loadu_ps(pad);
+			}
+		}
+
+		__m256 found[3];
+		__m256 mask = ray_triangle8_avx(found, r, tri, best[0]);
+		for(int k = 0; k < 3; k++)
+			best[k] = _mm256_blendv_ps(best[k], found[k], mask);
+		int32_t n = (int32_t)i;
+		__m256i index = _mm256_setr_epi32(n, n + 1, n + 2, n + 3, n + 4, n + 5, n + 6, n + 7);
+		best_index = _mm256_blendv_ps(best_index, _mm256_castsi256_ps(index), mask);
+	}
+
+	float lanes[24];
+	int32_t indices[8];
+	for(int k = 0; k < 3; k++)
+		_mm256_storeu_ps(lanes + k * 8, best[k]);
+	_mm256_storeu_ps((float *)indices, best_index);
+	_mm256_zeroupper(); //the reduce is plain SSE code
+	return ray_hit_reduce(hit, primitive, lanes, indices, 8);
+}
+
+MATH_TARGET_AVX static uint32_t ray_packet_triangles_avx(float *hit, uint32_t *primitive, const float *rays, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end)
+{
+	const float *const src[9] = {v0, v0 + capacity, v0 + 2 * capacity, e1, e1 + capacity, e1 + 2 * capacity, e2, e2 + capacity, e2 + 2 * capacity};
+	__m256 r[7], best[3];
+	for(int k = 0; k < 7; k++)
+		r[k] = _mm256_loadu_ps(rays + k * 8);
+	for(int k = 0; k < 3; k++)
+		best[k] = _mm256_loadu_ps(hit + k * 8);
+	__m256 best_index = _mm256_loadu_ps((const float *)primitive);
+	__m256 any = _mm256_setzero_ps();
+
+	for(size_t i = first; i < end; i++)
+	{
+		__m256 tri[9], found[3];
+		for(int k = 0; k < 9; k++)
+			tri[k] = _mm256_set1_ps(src[k][i]);
+		__m256 closer = ray_triangle8_avx(found, r, tri, best[0]);
+		for(int k = 0; k < 3; k++)
+			best[k] = _mm256_blendv_ps(best[k], found[k], closer);
+		best_index = _mm256_blendv_ps(best_index, _mm256_castsi256_ps(_mm256_set1_epi32((int32_t)i)), closer);
+		any = _mm256_or_ps(any, closer);
+	}
+
+	for(int k = 0; k < 3; k++)
+		_mm256_storeu_ps(hit + k * 8, best[k]);
+	_mm256_storeu_ps((float *)primitive, best_index);
+	return (uint32_t)_mm256_movemask_ps(any);
+}
+
+MATH_TARGET_AVX static uint32_t ray_packet_aabb_avx(float *t_near, const float *rays, const float *box)
+{
+	__m256 near = _mm256_loadu_ps(rays + 6 * 8);
+	__m256 far = _mm256_loadu_ps(rays + 7 * 8);
+	for(int k = 0; k < 3; k++)
+	{
+		__m256 o = _mm256_loadu_ps(rays + k * 8);
+		__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(rays + (3 + k) * 8));
+		__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box[k]), o), inv);
+		__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box[3 + k]), o), inv);
+		near = _mm256_max_ps(_mm256_min_ps(t0, t1), near);
+		far = _mm256_min_ps(_mm256_max_ps(t0, t1), far);
+	}
+	_mm256_storeu_ps(t_near, near);
+	return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ));
+}
+
+// AVX END
+
+/*
+ * AVX2 BEGIN
+*/
+
+MATH_TARGET_AVX2 static void mat4_mul_avx2(float *result, const float *mat_a, const float *mat_b)
+{
+	__m256 b0 = _mm256_broadcast_ps((const __m128 *)mat_b);
+	__m256 b1 = _mm256_broadcast_ps((const __m128 *)(mat_b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128 *)(mat_b + 8));
+	__m256 b3 = _mm256_broadcast_ps((const __m128 *)(mat_b + 12));
+	__m256 a01 = _mm256_loadu_ps(mat_a);
+	__m256 a23 = _mm256_loadu_ps(mat_a + 8);
+
+	__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+	r01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1, r01);
+	r01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2, r01);
+	r01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xff), b3, r01);
+
+	__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+	r23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1, r23);
+	r23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2, r23);
+	r23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xff), b3, r23);
+
+	_mm256_storeu_ps(result, r01);
+	_mm256_storeu_ps(result + 8, r23);
+}
+
+MATH_TARGET_AVX2 static void mat4x3_mul_avx2(float *result, const float *mat_a, const float *mat_b)
+{
+	__m128 c3 = mat4x3_col3_sse2(mat_b);
+	__m256 b0 = _mm256_broadcast_ps((const __m128 *)mat_b);
+	__m256 b1 = _mm256_broadcast_ps((const __m128 *)(mat_b + 3));
+	__m256 b2 = _mm256_broadcast_ps((const __m128 *)(mat_b + 6));
+	__m256 a01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(mat_a)), _mm_loadu_ps(mat_a + 3), 1);
+	__m256 a23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(mat_a + 6)), mat4x3_col3_sse2(mat_a), 1);
+
+	__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+	r01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1, r01);
+	r01 = _mm256_fmadd_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2, r01);
+
+	__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+	r23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1, r23);
+	r23 = _mm256_fmadd_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2, r23);
+
+	mat4x3_store_sse2(result, _mm256_castps256_ps128(r01), _mm256_extractf128_ps(r01, 1),
+		_mm256_castps256_ps128(r23), _mm_add_ps(_mm256_extractf128_ps(r23, 1), c3));
+}
+
+MATH_TARGET_AVX2 static void transform_aos_avx2
+(
+	float *result,
+	size_t result_stride,
+	const float *mat,
+	const float *points,
+	size_t stride,
+	size_t count,
+	int translate
+)
+{
+	//two points per register, one in each lane
+	__m256 c0 = _mm256_broadcast_ps((const __m128 *)mat);
+	__m256 c1 = _mm256_broadcast_ps((const __m128 *)(mat + 4));
+	__m256 c2 = _mm256_broadcast_ps((const __m128 *)(mat + 8));
+	__m256 c3 = translate ? _mm256_broadcast_ps((const __m128 *)(mat + 12)) : _mm256_setzero_ps();
+
+	size_t i = 0;
+	for(; i + 2 <= count; i += 2)
+	{
+		const float *p0 = points + i * stride;
+		const float *p1 = p0 + stride;
+		float *r0 = result + i * result_stride;
+		float *r1 = r0 + result_stride;
+
+		__m256 px = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[0])), _mm_set1_ps(p1[0]), 1);
+		__m256 py = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[1])), _mm_set1_ps(p1[1]), 1);
+		__m256 pz = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(p0[2])), _mm_set1_ps(p1[2]), 1);
+
+		__m256 v = _mm256_fmadd_ps(c0, px, c3);
+		v = _mm256_fmadd_ps(c1, py, v);
+		v = _mm256_fmadd_ps(c2, pz, v);
+
+		__m128 lo = _mm256_castps256_ps128(v);
+		__m128 hi = _mm256_extractf128_ps(v, 1);
+		_mm_storel_pi((__m64 *)r0, lo);
+		_mm_store_ss(r0 + 2, _mm_movehl_ps(lo, lo));
+		_mm_storel_pi((__m64 *)r1, hi);
+		_mm_store_ss(r1 + 2, _mm_movehl_ps(hi, hi));
+	}
+	if(i < count)
+	{
+		const float *p = points + i * stride;
+		float *r = result + i * result_stride;
+		__m128 v = _mm_fmadd_ps(_mm256_castps256_ps128(c0), _mm_set1_ps(p[0]), _mm256_castps256_ps128(c3));
+		v = _mm_fmadd_ps(_mm256_castps256_ps128(c1), _mm_set1_ps(p[1]), v);
+		v = _mm_fmadd_ps(_mm256_castps256_ps128(c2), _mm_set1_ps(p[2]), v);
+		_mm_storel_pi((__m64 *)r, v);
+		_mm_store_ss(r + 2, _mm_movehl_ps(v, v));
+	}
+}
+
+MATH_TARGET_AVX2 static void transform_soa_avx2
+(
+	float *result_x,
+	float *result_y,
+	float *result_z,
+	const float *mat,
+	const float *x,
+	const float *y,
+	const float *z,
+	size_t count,
+	int translate
+)
+{
+	__m256 m[12];
+	for(int j = 0; j < 12; j++)
+		m[j] = _mm256_set1_ps(mat[j]);
+	__m256 tx = _mm256_set1_ps(translate ? mat[12] : 0.0f);
+	__m256 ty = _mm256_set1_ps(translate ? mat[13] : 0.0f);
+	__m256 tz = _mm256_set1_ps(translate ? mat[14] : 0.0f);
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + i);
+		__m256 py = _mm256_loadu_ps(y + i);
+		__m256 pz = _mm256_loadu_ps(z + i);
+
+		__m256 rx = _mm256_fmadd_ps(m[8], pz, _mm256_fmadd_ps(m[4], py, _mm256_fmadd_ps(m[0], px, tx)));
+		__m256 ry = _mm256_fmadd_ps(m[9], pz, _mm256_fmadd_ps(m[5], py, _mm256_fmadd_ps(m[1], px, ty)));
+		__m256 rz = _mm256_fmadd_ps(m[10], pz, _mm256_fmadd_ps(m[6], py, _mm256_fmadd_ps(m[2], px, tz)));
+
+		_mm256_storeu_ps(result_x + i, rx);
+		_mm256_storeu_ps(result_y + i, ry);
+		_mm256_storeu_ps(result_z + i, rz);
+	}
+	transform_soa_tail(result_x, result_y, result_z, mat, x, y, z, i, count, translate);
+}
+
+/*
+ * 8 quaternions at a time: q0..q3 in the low lanes, q4..q7 in the high
+ * ones, then the usual 4x4 transpose inside each lane.
+*/
+MATH_TARGET_AVX2 static inline void quat_transpose8(__m256 *r0, __m256 *r1, __m256 *r2, __m256 *r3)
+{
+	__m256 t0 = _mm256_unpacklo_ps(*r0, *r1);
+	__m256 t1 = _mm256_unpacklo_ps(*r2, *r3);
+	__m256 t2 = _mm256_unpackhi_ps(*r0, *r1);
+	__m256 t3 = _mm256_unpackhi_ps(*r2, *r3);
+	*r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	*r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	*r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	*r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+MATH_TARGET_AVX2 static inline void quat_load8(__m256 q[4], const float *qts)
+{
+	for(int k = 0; k < 4; k++)
+		q[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(qts + k * 4)), _mm_loadu_ps(qts + 16 + k * 4), 1);
+	quat_transpose8(&q[0], &q[1], &q[2], &q[3]);
+}
+
+MATH_TARGET_AVX2 static inline void quat_store8(float *qts, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+	quat_transpose8(&x, &y, &z, &w);
+	__m256 q[4] = {x, y, z, w};
+	for(int k = 0; k < 4; k++)
+	{
+		_mm_storeu_ps(qts + k * 4, _mm256_castps256_ps128(q[k]));
+		_mm_storeu_ps(qts + 16 + k * 4, _mm256_extractf128_ps(q[k], 1));
+	}
+}
+
+MATH_TARGET_AVX2 static inline void quat_normalize8(__m256 *x, __m256 *y, __m256 *z, __m256 *w)
+{
+	__m256 len = _mm256_mul_ps(*x, *x);
+	len = _mm256_fmadd_ps(*y, *y, len);
+	len = _mm256_fmadd_ps(*z, *z, len);
+	len = _mm256_fmadd_ps(*w, *w, len);
+	len = _mm256_sqrt_ps(len);
+	__m256 k = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), len),
+		_mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+	*x = _mm256_mul_ps(*x, k);
+	*y = _mm256_mul_ps(*y, k);
+	*z = _mm256_mul_ps(*z, k);
+	*w = _mm256_mul_ps(*w, k);
+}
+
+MATH_TARGET_AVX2 static inline __m256 quat_dot8(__m256 a[4], __m256 b[4])
+{
+	__m256 dot = _mm256_mul_ps(a[0], b[0]);
+	dot = _mm256_fmadd_ps(a[1], b[1], dot);
+	dot = _mm256_fmadd_ps(a[2], b[2], dot);
+	return _mm256_fmadd_ps(a[3], b[3], dot);
+}
+
+MATH_TARGET_AVX2 static void quat_nlerp_avx2(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	__m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 a[4], b[4], r[4];
+		quat_load8(a, qt_a + i * 4);
+		quat_load8(b, qt_b + i * 4);
+		__m256 tt = _mm256_loadu_ps(t + i);
+		__m256 wa = _mm256_sub_ps(_mm256_set1_ps(1.0f), tt);
+		__m256 wb = _mm256_xor_ps(tt, _mm256_and_ps(quat_dot8(a, b), sign_mask));
+
+		for(int k = 0; k < 4; k++)
+			r[k] = _mm256_fmadd_ps(wb, b[k], _mm256_mul_ps(wa, a[k]));
+		quat_normalize8(&r[0], &r[1], &r[2], &r[3]);
+		quat_store8(result + i * 4, r[0], r[1], r[2], r[3]);
+	}
+	if(i < count)
+		quat_nlerp_sse2(result + i * 4, qt_a + i * 4, qt_b + i * 4, t + i, count - i);
+}
+
+MATH_TARGET_AVX2 static inline __m256 sin_half_pi_avx2(__m256 x)
+{
+	__m256 x2 = _mm256_mul_ps(x, x);
+	__m256 p = _mm256_set1_ps(1.6059044e-10f);
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-2.5052108e-8f));
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(2.7557319e-6f));
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.9841270e-4f));
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(8.3333333e-3f));
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.6666667e-1f));
+	p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.0f));
+	return _mm256_mul_ps(p, x);
+}
+
+MATH_TARGET_AVX2 static inline __m256 acos_unit_avx2(__m256 x)
+{
+	__m256 p = _mm256_set1_ps(-0.0012624911f);
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0066700901f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0170881256f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0308918810f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0501743046f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0889789874f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.2145988016f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(1.5707963050f));
+	return _mm256_mul_ps(p, _mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), x)));
+}
+
+MATH_TARGET_AVX2 static void quat_slerp_avx2(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count)
+{
+	__m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256 a[4], b[4], r[4];
+		quat_load8(a, qt_a + i * 4);
+		quat_load8(b, qt_b + i * 4);
+		__m256 dot = quat_dot8(a, b);
+		__m256 sign = _mm256_and_ps(dot, sign_mask);
+		dot = _mm256_min_ps(_mm256_xor_ps(dot, sign), one);
+		__m256 tt = _mm256_loadu_ps(t + i);
+
+		__m256 theta = acos_unit_avx2(dot);
+		__m256 inv_sin = _mm256_div_ps(one, sin_half_pi_avx2(theta));
+		__m256 wa = _mm256_mul_ps(sin_half_pi_avx2(_mm256_mul_ps(_mm256_sub_ps(one, tt), theta)), inv_sin);
+		__m256 wb = _mm256_mul_ps(sin_half_pi_avx2(_mm256_mul_ps(tt, theta)), inv_sin);
+
+		__m256 near = _mm256_cmp_ps(dot, _mm256_set1_ps(0.9995f), _CMP_GT_OQ);
+		wa = _mm256_blendv_ps(wa, _mm256_sub_ps(one, tt), near);
+		wb = _mm256_blendv_ps(wb, tt, near);
+		wb = _mm256_xor_ps(wb, sign);
+
+		for(int k = 0; k < 4; k++)
+			r[k] = _mm256_fmadd_ps(wb, b[k], _mm256_mul_ps(wa, a[k]));
+		quat_normalize8(&r[0], &r[1], &r[2], &r[3]);
+		quat_store8(result + i * 4, r[0], r[1], r[2], r[3]);
+	}
+	if(i < count)
+		quat_slerp_sse2(result + i * 4, qt_a + i * 4, qt_b + i * 4, t + i, count - i);
+}
+
+//no fma in the target: contracting the polynomial would break the match with math_sincos
+__attribute__((target("avx2"))) static inline void sincos_avx2(__m256 angle, __m256 *s, __m256 *c)
+{
+	__m256 round = _mm256_set1_ps(MATH_ROUND_MAGIC);
+	__m256 k = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(angle, _mm256_set1_ps(MATH_SINCOS_2_PI)), round), round);
+	__m256i quadrant = _mm256_cvttps_epi32(k);
+	__m256 r = _mm256_sub_ps(angle, _mm256_mul_ps(k, _mm256_set1_ps(MATH_SINCOS_PIO2_1)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(MATH_SINCOS_PIO2_2)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(MATH_SINCOS_PIO2_3)));
+	__m256 r2 = _mm256_mul_ps(r, r);
+
+	__m256 ps = _mm256_add_ps(_mm256_mul_ps(r2, _mm256_set1_ps(MATH_SINCOS_S3)), _mm256_set1_ps(MATH_SINCOS_S2));
+	ps = _mm256_add_ps(_mm256_mul_ps(r2, ps), _mm256_set1_ps(MATH_SINCOS_S1));
+	ps = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), ps));
+	__m256 pc = _mm256_add_ps(_mm256_mul_ps(r2, _mm256_set1_ps(MATH_SINCOS_C3)), _mm256_set1_ps(MATH_SINCOS_C2));
+	pc = _mm256_add_ps(_mm256_mul_ps(r2, pc), _mm256_set1_ps(MATH_SINCOS_C1));
+	pc = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), pc));
+
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i two = _mm256_set1_epi32(2);
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+	__m256 sign_s = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+	__m256 sign_c = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+	*s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sign_s);
+	*c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), sign_c);
+}
+
+__attribute__((target("avx2"))) static void sincos_batch_avx2(float *s, float *c, const float *angles, size_t count)
+{
+	size_t i = 0;
+	__m256 vs, vc;
+
+	for(; i + 8 <= count; i += 8)
+	{
+		sincos_avx2(_mm256_loadu_ps(angles + i), &vs, &vc);
+		_mm256_storeu_ps(s + i, vs);
+		_mm256_storeu_ps(c + i, vc);
+	}
+
+	if(i < count)
+		sincos_batch_sse2(s + i, c + i, angles + i, count - i);
+}
+
+//no mul + add to contract here, the cells match the scalar code
+MATH_TARGET_AVX2 static inline __m256i morton_cell_avx2(__m256 v, float min, float scale)
+{
+	__m256 f = _mm256_mul_ps(_mm256_sub_ps(v, _mm256_set1_ps(min)), _mm256_set1_ps(scale));
+	f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(1023.0f));
+	__m256i c = _mm256_cvttps_epi32(f);
+	c = _mm256_and_si256(_mm256_or_si256(c, _mm256_slli_epi32(c, 16)), _mm256_set1_epi32(0x030000FF));
+	c = _mm256_and_si256(_mm256_or_si256(c, _mm256_slli_epi32(c, 8)), _mm256_set1_epi32(0x0300F00F));
+	c = _mm256_and_si256(_mm256_or_si256(c, _mm256_slli_epi32(c, 4)), _mm256_set1_epi32(0x030C30C3));
+	c = _mm256_and_si256(_mm256_or_si256(c, _mm256_slli_epi32(c, 2)), _mm256_set1_epi32(0x09249249));
+	return c;
+}
+
+MATH_TARGET_AVX2 static void morton3_avx2(uint32_t *result, const float *x, const float *y, const float *z, const float *min_scale, size_t count)
+{
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i cx = morton_cell_avx2(_mm256_loadu_ps(x + i), min_scale[0], min_scale[3]);
+		__m256i cy = morton_cell_avx2(_mm256_loadu_ps(y + i), min_scale[1], min_scale[4]);
+		__m256i cz = morton_cell_avx2(_mm256_loadu_ps(z + i), min_scale[2], min_scale[5]);
+		__m256i code = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(cx, 2), _mm256_slli_epi32(cy, 1)), cz);
+		_mm256_storeu_si256((__m256i *)(result + i), code);
+	}
+	_mm256_zeroupper();
+
+	if(i < count)
+		morton3_sse2(result + i, x + i, y + i, z + i, min_scale, count - i);
+}
+
+// AVX2 END
+
+#endif //MATH_SIMD_X86
+
+int math_simd_detect(void)
+{
+#ifdef MATH_SIMD_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return MATH_SIMD_AVX2;
+	if(__builtin_cpu_supports("avx"))
+		return MATH_SIMD_AVX;
+	if(__builtin_cpu_supports("sse2"))
+		return MATH_SIMD_SSE2;
+#endif
+	return MATH_SIMD_SCALAR;
+}
+
+int math_simd_get_level(void)
+{
+	return math_simd_level;
+}
+
+int math_simd_set_level(int level)
+{
+	int supported = math_simd_detect();
+	if(level > supported)
+		level = supported;
+	if(level < MATH_SIMD_SCALAR)
+		level = MATH_SIMD_SCALAR;
+
+	//higher levels only override what they improve on
+	memset(&math_simd, 0, sizeof(math_simd));
+#ifdef MATH_SIMD_X86
+	if(level >= MATH_SIMD_SSE2)
+	{
+		math_simd.mat4_mul = mat4_mul_sse2;
+		math_simd.mat4_add = mat4_add_sse2;
+		math_simd.mat4_sub = mat4_sub_sse2;
+		math_simd.mat4_scale = mat4_scale_sse2;
+		math_simd.transform_aos = transform_aos_sse2;
+		math_simd.transform_soa = transform_soa_sse2;
+		math_simd.mat4_inverse = mat4_inverse_sse2;
+		math_simd.mat4_inverse_affine = mat4_inverse_affine_sse2;
+		math_simd.mat4_normal_matrix = mat4_normal_matrix_sse2;
+		math_simd.mat4x3_mul = mat4x3_mul_sse2;
+		math_simd.mat4x3_inverse = mat4x3_inverse_sse2;
+		math_simd.cull_aabbs = cull_aabbs_sse2;
+		math_simd.cull_spheres = cull_spheres_sse2;
+		math_simd.quat_mul = quat_mul_sse2;
+		math_simd.quat_rotate = quat_rotate_sse2;
+		math_simd.quat_to_mat4 = quat_to_mat4_sse2;
+		math_simd.quat_nlerp = quat_nlerp_sse2;
+		math_simd.quat_slerp = quat_slerp_sse2;
+		math_simd.sincos = sincos_batch_sse2;
+		math_simd.float_to_half = float_to_half_sse2;
+		math_simd.octahedral_encode = octahedral_encode_sse2;
+		math_simd.snorm16 = snorm16_batch_sse2;
+		math_simd.stream_add = stream_add_sse2;
+		math_simd.stream_sub = stream_sub_sse2;
+		math_simd.stream_scale = stream_scale_sse2;
+		math_simd.stream_sqrt = stream_sqrt_sse2;
+		math_simd.stream_dot = stream_dot_sse2;
+		math_simd.stream_cross = stream_cross_sse2;
+		math_simd.stream_normalize = stream_normalize_sse2;
+		math_simd.stream_normalize_approx = stream_normalize_approx_sse2;
+		math_simd.normalize_approx_aos = normalize_approx_aos_sse2;
+		math_simd.ray_triangles = ray_triangles_sse2;
+		math_simd.ray_packet_triangles = ray_packet_triangles_sse2;
+		math_simd.ray_packet_aabb = ray_packet_aabb_sse2;
+		math_simd.morton3 = morton3_sse2;
+		math_simd.aabb_transform = aabb_transform_sse2;
+	}
+	if(level >= MATH_SIMD_AVX)
+	{
+		math_simd.mat4_mul = mat4_mul_avx;
+		math_simd.mat4x3_mul = mat4x3_mul_avx;
+		math_simd.mat4_add = mat4_add_avx;
+		math_simd.mat4_sub = mat4_sub_avx;
+		math_simd.mat4_scale = mat4_scale_avx;
+		math_simd.cull_aabbs = cull_aabbs_avx;
+		math_simd.cull_spheres = cull_spheres_avx;
+		math_simd.stream_add = stream_add_avx;
+		math_simd.stream_sub = stream_sub_avx;
+		math_simd.stream_scale = stream_scale_avx;
+		math_simd.stream_sqrt = stream_sqrt_avx;
+		math_simd.stream_dot = stream_dot_avx;
+		math_simd.stream_cross = stream_cross_avx;
+		math_simd.stream_normalize = stream_normalize_avx;
+		math_simd.stream_normalize_approx = stream_normalize_approx_avx;
+		math_simd.ray_triangles = ray_triangles_avx;
+		math_simd.ray_packet_triangles = ray_packet_triangles_avx;
+		math_simd.ray_packet_aabb = ray_packet_aabb_avx;
+		if(__builtin_cpu_supports("f16c"))
+			math_simd.float_to_half = float_to_half_f16c;
+	}
+	if(level >= MATH_SIMD_AVX2)
+	{
+		math_simd.mat4_mul = mat4_mul_avx2;
+		math_simd.mat4x3_mul = mat4x3_mul_avx2;
+		math_simd.transform_aos = transform_aos_avx2;
+		math_simd.transform_soa = transform_soa_avx2;
+		math_simd.quat_nlerp = quat_nlerp_avx2;
+		math_simd.quat_slerp = quat_slerp_avx2;
+		math_simd.sincos = sincos_batch_avx2;
+		math_simd.morton3 = morton3_avx2;
+	}
+#endif
+
+	math_simd_level = level;
+	return level;
+}
+
+const char *math_simd_level_name(int level)
+{
+	switch(level)
+	{
+		case MATH_SIMD_SSE2: return "sse2";
+		case MATH_SIMD_AVX: return "avx";
+		case MATH_SIMD_AVX2: return "avx2+fma";
+		default: return "scalar";
+	}
+}
+
+#if defined(MATH_SIMD) && defined(__GNUC__)
+__attribute__((constructor)) static void math_simd_startup(void)
+{
+	math_simd_set_level(math_simd_detect());
+}
+#endif
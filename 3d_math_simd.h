@@ -0,0 +1,200 @@
+/**
+ * Matheus' Simple 3D Math
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file 3d_math_simd.h
+ * @brief SIMD kernels and runtime dispatch for 3d_math
+ *
+ * Only active when building with MATH_SIMD defined. The kernel table is
+ * filled once at startup from cpuid. Entries left NULL mean "use the
+ * scalar code in 3d_math.c", so the public API in 3d_math.h never
+ * changes between builds.
+ *
+ * Also holds the helpers used to split big batches across threads,
+ * which only do something when building with -fopenmp.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#ifndef THREEDMATH_SIMD
+#define THREEDMATH_SIMD
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum
+{
+	MATH_SIMD_SCALAR = 0,
+	MATH_SIMD_SSE2,
+	MATH_SIMD_AVX,
+	MATH_SIMD_AVX2 //AVX2 + FMA
+};
+
+/*
+ * Kernels take plain float pointers, mat4 is 16 contiguous floats.
+ * They load all inputs before storing, so result may alias inputs.
+*/
+typedef struct math_simd_table
+{
+	void (*mat4_mul)(float *result, const float *mat_a, const float *mat_b);
+	void (*mat4_add)(float *result, const float *mat_a, const float *mat_b);
+	void (*mat4_sub)(float *result, const float *mat_a, const float *mat_b);
+	void (*mat4_scale)(float *result, const float *mat, float s);
+	void (*mat4_inverse)(float *result, const float *mat);
+	void (*mat4_inverse_affine)(float *result, const float *mat);
+	void (*mat4_normal_matrix)(float *result, const float *model);
+
+	//mat4x3 is 12 contiguous floats, the (0, 0, 0, 1) row is implicit
+	void (*mat4x3_mul)(float *result, const float *mat_a, const float *mat_b);
+	void (*mat4x3_inverse)(float *result, const float *mat);
+
+	//translate == 0 skips the fourth column (directions)
+	void (*transform_aos)(float *result, size_t result_stride, const float *mat, const float *points, size_t stride, size_t count, int translate);
+	void (*transform_soa)(float *result_x, float *result_y, float *result_z, const float *mat, const float *x, const float *y, const float *z, size_t count, int translate);
+	void (*normalize_approx_aos)(float *result, size_t result_stride, const float *vecs, size_t stride, size_t count);
+
+	//first is a multiple of 32, whole words of visible get written
+	void (*cull_aabbs)(uint32_t *visible, const float *planes, const float *const bounds[6], size_t first, size_t count);
+	void (*cull_spheres)(uint32_t *visible, const float *planes, const float *const bounds[4], size_t first, size_t count);
+
+	//quaternion arrays, element i of every array goes together
+	void (*quat_mul)(float *result, const float *qt_a, const float *qt_b, size_t count);
+	void (*quat_rotate)(float *result, const float *qts, const float *vecs, size_t count);
+	void (*quat_to_mat4)(float *result, const float *qts, size_t count);
+	void (*quat_nlerp)(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count);
+	void (*quat_slerp)(float *result, const float *qt_a, const float *qt_b, const float *t, size_t count);
+
+	void (*sincos)(float *s, float *c, const float *angles, size_t count);
+
+	void (*float_to_half)(uint16_t *result, const float *values, size_t count);
+	void (*octahedral_encode)(int16_t *result, const float *normals, size_t stride, size_t count);
+	void (*snorm16)(int16_t *result, const float *values, float scale, size_t count); //snorm16 of value * scale
+
+	/*
+	 * SoA streams: n is a multiple of 8 and stream arrays are 32-byte
+	 * aligned. Component k of a stream is at base + k * capacity. The
+	 * float results of dot and sqrt are plain arrays, maybe unaligned.
+	*/
+	void (*stream_add)(float *result, const float *a, const float *b, size_t n);
+	void (*stream_sub)(float *result, const float *a, const float *b, size_t n);
+	void (*stream_scale)(float *result, const float *a, float s, size_t n);
+	void (*stream_sqrt)(float *result, const float *a, size_t n);
+	void (*stream_dot)(float *result, const float *a, size_t capacity_a, const float *b, size_t capacity_b, int components, size_t n);
+	void (*stream_cross)(float *result, size_t capacity_r, const float *a, size_t capacity_a, const float *b, size_t capacity_b, size_t n);
+	void (*stream_normalize)(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n);
+	void (*stream_normalize_approx)(float *result, size_t capacity_r, const float *a, size_t capacity_a, int components, size_t n);
+
+	/*
+	 * Rays are 8 floats (origin, direction, t_min, t_max), packets 8
+	 * arrays of 8. hit is t, u, v (arrays of 8 for packets); hit t comes
+	 * in as the closest so far and only closer hits are written. Triangles
+	 * are v0/e1/e2 streams sharing capacity, first..end unaligned.
+	 * Return whether (which lanes) got a closer hit.
+	*/
+	int (*ray_triangles)(float *hit, uint32_t *primitive, const float *ray, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end);
+	uint32_t (*ray_packet_triangles)(float *hit, uint32_t *primitive, const float *rays, const float *v0, const float *e1, const float *e2, size_t capacity, size_t first, size_t end);
+	uint32_t (*ray_packet_aabb)(float *t_near, const float *rays, const float *box); //box is min xyz, max xyz
+
+	//boxes are min xyz, max xyz, mats are mat4x3
+	void (*aabb_transform)(float *result, const float *boxes, const float *mats, size_t count);
+
+	//min_scale is the box min xyz then cells per unit xyz
+	void (*morton3)(uint32_t *result, const float *x, const float *y, const float *z, const float *min_scale, size_t count);
+} math_simd_table;
+
+extern math_simd_table math_simd;
+
+//(x + this) - this rounds x to the nearest integer (ties to even) for |x| < 2^22
+#define MATH_ROUND_MAGIC 12582912.0f
+
+/*
+ * math_sincos: round to the nearest quarter turn, subtract it in three
+ * parts of pi/2 (Cody-Waite) and evaluate the cephes sinf/cosf
+ * polynomials on [-pi/4, pi/4]. Shared so the kernels match the scalar
+ * code exactly.
+*/
+#define MATH_SINCOS_2_PI 0.63661977236758134f
+#define MATH_SINCOS_PIO2_1 1.5703125f
+#define MATH_SINCOS_PIO2_2 4.837512969970703125e-4f
+#define MATH_SINCOS_PIO2_3 7.54978995489188216e-8f
+#define MATH_SINCOS_S1 -1.6666654611e-1f
+#define MATH_SINCOS_S2 8.3321608736e-3f
+#define MATH_SINCOS_S3 -1.9515295891e-4f
+#define MATH_SINCOS_C1 4.166664568298827e-2f
+#define MATH_SINCOS_C2 -1.388731625493765e-3f
+#define MATH_SINCOS_C3 2.443315711809948e-5f
+
+//ray/triangle determinants below this are parallel (or degenerate triangles)
+#define MATH_RAY_EPSILON 1e-12f
+
+#ifdef MATH_SIMD
+	//run the selected kernel if there is one, otherwise fall through to scalar
+	#define MATH_DISPATCH(kernel, ...) \
+		if(math_simd.kernel != NULL) { math_simd.kernel(__VA_ARGS__); return; }
+	//the selected kernel, or the scalar one with the same signature
+	#define MATH_KERNEL(kernel, fallback) (math_simd.kernel != NULL ? math_simd.kernel : (fallback))
+#else
+	#define MATH_DISPATCH(kernel, ...)
+	#define MATH_KERNEL(kernel, fallback) (fallback)
+#endif
+
+//batches are cut in chunks of this many elements, chunks go to threads.
+//keep it a multiple of 32 so bitmask words are never split between threads
+#ifndef MATH_BATCH_CHUNK
+	#define MATH_BATCH_CHUNK 16384
+#endif
+
+#ifdef _OPENMP
+	#define MATH_PRAGMA(x) _Pragma(#x)
+	#define MATH_PARALLEL_FOR(cond) MATH_PRAGMA(omp parallel for if(cond) schedule(static))
+#else
+	#define MATH_PARALLEL_FOR(cond)
+#endif
+
+/*
+ * Run stmt over count elements chunk by chunk. Inside stmt, first and n
+ * (names picked by the caller) are the chunk start and length.
+*/
+#define MATH_BATCH(count, first, n, stmt) \
+	do \
+	{ \
+		long math_chunks = (long)(((count) + MATH_BATCH_CHUNK - 1) / MATH_BATCH_CHUNK); \
+		MATH_PARALLEL_FOR(math_chunks > 1) \
+		for(long math_chunk = 0; math_chunk < math_chunks; math_chunk++) \
+		{ \
+			size_t first = (size_t)math_chunk * MATH_BATCH_CHUNK; \
+			size_t n = (count) - first < MATH_BATCH_CHUNK ? (count) - first : MATH_BATCH_CHUNK; \
+			stmt; \
+		} \
+	} while(0)
+
+/**
+ * @brief Best level the running CPU supports
+*/
+int math_simd_detect(void);
+
+/**
+ * @brief Level currently in use
+*/
+int math_simd_get_level(void);
+
+/**
+ * Select the kernels for a level, clamped to what the CPU supports.
+ * Called automatically at startup with math_simd_detect(), call it
+ * again to force a lower level (e.g. to compare variants).
+ * @brief Select the SIMD level
+ * @param level (int) one of MATH_SIMD_*
+ * @return the level actually selected
+*/
+int math_simd_set_level(int level);
+
+const char *math_simd_level_name(int level);
+
+#endif
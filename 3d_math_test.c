@@ -0,0 +1,639 @@
+/**
+ * Matheus' Simple 3D Math
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file 3d_math_test.c
+ * @brief Checks the SIMD kernels against the scalar code
+ *
+ * Runs every 3d_math function that goes through a math_simd kernel once
+ * at the scalar level and once at each level the CPU supports, and
+ * compares the results. SSE2 and AVX must match bit for bit, except
+ * mat4_inverse and quat_slerp whose kernels use another algorithm. At
+ * AVX2 the kernels that fuse multiply-adds (mat4_mul, mat4x3_mul,
+ * transform_aos/soa, quat_nlerp/slerp) round once where the scalar code
+ * rounds twice, so they only have to be within TOLERANCE_FMA;
+ * everything else still has to match exactly. Also checks that math_mat4_mul works with result
+ * aliasing an input at every level.
+ *
+ * Before that, math_sincos and math_rsqrt are checked against libm and
+ * math_mat4_rotate_x/y/z against a rotation built by hand.
+ *
+ * ./3d_math_test exits with 1 on any mismatch. Without MATH_SIMD only
+ * the scalar level exists and there is nothing to compare.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "3d_math.h"
+#include "3d_math_simd.h"
+
+#define N 1003 //not a multiple of 8, so the kernel tails get tested too
+#define RAYS 64
+#define MAX_OUT (N * 48)
+
+/*
+ * Error allowed at AVX2 for the kernels using FMA, relative to
+ * max(1, |scalar result|). Inputs are within [-10, 10], a few ulp of
+ * the biggest terms in a 4 element dot product.
+*/
+#define TOLERANCE_FMA 1e-5f
+
+/*
+ * Kernels that use a different algorithm than the scalar code at every
+ * level, same measure. The general inverse is a 2x2 block adjugate
+ * instead of cofactors (the test matrices are well conditioned), slerp
+ * uses polynomial acos/sin instead of libm (documented within 3e-7).
+*/
+#define TOLERANCE_INVERSE 1e-6f
+#define TOLERANCE_SLERP 1e-6f
+
+typedef struct test
+{
+	const char *name;
+	size_t (*run)(float *out); //returns how many floats it wrote
+	float tolerance; //0: bit-exact with the scalar code
+	int fma; //compared with TOLERANCE_FMA at AVX2
+} test;
+
+static mat4 mat_a[N], mat_b[N], mat_r[N];
+static mat4x3 aff_a[N], aff_b[N], aff_r[N];
+static quat qt_a[N], qt_b[N], qt_r[N];
+static vec3 vec_a[N], vec_r[N];
+static float xs[N], ys[N], zs[N], ts[N], angles[N];
+static float points[N * 8];
+static float normals[N * 3];
+static aabb boxes[N], boxes_r[N];
+static vec4 planes[6];
+static vec3_stream stream_a, stream_b, stream_r;
+static vec4_stream stream4_a, stream4_b, stream4_r;
+static triangle_stream tris;
+static ray rays[RAYS];
+static ray_packet packets[RAYS / MATH_RAY_PACKET];
+
+static float out_ref[MAX_OUT], out[MAX_OUT];
+
+static float frand(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+//integer results are compared through their bits like everything else
+static size_t put_bits(float *dst, const void *src, size_t bytes)
+{
+	memcpy(dst, src, bytes);
+	return (bytes + sizeof(float) - 1) / sizeof(float);
+}
+
+static void setup(void)
+{
+	srand(1);
+	float soup[N * 9];
+	for(size_t i = 0; i < N; i++)
+	{
+		vec3 axis = {frand(-1.0f, 1.0f), frand(-1.0f, 1.0f), frand(-1.0f, 1.0f)};
+		math_vec3_normalize(axis);
+		math_quat_from_axis_angle(qt_a[i], axis, frand(-3.0f, 3.0f));
+		math_quat_from_axis_angle(qt_b[i], axis, frand(-3.0f, 3.0f));
+		for(int k = 0; k < 3; k++)
+			vec_a[i][k] = frand(-10.0f, 10.0f);
+
+		math_mat4x3_compose(aff_a[i], vec_a[i], qt_a[i], (vec3){frand(0.5f, 2.0f), frand(0.5f, 2.0f), frand(0.5f, 2.0f)});
+		math_mat4x3_to_mat4(mat_a[i], aff_a[i]);
+		math_mat4x3_compose(aff_b[i], vec_a[i], qt_b[i], (vec3){1.5f, 0.75f, 1.25f});
+		//general matrices, diagonally dominant so they are well conditioned
+		for(int c = 0; c < 4; c++)
+			for(int r = 0; r < 4; r++)
+				mat_b[i][c][r] = frand(-10.0f, 10.0f) + (c == r ? 40.0f : 0.0f);
+
+		xs[i] = vec_a[i][0];
+		ys[i] = vec_a[i][1];
+		zs[i] = vec_a[i][2];
+		ts[i] = frand(0.0f, 1.0f);
+		angles[i] = frand(-100.0f, 100.0f);
+		for(int k = 0; k < 8; k++)
+			points[i * 8 + k] = frand(-10.0f, 10.0f);
+		vec3 normal = {frand(-1.0f, 1.0f), frand(-1.0f, 1.0f), frand(-1.0f, 1.0f)};
+		math_vec3_normalize(normal);
+		memcpy(&normals[i * 3], normal, sizeof(vec3));
+		memcpy(&points[i * 8 + 3], normal, sizeof(vec3)); //main.c's vertex layout
+		for(int k = 0; k < 3; k++)
+		{
+			boxes[i].min[k] = vec_a[i][k] - ts[i];
+			boxes[i].max[k] = vec_a[i][k] + 1.0f;
+		}
+		for(int k = 0; k < 9; k++)
+			soup[i * 9 + k] = k < 3 ? vec_a[i][k] : soup[i * 9 + k - 3] + frand(-2.0f, 2.0f);
+	}
+	//exact zeros and signed zeros, which the kernels must not treat differently
+	memset(points, 0, 8 * sizeof(float));
+	points[9] = -0.0f;
+	mat_a[1][3][0] = -0.0f;
+
+	math_vec3_stream_alloc(&stream_a, N);
+	math_vec3_stream_alloc(&stream_b, N);
+	math_vec3_stream_alloc(&stream_r, N);
+	math_vec3_stream_from_aos(&stream_a, points, 8, N);
+	math_vec3_stream_from_aos(&stream_b, points + 3, 8, N);
+	math_vec4_stream_alloc(&stream4_a, N);
+	math_vec4_stream_alloc(&stream4_b, N);
+	math_vec4_stream_alloc(&stream4_r, N);
+	math_vec4_stream_from_aos(&stream4_a, points, 8, N);
+	math_vec4_stream_from_aos(&stream4_b, points + 4, 8, N);
+	math_triangle_stream_alloc(&tris, N);
+	math_triangle_stream_from_aos(&tris, soup, 3, N);
+
+	mat4 view, projection, view_projection;
+	math_lookat(view, (vec3){0.0f, 1.0f, -15.0f}, (vec3){0.0f, 0.0f, 0.0f}, (vec3){0.0f, 1.0f, 0.0f});
+	math_perspective(projection, deg_to_rad(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	math_mat4_mul(view_projection, view, projection);
+	math_frustum_planes(planes, view_projection);
+
+	//groups of 8 rays from one origin, aimed at triangles
+	for(size_t i = 0; i < RAYS; i++)
+	{
+		vec3 origin = {0.0f, 0.0f, -30.0f};
+		origin[0] += (float)(i / MATH_RAY_PACKET);
+		math_vec3_copy(rays[i].origin, origin);
+		math_vec3_sub(rays[i].direction, vec_a[i * 7], origin);
+		math_vec3_normalize(rays[i].direction);
+		rays[i].t_min = 0.0f;
+		rays[i].t_max = 1000.0f;
+	}
+	for(size_t i = 0; i < RAYS / MATH_RAY_PACKET; i++)
+		math_ray_packet_from_rays(&packets[i], &rays[i * MATH_RAY_PACKET], MATH_RAY_PACKET);
+}
+
+static size_t t_mat4_mul(float *dst)
+{
+	for(size_t i = 0; i < N; i++)
+		math_mat4_mul(mat_r[i], mat_a[i], mat_b[i]);
+	return put_bits(dst, mat_r, sizeof(mat_r));
+}
+
+static size_t t_mat4_add_sub_scale(float *dst)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < N; i++)
+		math_mat4_add(mat_r[i], mat_a[i], mat_b[i]);
+	n += put_bits(dst + n, mat_r, sizeof(mat_r));
+	for(size_t i = 0; i < N; i++)
+		math_mat4_sub(mat_r[i], mat_a[i], mat_b[i]);
+	n += put_bits(dst + n, mat_r, sizeof(mat_r));
+	for(size_t i = 0; i < N; i++)
+		math_mat4_scale(mat_r[i], mat_b[i], ts[i]);
+	n += put_bits(dst + n, mat_r, sizeof(mat_r));
+	return n;
+}
+
+static size_t t_mat4_inverse(float *dst)
+{
+	math_mat4_inverse_batch(mat_r, mat_b, N);
+	return put_bits(dst, mat_r, sizeof(mat_r));
+}
+
+static size_t t_mat4_inverse_affine(float *dst)
+{
+	size_t n = 0;
+	math_mat4_inverse_affine_batch(mat_r, mat_a, N);
+	n += put_bits(dst + n, mat_r, sizeof(mat_r));
+	math_mat4_normal_matrix_batch(mat_r, mat_a, N);
+	n += put_bits(dst + n, mat_r, sizeof(mat_r));
+	return n;
+}
+
+static size_t t_mat4x3_mul(float *dst)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < N; i++)
+		math_mat4x3_mul(aff_r[i], aff_a[i], aff_b[i]);
+	n += put_bits(dst + n, aff_r, sizeof(aff_r));
+	math_mat4x3_mul_batch(aff_r, aff_b, aff_a, N);
+	n += put_bits(dst + n, aff_r, sizeof(aff_r));
+	//in place
+	math_mat4x3_mul_batch(aff_r, aff_r, aff_a, N);
+	n += put_bits(dst + n, aff_r, sizeof(aff_r));
+	return n;
+}
+
+static size_t t_mat4x3_inverse(float *dst)
+{
+	size_t n = 0;
+	math_mat4x3_inverse_batch(aff_r, aff_a, N);
+	n += put_bits(dst + n, aff_r, sizeof(aff_r));
+	for(size_t i = 0; i < N; i++)
+		math_mat4x3_inverse(aff_r[i], aff_r[i]);
+	n += put_bits(dst + n, aff_r, sizeof(aff_r));
+	return n;
+}
+
+static size_t t_transform_aos(float *dst)
+{
+	math_mat4_transform_points(dst, 8, mat_a[2], points, 8, N);
+	math_mat4_transform_dirs(dst + 3, 8, mat_a[2], points + 3, 8, N);
+	//in place, same stride
+	float *in_place = dst + N * 8;
+	memcpy(in_place, points, sizeof(points));
+	math_mat4_transform_points(in_place, 8, mat_a[2], in_place, 8, N);
+	math_mat4_transform_dirs(in_place + 3, 8, mat_a[2], in_place + 3, 8, N);
+	return N * 16;
+}
+
+static size_t t_transform_soa(float *dst)
+{
+	math_mat4_transform_points_soa(dst, dst + N, dst + 2 * N, mat_a[3], xs, ys, zs, N);
+	math_mat4_transform_dirs_soa(dst + 3 * N, dst + 4 * N, dst + 5 * N, mat_a[3], xs, ys, zs, N);
+	return N * 6;
+}
+
+static size_t t_normalize_approx_batch(float *dst)
+{
+	math_vec3_normalize_approx_batch(dst, 3, points, 8, N);
+	return N * 3;
+}
+
+static size_t t_cull(float *dst)
+{
+	uint32_t visible[(N + 31) / 32];
+	size_t n = 0;
+	math_frustum_cull_aabbs(visible, planes, xs, ys, zs, ts, ts, ts, N);
+	n += put_bits(dst + n, visible, sizeof(visible));
+	math_frustum_cull_spheres(visible, planes, xs, ys, zs, ts, N);
+	n += put_bits(dst + n, visible, sizeof(visible));
+	return n;
+}
+
+static size_t t_quat(float *dst)
+{
+	size_t n = 0;
+	math_quat_mul_batch(qt_r, qt_a, qt_b, N);
+	n += put_bits(dst + n, qt_r, sizeof(qt_r));
+	math_quat_rotate_vec3_batch(vec_r, qt_a, vec_a, N);
+	n += put_bits(dst + n, vec_r, sizeof(vec_r));
+	math_quat_to_mat4_batch(mat_r, qt_a, N);
+	n += put_bits(dst + n, mat_r, sizeof(mat4) * (N / 2));
+	return n;
+}
+
+static size_t t_quat_nlerp(float *dst)
+{
+	math_quat_nlerp_batch(qt_r, qt_a, qt_b, ts, N);
+	return put_bits(dst, qt_r, sizeof(qt_r));
+}
+
+static size_t t_quat_slerp(float *dst)
+{
+	math_quat_slerp_batch(qt_r, qt_a, qt_b, ts, N);
+	return put_bits(dst, qt_r, sizeof(qt_r));
+}
+
+static size_t t_sincos(float *dst)
+{
+	size_t n = 0;
+	math_sincos_batch(dst, dst + N, angles, N);
+	n += 2 * N;
+	math_quat_from_axis_angle_batch(qt_r, vec_a, angles, N);
+	n += put_bits(dst + n, qt_r, sizeof(qt_r));
+	return n;
+}
+
+static size_t t_pack(float *dst)
+{
+	static uint16_t halves[N * 8];
+	static int16_t octs[N * 2];
+	static vertex_packed packed[N];
+	size_t n = 0;
+	math_float_to_half_batch(halves, points, N * 8);
+	n += put_bits(dst + n, halves, sizeof(halves));
+	math_octahedral_encode_batch(octs, normals, 3, N);
+	n += put_bits(dst + n, octs, sizeof(octs));
+	math_pack_vertices(packed, points, points + 3, points + 6, 8, 5.0f, N); //some texcoords clamp
+	n += put_bits(dst + n, packed, sizeof(packed));
+	return n;
+}
+
+static size_t t_stream(float *dst)
+{
+	size_t n = 0;
+	math_vec3_stream_add(&stream_r, &stream_a, &stream_b);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec3_stream_sub(&stream_r, &stream_a, &stream_b);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec3_stream_scale(&stream_r, &stream_a, 0.3f);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec3_stream_cross(&stream_r, &stream_a, &stream_b);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec3_stream_dot(dst + n, &stream_a, &stream_b);
+	n += N;
+	math_vec3_stream_len(dst + n, &stream_a);
+	n += N;
+	return n;
+}
+
+static size_t t_stream_normalize(float *dst)
+{
+	size_t n = 0;
+	math_vec3_stream_normalize(&stream_r, &stream_a);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec3_stream_normalize_approx(&stream_r, &stream_a);
+	math_vec3_stream_to_aos(dst + n, 3, &stream_r);
+	n += N * 3;
+	math_vec4_stream_normalize(&stream4_r, &stream4_a);
+	math_vec4_stream_to_aos(dst + n, 4, &stream4_r);
+	n += N * 4;
+	return n;
+}
+
+static size_t t_stream4(float *dst)
+{
+	size_t n = 0;
+	math_vec4_stream_add(&stream4_r, &stream4_a, &stream4_b);
+	math_vec4_stream_to_aos(dst + n, 4, &stream4_r);
+	n += N * 4;
+	math_vec4_stream_sub(&stream4_r, &stream4_a, &stream4_b);
+	math_vec4_stream_to_aos(dst + n, 4, &stream4_r);
+	n += N * 4;
+	math_vec4_stream_scale(&stream4_r, &stream4_a, -2.5f);
+	math_vec4_stream_to_aos(dst + n, 4, &stream4_r);
+	n += N * 4;
+	math_vec4_stream_dot(dst + n, &stream4_a, &stream4_b);
+	n += N;
+	math_vec4_stream_len(dst + n, &stream4_a);
+	n += N;
+	math_vec4_stream_normalize_approx(&stream4_r, &stream4_a);
+	math_vec4_stream_to_aos(dst + n, 4, &stream4_r);
+	n += N * 4;
+	return n;
+}
+
+static size_t t_ray(float *dst)
+{
+	ray_hit hits[RAYS];
+	ray_packet_hit packet_hits[RAYS / MATH_RAY_PACKET];
+	uint32_t masks[RAYS / MATH_RAY_PACKET];
+	float t_near[RAYS];
+	size_t n = 0;
+
+	memset(hits, 0, sizeof(hits));
+	math_ray_nearest_triangle_batch(hits, rays, RAYS, &tris);
+	n += put_bits(dst + n, hits, sizeof(hits));
+	for(size_t i = 0; i < RAYS / MATH_RAY_PACKET; i++)
+	{
+		math_ray_packet_nearest_triangle(&packet_hits[i], &packets[i], &tris);
+		masks[i] = math_ray_packet_aabb(&t_near[i * MATH_RAY_PACKET], &packets[i], boxes[i].min, boxes[i].max);
+	}
+	n += put_bits(dst + n, packet_hits, sizeof(packet_hits));
+	n += put_bits(dst + n, masks, sizeof(masks));
+	//t_near is only written for lanes that hit
+	for(size_t i = 0; i < RAYS; i++)
+		if(!(masks[i / MATH_RAY_PACKET] & 1u << (i % MATH_RAY_PACKET)))
+			t_near[i] = 0.0f;
+	n += put_bits(dst + n, t_near, sizeof(t_near));
+	return n;
+}
+
+static size_t t_aabb_transform(float *dst)
+{
+	math_aabb_transform_batch(boxes_r, boxes, aff_a, N);
+	return put_bits(dst, boxes_r, sizeof(boxes_r));
+}
+
+static size_t t_morton3(float *dst)
+{
+	uint32_t codes[N];
+	math_morton3_batch(codes, xs, ys, zs, (vec3){-10.0f, -10.0f, -10.0f}, (vec3){10.0f, 10.0f, 10.0f}, N);
+	return put_bits(dst, codes, sizeof(codes));
+}
+
+static const test tests[] =
+{
+	{"mat4_mul", t_mat4_mul, 0.0f, 1},
+	{"mat4_add/sub/scale", t_mat4_add_sub_scale, 0.0f, 0},
+	{"mat4_inverse", t_mat4_inverse, TOLERANCE_INVERSE, 0},
+	{"mat4_inverse_affine", t_mat4_inverse_affine, 0.0f, 0},
+	{"mat4x3_mul", t_mat4x3_mul, 0.0f, 1},
+	{"mat4x3_inverse", t_mat4x3_inverse, 0.0f, 0},
+	{"transform_aos", t_transform_aos, 0.0f, 1},
+	{"transform_soa", t_transform_soa, 0.0f, 1},
+	{"normalize_approx_batch", t_normalize_approx_batch, 0.0f, 0},
+	{"frustum_cull", t_cull, 0.0f, 0},
+	{"quat_mul/rotate/to_mat4", t_quat, 0.0f, 0},
+	{"quat_nlerp", t_quat_nlerp, 0.0f, 1},
+	{"quat_slerp", t_quat_slerp, TOLERANCE_SLERP, 1},
+	{"sincos", t_sincos, 0.0f, 0},
+	{"pack", t_pack, 0.0f, 0},
+	{"vec3_stream", t_stream, 0.0f, 0},
+	{"stream_normalize", t_stream_normalize, 0.0f, 0},
+	{"vec4_stream", t_stream4, 0.0f, 0},
+	{"ray", t_ray, 0.0f, 0},
+	{"aabb_transform", t_aabb_transform, 0.0f, 0},
+	{"morton3", t_morton3, 0.0f, 0},
+};
+
+#define TEST_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+//math_mat4_mul(m, m, x) and math_mat4_mul(m, x, m) must give math_mat4_mul(r, m, x)
+static int check_aliasing(void)
+{
+	int failed = 0;
+	for(size_t i = 0; i < 64; i++)
+	{
+		mat4 expected, m;
+		math_mat4_mul(expected, mat_a[i], mat_b[i]);
+		math_mat4_copy(m, mat_a[i]);
+		math_mat4_mul(m, m, mat_b[i]);
+		failed |= memcmp(m, expected, sizeof(mat4)) != 0;
+		math_mat4_copy(m, mat_b[i]);
+		math_mat4_mul(m, mat_a[i], m);
+		failed |= memcmp(m, expected, sizeof(mat4)) != 0;
+		math_mat4_copy(m, mat_a[i]);
+		math_mat4_mul(expected, m, m);
+		math_mat4_mul(m, m, m);
+		failed |= memcmp(m, expected, sizeof(mat4)) != 0;
+	}
+	if(failed)
+		printf("  mat4_mul with aliased result  FAILED\n");
+	return failed;
+}
+
+//from_aos over the capacity (5 rounded up to 8) is refused and leaves the stream alone
+static int check_stream_capacity(void)
+{
+	vec3_stream small;
+	vec4_stream small4;
+	triangle_stream small_tris;
+	int failed = !math_vec3_stream_alloc(&small, 5) || !math_vec4_stream_alloc(&small4, 5) ||
+		!math_triangle_stream_alloc(&small_tris, 5);
+
+	failed |= !math_vec3_stream_from_aos(&small, points, 8, 8);
+	failed |= math_vec3_stream_from_aos(&small, points, 8, 9) || small.count != 8;
+	failed |= math_vec4_stream_from_aos(&small4, points, 8, 9) || small4.count != 0;
+	failed |= math_triangle_stream_from_aos(&small_tris, points, 3, 9) || small_tris.v0.count != 0;
+	math_vec3_stream_free(&small);
+	math_vec4_stream_free(&small4);
+	math_triangle_stream_free(&small_tris);
+	if(failed)
+		printf("stream from_aos over capacity  FAILED\n");
+	return failed;
+}
+
+/*
+ * The approximations against libm in double over their documented
+ * range. They are scalar code, so this runs once, not per level.
+*/
+static int check_accuracy(void)
+{
+	double max_sincos = 0.0;
+	double max_rsqrt = 0.0;
+	int steps = 1 << 22;
+
+	for(int i = 0; i <= steps; i++)
+	{
+		float angle = -8192.0f + 16384.0f * (float)i / (float)steps;
+		float s, c;
+		math_sincos(angle, &s, &c);
+		double err_s = fabs(s - sin((double)angle));
+		double err_c = fabs(c - cos((double)angle));
+		if(err_s > max_sincos)
+			max_sincos = err_s;
+		if(err_c > max_sincos)
+			max_sincos = err_c;
+
+		float x = 1e-3f + 1e3f * (float)i / (float)steps;
+		double exact = 1.0 / sqrt((double)x);
+		double err_r = fabs(math_rsqrt(x) - exact) / exact;
+		if(err_r > max_rsqrt)
+			max_rsqrt = err_r;
+	}
+
+	//bounds documented in 3d_math.h, rsqrt is looser without SSE
+	int failed = max_sincos >= 1e-7 || max_rsqrt >= 6e-6;
+	printf("accuracy: sincos max abs error %.3g, rsqrt max rel error %.3g%s\n",
+		max_sincos, max_rsqrt, failed ? "  FAILED" : "");
+	return failed;
+}
+
+//math_mat4_rotate_x/y/z(result, mat, angle) is mat times the rotation, result may be mat
+static int check_rotations(void)
+{
+	int failed = 0;
+	for(size_t i = 0; i < 64; i++)
+	{
+		float s, c;
+		math_sincos(angles[i], &s, &c);
+		for(int axis = 0; axis < 3; axis++)
+		{
+			//the two other axes in cyclic order
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			mat4 rotation, expected, result;
+			math_mat4_identity(rotation);
+			rotation[u][u] = c;
+			rotation[u][v] = s;
+			rotation[v][u] = -s;
+			rotation[v][v] = c;
+			math_mat4_mul(expected, mat_a[i], rotation);
+
+			math_mat4_copy(result, mat_a[i]);
+			if(axis == 0)
+				math_mat4_rotate_x(result, result, angles[i]);
+			else if(axis == 1)
+				math_mat4_rotate_y(result, result, angles[i]);
+			else
+				math_mat4_rotate_z(result, result, angles[i]);
+			failed |= memcmp(result, expected, sizeof(mat4)) != 0;
+		}
+	}
+	if(failed)
+		printf("rotate_x/y/z  FAILED\n");
+	return failed;
+}
+
+//first mismatching float, or -1
+static long compare(const float *ref, const float *got, size_t count, float tolerance, float *worst)
+{
+	long first = -1;
+	*worst = 0.0f;
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t bits_ref, bits_got;
+		memcpy(&bits_ref, &ref[i], sizeof(float));
+		memcpy(&bits_got, &got[i], sizeof(float));
+		if(bits_ref == bits_got)
+			continue;
+		float err = fabsf(got[i] - ref[i]) / fmaxf(1.0f, fabsf(ref[i]));
+		if(tolerance > 0.0f && err <= tolerance)
+		{
+			*worst = fmaxf(*worst, err);
+			continue;
+		}
+		if(first < 0)
+			first = (long)i;
+	}
+	return first;
+}
+
+int main(void)
+{
+	setup();
+	int failures = check_accuracy();
+	failures += check_rotations();
+	failures += check_stream_capacity();
+	int detected = math_simd_detect();
+
+	for(int level = MATH_SIMD_SCALAR; level <= detected; level++)
+	{
+		math_simd_set_level(level);
+		printf("%s:\n", math_simd_level_name(level));
+		failures += check_aliasing();
+		if(level == MATH_SIMD_SCALAR)
+			continue;
+
+		for(size_t i = 0; i < TEST_COUNT; i++)
+		{
+			const test *t = &tests[i];
+			math_simd_set_level(MATH_SIMD_SCALAR);
+			memset(out_ref, 0, sizeof(out_ref));
+			size_t count = t->run(out_ref);
+			math_simd_set_level(level);
+			memset(out, 0, sizeof(out));
+			t->run(out);
+
+			float tolerance = t->tolerance;
+			if(t->fma && level >= MATH_SIMD_AVX2)
+				tolerance = fmaxf(tolerance, TOLERANCE_FMA);
+			float worst;
+			long first = compare(out_ref, out, count, tolerance, &worst);
+			if(first >= 0)
+			{
+				printf("  %-24s FAILED at float %ld: %.9g, scalar %.9g\n", t->name, first, out[first], out_ref[first]);
+				failures++;
+			}
+			else if(worst > 0.0f)
+				printf("  %-24s ok, max rel error %.3g\n", t->name, worst);
+			else
+				printf("  %-24s ok, exact\n", t->name);
+		}
+	}
+
+	if(detected == MATH_SIMD_SCALAR)
+		printf("no SIMD levels to compare (build with -DMATH_SIMD)\n");
+	if(failures > 0)
+		printf("%d failure(s)\n", failures);
+	return failures > 0;
+}
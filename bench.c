@@ -0,0 +1,755 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file bench.c
+ * @brief Microbenchmarks for 3d_math and the camera
+ *
+ * Every 3d_math.h family plus the camera paths. Single calls are timed
+ * over a pool of inputs, batched functions at several batch sizes.
+ * Reports ns/op and cycles/op (TSC ticks, so reference cycles, x86
+ * only), the best of a few runs.
+ *
+ * ./bench [--simd LEVEL] [--filter TEXT] [--json FILE]
+ *         [--baseline FILE] [--threshold PERCENT]
+ *
+ * --json writes the results, --baseline compares against a file written
+ * by --json earlier and exits with 1 when something got slower than the
+ * threshold (default 10%). Baselines only make sense on the same
+ * machine and build flags, one recorded at another SIMD level is
+ * refused (exit 2). Build it with and without MATH_INLINE/MATH_SIMD
+ * (see build.sh) to compare variants. Accuracy is checked by
+ * 3d_math_test, not here.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "3d_math.h"
+#include "3d_math_simd.h"
+#include "bvh.h"
+#include "hierarchy.h"
+#include "camera.h"
+#include "camera_path.h"
+#include "camera_array.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define BENCH_TSC
+#endif
+
+#define POOL 1024 //inputs cycled through by the single call benchmarks
+#define MAX_BATCH 65536
+#define MIN_RUN_NS 10e6
+#define RUNS 5
+#define MAX_RESULTS 256
+
+static const size_t batch_sizes[] = {16, 1024, MAX_BATCH};
+
+typedef struct bench
+{
+	const char *name;
+	void (*run)(size_t n); //does n operations
+	int batched; //0: timed at POOL calls, reported as batch 1
+} bench;
+
+typedef struct result
+{
+	char name[64];
+	size_t batch;
+	double ns;
+	double cycles;
+} result;
+
+static volatile float sink;
+
+static vec3 vec_a[MAX_BATCH], vec_b[MAX_BATCH], vec_r[MAX_BATCH];
+static vec4 v4_a[MAX_BATCH], v4_r[MAX_BATCH];
+static mat4 mat_a[MAX_BATCH], mat_b[MAX_BATCH], mat_r[MAX_BATCH];
+static mat4x3 aff_a[MAX_BATCH], aff_b[MAX_BATCH], aff_r[MAX_BATCH];
+static quat qt_a[MAX_BATCH], qt_b[MAX_BATCH], qt_r[MAX_BATCH];
+static float xs[MAX_BATCH], ys[MAX_BATCH], zs[MAX_BATCH], ts[MAX_BATCH];
+static float rx[MAX_BATCH], ry[MAX_BATCH], rz[MAX_BATCH];
+static float fovs[MAX_BATCH], aspects[MAX_BATCH], nears[MAX_BATCH], fars[MAX_BATCH];
+static float points[MAX_BATCH * 8], points_r[MAX_BATCH * 8];
+static uint32_t visible[MAX_BATCH / 32];
+static uint32_t codes[MAX_BATCH];
+static aabb box_a[MAX_BATCH], box_r[MAX_BATCH];
+static int flags[POOL];
+static uint16_t halves[MAX_BATCH * 4];
+static vertex_packed packed[MAX_BATCH];
+static vec3_stream stream_a, stream_b, stream_r;
+static float *soup;
+static triangle_stream tris;
+static ts_bvh bvh;
+static ts_hierarchy tree;
+static ray rays[POOL];
+static ray_packet packets[POOL];
+static ray_hit hits[POOL];
+static ray_packet_hit packet_hit;
+static vec4 planes[6];
+static ts_camera camera, camera_quaternion, camera_jitter;
+static ts_camera_path camera_path;
+static ts_camera_array camera_wall;
+
+static float frand(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+static void setup(void)
+{
+	srand(1);
+	for(size_t i = 0; i < MAX_BATCH; i++)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			vec_a[i][k] = frand(-10.0f, 10.0f);
+			vec_b[i][k] = frand(-10.0f, 10.0f);
+		}
+		for(int k = 0; k < 4; k++)
+			v4_a[i][k] = frand(-10.0f, 10.0f);
+
+		vec3 axis = {frand(-1.0f, 1.0f), frand(-1.0f, 1.0f), frand(-1.0f, 1.0f)};
+		math_vec3_normalize(axis);
+		math_quat_from_axis_angle(qt_a[i], axis, frand(-3.0f, 3.0f));
+		math_quat_from_axis_angle(qt_b[i], axis, frand(-3.0f, 3.0f));
+
+		math_mat4x3_compose(aff_a[i], vec_a[i], qt_a[i], (vec3){1.0f, 2.0f, 0.5f});
+		for(int k = 0; k < 3; k++)
+		{
+			box_a[i].min[k] = vec_b[i][k] - 1.0f;
+			box_a[i].max[k] = vec_b[i][k] + 1.0f;
+		}
+		math_mat4x3_compose(aff_b[i], vec_b[i], qt_b[i], (vec3){1.0f, 1.0f, 1.0f});
+		math_mat4x3_to_mat4(mat_a[i], aff_a[i]);
+		math_mat4x3_to_mat4(mat_b[i], aff_b[i]);
+
+		xs[i] = vec_a[i][0];
+		ys[i] = vec_a[i][1];
+		zs[i] = vec_a[i][2];
+		ts[i] = frand(0.0f, 1.0f);
+		for(int k = 0; k < 8; k++)
+			points[i * 8 + k] = frand(-10.0f, 10.0f);
+	}
+
+	math_vec3_stream_alloc(&stream_a, MAX_BATCH);
+	math_vec3_stream_alloc(&stream_b, MAX_BATCH);
+	math_vec3_stream_alloc(&stream_r, MAX_BATCH);
+	math_vec3_stream_from_aos(&stream_a, &vec_a[0][0], 3, MAX_BATCH);
+	math_vec3_stream_from_aos(&stream_b, &vec_b[0][0], 3, MAX_BATCH);
+
+	//small triangles scattered in a 20 unit cube, rays from outside aimed at them,
+	//in groups of 8 from one origin so packets are coherent
+	soup = malloc(MAX_BATCH * 9 * sizeof(float));
+	for(size_t i = 0; i < MAX_BATCH * 9; i++)
+		soup[i] = i % 9 < 3 ? vec_a[i / 9][i % 9] : soup[i - 3] + frand(-1.0f, 1.0f);
+	math_triangle_stream_alloc(&tris, MAX_BATCH);
+	math_triangle_stream_from_aos(&tris, soup, 3, MAX_BATCH);
+	bvh_build(&bvh, soup, 3, MAX_BATCH);
+
+	//4 children per node, the last three quarters are leaves
+	uint32_t *parents = malloc(MAX_BATCH * sizeof(uint32_t));
+	parents[0] = HIERARCHY_NONE;
+	for(size_t i = 1; i < MAX_BATCH; i++)
+		parents[i] = (uint32_t)((i - 1) / 4);
+	hierarchy_init(&tree, parents, MAX_BATCH);
+	camera_array_init(&camera_wall, MAX_BATCH);
+	free(parents);
+	for(size_t i = 0; i < POOL; i++)
+	{
+		vec3 target = {frand(-0.5f, 0.5f), frand(-0.5f, 0.5f), frand(-0.5f, 0.5f)};
+		math_vec3_add(target, target, vec_a[i & ~(size_t)7]);
+		math_vec3_scale(rays[i].origin, vec_b[i & ~(size_t)7], 3.0f);
+		math_vec3_sub(rays[i].direction, target, rays[i].origin);
+		math_vec3_normalize(rays[i].direction);
+		rays[i].t_min = 0.0f;
+		rays[i].t_max = 1000.0f;
+	}
+	for(size_t i = 0; i < POOL; i++)
+		math_ray_packet_from_rays(&packets[i], &rays[i & ~(size_t)7], 8);
+
+	mat4 view, projection, view_projection;
+	math_lookat(view, (vec3){0.0f, 1.0f, -15.0f}, (vec3){0.0f, 0.0f, 0.0f}, (vec3){0.0f, 1.0f, 0.0f});
+	math_perspective(projection, deg_to_rad(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	math_mat4_mul(view_projection, view, projection);
+	math_frustum_planes(planes, view_projection);
+
+	camera_initialize(&camera, (vec3){0.0f, 0.0f, -3.0f});
+	camera_initialize(&camera_quaternion, (vec3){0.0f, 0.0f, -3.0f});
+	camera_set_quaternion_mode(&camera_quaternion, 1);
+	camera_initialize(&camera_jitter, (vec3){0.0f, 0.0f, -3.0f});
+	camera_set_jitter(&camera_jitter, CAMERA_JITTER_HALTON, 1920, 1080, 16);
+	camera_path_init(&camera_path);
+	for(size_t i = 0; i < POOL; i++)
+	{
+		camera_set_position(&camera, vec_a[i]);
+		camera_set_angles(&camera, ts[i] * 360.0f, ts[i] * 90.0f - 45.0f, 0.0f);
+		camera_path_record(&camera_path, &camera, i * CAMERA_PATH_STEP);
+	}
+
+	//projection parameters in the ranges a real camera uses, near < far
+	for(size_t i = 0; i < MAX_BATCH; i++)
+	{
+		fovs[i] = ts[i] + 0.5f;
+		aspects[i] = frand(1.0f, 2.0f);
+		nears[i] = frand(0.1f, 1.0f);
+		fars[i] = frand(100.0f, 1000.0f);
+	}
+}
+
+/*
+ * BENCHMARKS BEGIN
+*/
+
+#define SINGLE(fn, body) \
+	static void fn(size_t n) \
+	{ \
+		for(size_t i = 0; i < n; i++) \
+		{ \
+			body; \
+		} \
+	}
+
+SINGLE(b_vec2_normalize, math_vec2_normalize(vec_r[i], vec_a[i]))
+SINGLE(b_vec3_add, math_vec3_add(vec_r[i], vec_a[i], vec_b[i]))
+SINGLE(b_vec3_cross, math_vec3_cross(vec_r[i], vec_a[i], vec_b[i]))
+SINGLE(b_vec3_normalize_to, math_vec3_normalize_to(vec_r[i], vec_a[i]))
+SINGLE(b_vec3_normalize_approx, math_vec3_normalize_approx(vec_r[i], vec_a[i]))
+SINGLE(b_vec4_normalize, math_vec4_copy(v4_r[i], v4_a[i]); math_vec4_normalize(v4_r[i]))
+SINGLE(b_mat4_mul, math_mat4_mul(mat_r[i], mat_a[i], mat_b[i]))
+SINGLE(b_mat4_transpose, math_mat4_transpose(mat_r[i], mat_a[i]))
+SINGLE(b_mat4_rotate_axis, math_mat4_copy(mat_r[i], mat_a[i]); math_mat4_rotate_axis(mat_r[i], vec_a[i], ts[i]))
+SINGLE(b_mat4_inverse, math_mat4_inverse(mat_r[i], mat_a[i]))
+SINGLE(b_mat4_inverse_affine, math_mat4_inverse_affine(mat_r[i], mat_a[i]))
+SINGLE(b_mat4_normal_matrix, math_mat4_normal_matrix(mat_r[i], mat_a[i]))
+SINGLE(b_mat4x3_mul, math_mat4x3_mul(aff_r[i], aff_a[i], aff_b[i]))
+SINGLE(b_mat4x3_inverse, math_mat4x3_inverse(aff_r[i], aff_a[i]))
+SINGLE(b_mat4x3_compose, math_mat4x3_compose(aff_r[i], vec_a[i], qt_a[i], vec_b[i]))
+SINGLE(b_mat4x3_transform_point, math_mat4x3_transform_point(vec_r[i], aff_a[i], vec_b[i]))
+SINGLE(b_quat_mul, math_quat_mul(qt_r[i], qt_a[i], qt_b[i]))
+SINGLE(b_quat_rotate_vec3, math_quat_rotate_vec3(vec_r[i], qt_a[i], vec_a[i]))
+SINGLE(b_quat_to_mat4, math_quat_to_mat4(mat_r[i], qt_a[i]))
+SINGLE(b_quat_slerp, math_quat_slerp(qt_r[i], qt_a[i], qt_b[i], ts[i]))
+SINGLE(b_lookat, math_lookat(mat_r[i], vec_a[i], vec_b[i], (vec3){0.0f, 1.0f, 0.0f}))
+SINGLE(b_perspective, math_perspective(mat_r[i], ts[i] + 0.5f, 1.5f, 0.1f, 100.0f))
+SINGLE(b_perspective_reverse_infinite, math_perspective_reverse_infinite(mat_r[i], ts[i] + 0.5f, 1.5f, 0.1f))
+SINGLE(b_mat4_mul_perspective, math_mat4_mul_perspective(mat_r[i], mat_a[i], mat_b[i]))
+SINGLE(b_frustum_planes, math_frustum_planes(v4_r + (i & ~(size_t)7), mat_a[i]))
+SINGLE(b_aabb_transform, math_aabb_transform(&box_r[i], &box_a[i], aff_a[i]))
+SINGLE(b_frustum_test_aabb, flags[i] = math_frustum_test_aabb(planes, vec_a[i], (vec3){1.0f, 1.0f, 1.0f}))
+SINGLE(b_rsqrt, rx[i] = math_rsqrt(ts[i] + 1.0f))
+SINGLE(b_sincos, math_sincos(xs[i], &rx[i], &ry[i]))
+SINGLE(b_halton, rx[i] = math_halton((uint32_t)i + 1, 3))
+SINGLE(b_r2, math_r2(&vec_r[i][0], (uint32_t)i))
+SINGLE(b_libm_sincos, rx[i] = sinf(xs[i]); ry[i] = cosf(xs[i]))
+SINGLE(b_ray_triangle, flags[i] = math_ray_triangle(&hits[i], &rays[i], vec_a[i], vec_b[i], vec_a[(i + 1) % POOL]))
+SINGLE(b_ray_aabb, flags[i] = math_ray_aabb(&rx[i], &rays[i], (vec3){-1.0f, -1.0f, -1.0f}, (vec3){1.0f, 1.0f, 1.0f}))
+SINGLE(b_ray_packet_aabb, flags[i] = (int)math_ray_packet_aabb(rx + i * 8, &packets[i], (vec3){-1.0f, -1.0f, -1.0f}, (vec3){1.0f, 1.0f, 1.0f}))
+SINGLE(b_bvh_intersect, flags[i] = bvh_intersect(&bvh, &rays[i], &hits[i]))
+SINGLE(b_bvh_occluded, flags[i] = bvh_occluded(&bvh, &rays[i]))
+SINGLE(b_bvh_intersect_packet, bvh_intersect_packet(&bvh, &packets[i], &packet_hit))
+SINGLE(b_camera_freecam, camera_freecam(&camera, ts[i] - 0.5f, 0.5f - ts[i], 1))
+SINGLE(b_camera_freecam_quaternion, camera_freecam(&camera_quaternion, ts[i] - 0.5f, 0.5f - ts[i], 1))
+SINGLE(b_camera_get_view_matrix, camera_get_view_matrix(&camera, mat_r[i]))
+SINGLE(b_camera_jitter, camera_next_frame(&camera_jitter); camera_update_matrices(&camera_jitter))
+SINGLE(b_camera_path_sample, camera_path_sample(&camera_path, ts[i] * camera_path_duration(&camera_path), &camera))
+SINGLE(b_camera_view_projection, camera_freecam(&camera, ts[i] - 0.5f, 0.5f - ts[i], 1); camera_get_view_projection(&camera, mat_r[i]))
+
+static void b_transform_points(size_t n)
+{
+	math_mat4_transform_points(points_r, 8, mat_a[0], points, 8, n);
+}
+
+static void b_transform_points_soa(size_t n)
+{
+	math_mat4_transform_points_soa(rx, ry, rz, mat_a[0], xs, ys, zs, n);
+}
+
+static void b_normalize_approx_batch(size_t n)
+{
+	math_vec3_normalize_approx_batch(points_r, 8, points, 8, n);
+}
+
+static void b_mat4_inverse_batch(size_t n)
+{
+	math_mat4_inverse_batch(mat_r, mat_a, n);
+}
+
+static void b_mat4_normal_matrix_batch(size_t n)
+{
+	math_mat4_normal_matrix_batch(mat_r, mat_a, n);
+}
+
+static void b_mat4x3_mul_batch(size_t n)
+{
+	math_mat4x3_mul_batch(aff_r, aff_a, aff_b, n);
+}
+
+static void b_mat4x3_to_mat4_batch(size_t n)
+{
+	math_mat4x3_to_mat4_batch(mat_r, aff_a, n);
+}
+
+//views and view-projections, one shared projection, up is the target
+static void b_lookat_batch(size_t n)
+{
+	math_lookat_batch(mat_r, mat_a, vec_a, vec_b, vec_b, mat_b, 0, n);
+}
+
+static void b_perspective_batch(size_t n)
+{
+	math_perspective_batch(mat_r, fovs, aspects, nears, fars, n);
+}
+
+//per face, n / 6 cube maps
+static void b_cubemap_lookat(size_t n)
+{
+	math_cubemap_lookat(mat_r, mat_a, vec_a, 0.1f, 100.0f, n / 6);
+}
+
+static void b_stream_add(size_t n)
+{
+	stream_a.count = stream_b.count = n;
+	math_vec3_stream_add(&stream_r, &stream_a, &stream_b);
+}
+
+static void b_stream_dot(size_t n)
+{
+	stream_a.count = stream_b.count = n;
+	math_vec3_stream_dot(rx, &stream_a, &stream_b);
+}
+
+static void b_stream_cross(size_t n)
+{
+	stream_a.count = stream_b.count = n;
+	math_vec3_stream_cross(&stream_r, &stream_a, &stream_b);
+}
+
+static void b_stream_normalize(size_t n)
+{
+	stream_a.count = n;
+	math_vec3_stream_normalize(&stream_r, &stream_a);
+}
+
+static void b_stream_normalize_approx(size_t n)
+{
+	stream_a.count = n;
+	math_vec3_stream_normalize_approx(&stream_r, &stream_a);
+}
+
+static void b_sincos_batch(size_t n)
+{
+	math_sincos_batch(rx, ry, xs, n);
+}
+
+static void b_morton3_batch(size_t n)
+{
+	vec3 min = {-10.0f, -10.0f, -10.0f};
+	vec3 max = {10.0f, 10.0f, 10.0f};
+	math_morton3_batch(codes, xs, ys, zs, min, max, n);
+}
+
+static void b_quat_from_axis_angle_batch(size_t n)
+{
+	math_quat_from_axis_angle_batch(qt_r, vec_a, xs, n);
+}
+
+static void b_float_to_half_batch(size_t n)
+{
+	math_float_to_half_batch(halves, points, n);
+}
+
+static void b_octahedral_encode_batch(size_t n)
+{
+	math_octahedral_encode_batch((int16_t *)halves, points, 8, n);
+}
+
+static void b_pack_vertices(size_t n)
+{
+	math_pack_vertices(packed, points, points + 3, points + 6, 8, 10.0f, n);
+}
+
+static void b_quat_mul_batch(size_t n)
+{
+	math_quat_mul_batch(qt_r, qt_a, qt_b, n);
+}
+
+static void b_quat_rotate_vec3_batch(size_t n)
+{
+	math_quat_rotate_vec3_batch(vec_r, qt_a, vec_a, n);
+}
+
+static void b_quat_to_mat4_batch(size_t n)
+{
+	math_quat_to_mat4_batch(mat_r, qt_a, n);
+}
+
+static void b_quat_slerp_batch(size_t n)
+{
+	math_quat_slerp_batch(qt_r, qt_a, qt_b, ts, n);
+}
+
+//one ray (eight for the packet) against n triangles
+static void b_ray_nearest_triangle(size_t n)
+{
+	tris.v0.count = n;
+	math_ray_nearest_triangle(&hits[0], &rays[0], &tris);
+}
+
+static void b_ray_packet_nearest_triangle(size_t n)
+{
+	tris.v0.count = n;
+	math_ray_packet_nearest_triangle(&packet_hit, &packets[0], &tris);
+}
+
+//per triangle, first n of the soup
+static void b_bvh_build(size_t n)
+{
+	ts_bvh built;
+	bvh_build(&built, soup, 3, n);
+	bvh_free(&built);
+}
+
+static void b_aabb_transform_batch(size_t n)
+{
+	math_aabb_transform_batch(box_r, box_a, aff_a, n);
+}
+
+//per moved leaf, the rest of the tree stays put
+static void b_hierarchy_update(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+		hierarchy_set_translation(&tree, (uint32_t)(MAX_BATCH - 1 - i), vec_a[i]);
+	hierarchy_update(&tree);
+}
+
+//only the first n cameras, moved like camera_view_projection does
+static void b_camera_array_update(size_t n)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		camera_wall.yaw[i] += ts[i] - 0.5f;
+		camera_wall.pitch[i] = ts[i] * 90.0f - 45.0f;
+	}
+	camera_wall.count = n;
+	camera_array_update(&camera_wall);
+}
+
+static void b_bvh_build_lbvh(size_t n)
+{
+	ts_bvh built;
+	bvh_build_lbvh(&built, soup, 3, n, NULL);
+	bvh_free(&built);
+}
+
+static void b_cull_aabbs(size_t n)
+{
+	math_frustum_cull_aabbs(visible, planes, xs, ys, zs, ts, ts, ts, n);
+}
+
+static void b_cull_spheres(size_t n)
+{
+	math_frustum_cull_spheres(visible, planes, xs, ys, zs, ts, n);
+}
+
+static const bench benches[] =
+{
+	{"vec2_normalize", b_vec2_normalize, 0},
+	{"vec3_add", b_vec3_add, 0},
+	{"vec3_cross", b_vec3_cross, 0},
+	{"vec3_normalize_to", b_vec3_normalize_to, 0},
+	{"vec3_normalize_approx", b_vec3_normalize_approx, 0},
+	{"vec4_normalize", b_vec4_normalize, 0},
+	{"mat4_mul", b_mat4_mul, 0},
+	{"mat4_transpose", b_mat4_transpose, 0},
+	{"mat4_rotate_axis", b_mat4_rotate_axis, 0},
+	{"mat4_inverse", b_mat4_inverse, 0},
+	{"mat4_inverse_affine", b_mat4_inverse_affine, 0},
+	{"mat4_normal_matrix", b_mat4_normal_matrix, 0},
+	{"mat4x3_mul", b_mat4x3_mul, 0},
+	{"mat4x3_inverse", b_mat4x3_inverse, 0},
+	{"mat4x3_compose", b_mat4x3_compose, 0},
+	{"mat4x3_transform_point", b_mat4x3_transform_point, 0},
+	{"quat_mul", b_quat_mul, 0},
+	{"quat_rotate_vec3", b_quat_rotate_vec3, 0},
+	{"quat_to_mat4", b_quat_to_mat4, 0},
+	{"quat_slerp", b_quat_slerp, 0},
+	{"lookat", b_lookat, 0},
+	{"perspective", b_perspective, 0},
+	{"perspective_reverse_infinite", b_perspective_reverse_infinite, 0},
+	{"mat4_mul_perspective", b_mat4_mul_perspective, 0},
+	{"frustum_planes", b_frustum_planes, 0},
+	{"frustum_test_aabb", b_frustum_test_aabb, 0},
+	{"aabb_transform", b_aabb_transform, 0},
+	{"rsqrt", b_rsqrt, 0},
+	{"sincos", b_sincos, 0},
+	{"libm_sinf_cosf", b_libm_sincos, 0},
+	{"halton", b_halton, 0},
+	{"r2", b_r2, 0},
+	{"ray_triangle", b_ray_triangle, 0},
+	{"ray_aabb", b_ray_aabb, 0},
+	{"ray_packet_aabb", b_ray_packet_aabb, 0},
+	{"bvh_intersect", b_bvh_intersect, 0},
+	{"bvh_occluded", b_bvh_occluded, 0},
+	{"bvh_intersect_packet", b_bvh_intersect_packet, 0},
+	{"camera_freecam", b_camera_freecam, 0},
+	{"camera_freecam_quaternion", b_camera_freecam_quaternion, 0},
+	{"camera_get_view_matrix", b_camera_get_view_matrix, 0},
+	{"camera_view_projection", b_camera_view_projection, 0},
+	{"camera_path_sample", b_camera_path_sample, 0},
+	{"camera_jitter", b_camera_jitter, 0},
+	{"mat4_transform_points", b_transform_points, 1},
+	{"mat4_transform_points_soa", b_transform_points_soa, 1},
+	{"vec3_normalize_approx_batch", b_normalize_approx_batch, 1},
+	{"mat4_inverse_batch", b_mat4_inverse_batch, 1},
+	{"mat4_normal_matrix_batch", b_mat4_normal_matrix_batch, 1},
+	{"mat4x3_mul_batch", b_mat4x3_mul_batch, 1},
+	{"mat4x3_to_mat4_batch", b_mat4x3_to_mat4_batch, 1},
+	{"lookat_batch", b_lookat_batch, 1},
+	{"perspective_batch", b_perspective_batch, 1},
+	{"cubemap_lookat", b_cubemap_lookat, 1},
+	{"vec3_stream_add", b_stream_add, 1},
+	{"vec3_stream_dot", b_stream_dot, 1},
+	{"vec3_stream_cross", b_stream_cross, 1},
+	{"vec3_stream_normalize", b_stream_normalize, 1},
+	{"vec3_stream_normalize_approx", b_stream_normalize_approx, 1},
+	{"sincos_batch", b_sincos_batch, 1},
+	{"morton3_batch", b_morton3_batch, 1},
+	{"quat_from_axis_angle_batch", b_quat_from_axis_angle_batch, 1},
+	{"float_to_half_batch", b_float_to_half_batch, 1},
+	{"octahedral_encode_batch", b_octahedral_encode_batch, 1},
+	{"pack_vertices", b_pack_vertices, 1},
+	{"quat_mul_batch", b_quat_mul_batch, 1},
+	{"quat_rotate_vec3_batch", b_quat_rotate_vec3_batch, 1},
+	{"quat_to_mat4_batch", b_quat_to_mat4_batch, 1},
+	{"quat_slerp_batch", b_quat_slerp_batch, 1},
+	{"frustum_cull_aabbs", b_cull_aabbs, 1},
+	{"frustum_cull_spheres", b_cull_spheres, 1},
+	{"ray_nearest_triangle", b_ray_nearest_triangle, 1},
+	{"ray_packet_nearest_triangle", b_ray_packet_nearest_triangle, 1},
+	{"aabb_transform_batch", b_aabb_transform_batch, 1},
+	{"hierarchy_update", b_hierarchy_update, 1},
+	{"camera_array_update", b_camera_array_update, 1},
+	{"bvh_build", b_bvh_build, 1},
+	{"bvh_build_lbvh", b_bvh_build_lbvh, 1},
+};
+
+// BENCHMARKS END
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long ticks(void)
+{
+#ifdef BENCH_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//best of RUNS, each long enough to be above timer noise
+static void measure(const bench *b, size_t n, double *ns, double *cycles)
+{
+	size_t reps = 1;
+	for(;;)
+	{
+		double start = now_ns();
+		for(size_t r = 0; r < reps; r++)
+			b->run(n);
+		if(now_ns() - start >= MIN_RUN_NS / RUNS || reps >= ((size_t)1 << 30))
+			break;
+		reps *= 2;
+	}
+
+	*ns = *cycles = 0.0;
+	for(int run = 0; run < RUNS; run++)
+	{
+		double start = now_ns();
+		unsigned long long start_ticks = ticks();
+		for(size_t r = 0; r < reps; r++)
+			b->run(n);
+		double elapsed = (now_ns() - start) / ((double)reps * n);
+		double elapsed_ticks = (double)(ticks() - start_ticks) / ((double)reps * n);
+		if(run == 0 || elapsed < *ns)
+		{
+			*ns = elapsed;
+			*cycles = elapsed_ticks;
+		}
+	}
+}
+
+static int write_json(const char *path, const result *results, size_t count)
+{
+	FILE *file = fopen(path, "w");
+	if(file == NULL)
+		return 0;
+
+	//one result per line, load_baseline depends on it
+	fprintf(file, "{\n\t\"simd\": \"%s\",\n\t\"results\": [\n", math_simd_level_name(math_simd_get_level()));
+	for(size_t i = 0; i < count; i++)
+	{
+		fprintf(file, "\t\t{\"name\": \"%s\", \"batch\": %zu, \"ns_per_op\": %.4f, \"cycles_per_op\": %.4f}%s\n",
+			results[i].name, results[i].batch, results[i].ns, results[i].cycles, i + 1 < count ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	return fclose(file) == 0;
+}
+
+//simd gets the level the baseline was recorded at, empty if the file doesn't say
+static size_t load_baseline(const char *path, result *results, size_t max, char simd[32])
+{
+	simd[0] = '\0';
+	FILE *file = fopen(path, "r");
+	if(file == NULL)
+		return 0;
+
+	size_t count = 0;
+	char line[256];
+	while(count < max && fgets(line, sizeof(line), file) != NULL)
+	{
+		result *r = &results[count];
+		const char *level = strstr(line, "\"simd\"");
+		const char *entry = strstr(line, "{\"name\"");
+		if(level != NULL)
+			sscanf(level, "\"simd\": \"%31[^\"]\"", simd);
+		else if(entry != NULL && sscanf(entry, "{\"name\": \"%63[^\"]\", \"batch\": %zu, \"ns_per_op\": %lf, \"cycles_per_op\": %lf",
+			r->name, &r->batch, &r->ns, &r->cycles) == 4)
+			count++;
+	}
+	fclose(file);
+	return count;
+}
+
+static const result *find(const result *results, size_t count, const result *key)
+{
+	for(size_t i = 0; i < count; i++)
+		if(results[i].batch == key->batch && strcmp(results[i].name, key->name) == 0)
+			return &results[i];
+	return NULL;
+}
+
+static int usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [--simd scalar|sse2|avx|avx2+fma] [--filter TEXT] [--json FILE] [--baseline FILE] [--threshold PERCENT]\n", program);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	const char *json_path = NULL;
+	const char *baseline_path = NULL;
+	double threshold = 10.0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 >= argc)
+			return usage(argv[0]);
+		if(strcmp(argv[i], "--filter") == 0)
+			filter = argv[++i];
+		else if(strcmp(argv[i], "--json") == 0)
+			json_path = argv[++i];
+		else if(strcmp(argv[i], "--baseline") == 0)
+			baseline_path = argv[++i];
+		else if(strcmp(argv[i], "--threshold") == 0)
+			threshold = atof(argv[++i]);
+		else if(strcmp(argv[i], "--simd") == 0)
+		{
+			const char *name = argv[++i];
+			int level = MATH_SIMD_SCALAR;
+			while(level <= MATH_SIMD_AVX2 && strcmp(math_simd_level_name(level), name) != 0)
+				level++;
+			if(level > MATH_SIMD_AVX2)
+				return usage(argv[0]);
+			math_simd_set_level(level);
+		}
+		else
+			return usage(argv[0]);
+	}
+
+	static result baseline[MAX_RESULTS];
+	size_t baseline_count = 0;
+	if(baseline_path != NULL)
+	{
+		char simd[32];
+		baseline_count = load_baseline(baseline_path, baseline, MAX_RESULTS, simd);
+		if(baseline_count == 0)
+		{
+			fprintf(stderr, "no results in baseline %s\n", baseline_path);
+			return 2;
+		}
+		//kernels from different levels aren't comparable
+		const char *level = math_simd_level_name(math_simd_get_level());
+		if(strcmp(simd, level) != 0)
+		{
+			fprintf(stderr, "baseline %s was recorded at simd level \"%s\", this run is \"%s\"\n", baseline_path, simd, level);
+			return 2;
+		}
+	}
+
+	setup();
+
+	printf("simd: %s\n", math_simd_level_name(math_simd_get_level()));
+	printf("%-30s %6s %10s %10s %10s\n", "benchmark", "batch", "ns/op", "cycles/op", "vs base");
+
+	static result results[MAX_RESULTS];
+	size_t count = 0;
+	int regressions = 0;
+
+	for(size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+	{
+		const bench *b = &benches[i];
+		if(filter != NULL && strstr(b->name, filter) == NULL)
+			continue;
+
+		size_t sizes = b->batched ? sizeof(batch_sizes) / sizeof(batch_sizes[0]) : 1;
+		for(size_t s = 0; s < sizes && count < MAX_RESULTS; s++)
+		{
+			result *r = &results[count++];
+			size_t n = b->batched ? batch_sizes[s] : POOL;
+			snprintf(r->name, sizeof(r->name), "%s", b->name);
+			r->batch = b->batched ? n : 1;
+			measure(b, n, &r->ns, &r->cycles);
+
+			printf("%-30s %6zu %10.2f %10.2f", r->name, r->batch, r->ns, r->cycles);
+			const result *base = find(baseline, baseline_count, r);
+			if(base != NULL)
+			{
+				double change = (r->ns / base->ns - 1.0) * 100.0;
+				int regressed = change > threshold;
+				regressions += regressed;
+				printf(" %+9.1f%%%s", change, regressed ? "  REGRESSION" : "");
+			}
+			printf("\n");
+		}
+	}
+
+	sink = vec_r[0][0] + mat_r[0][0][0] + aff_r[0][0][0] + qt_r[0][0] + rx[0] + points_r[0] + ts[0] + (float)visible[0] + (float)flags[0] + (float)halves[0] + (float)packed[0].normal[0] + camera.front[0] + camera_quaternion.front[0];
+
+	if(json_path != NULL && !write_json(json_path, results, count))
+	{
+		fprintf(stderr, "could not write %s\n", json_path);
+		return 2;
+	}
+
+	if(regressions > 0)
+		printf("%d regression(s) above %.1f%%\n", regressions, threshold);
+	return regressions > 0;
+}
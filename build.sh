@@ -1 +1,18 @@
-gcc gl.c 3d_math.c camera.c main.c -o TinyBlinnPhongGL -lSDL2 -lGL -lm
+# Add -DMATH_SIMD to CFLAGS for the SSE2/AVX/AVX2 math kernels (picked at startup)
+# and -fopenmp to split big math batches across threads.
+# -DMATH_APPROX_NORMALIZE makes the camera/look-at paths use the rsqrt normalize
+gcc $CFLAGS gl.c 3d_math.c 3d_math_simd.c camera.c camera_path.c main.c -o TinyBlinnPhongGL -lSDL2 -lGL -lm
+
+# Math benchmark, out-of-line and header-only (MATH_INLINE) builds.
+# ./bench --json base.json records a baseline, ./bench --baseline base.json
+# compares against it and exits with 1 on regressions (--threshold, default 10%)
+gcc -O2 $CFLAGS bench.c 3d_math.c 3d_math_simd.c bvh.c hierarchy.c camera.c camera_path.c camera_array.c -o bench -lm
+gcc -O2 -DMATH_INLINE $CFLAGS bench.c 3d_math_simd.c bvh.c hierarchy.c camera.c camera_path.c camera_array.c -o bench_inline -lm
+
+# Math tests: sincos/rsqrt against libm and the SIMD kernels against the scalar code
+# at every level the CPU has. Exits with 1 on a mismatch
+gcc -O2 $CFLAGS 3d_math_test.c 3d_math.c 3d_math_simd.c -o 3d_math_test -lm
+
+# Scene tests: bvh (SAH, LBVH, refit) and hierarchy against brute force, camera_array
+# against ts_camera, camera_path save/load. Exits with 1 on a mismatch
+gcc -O2 $CFLAGS scene_test.c 3d_math.c 3d_math_simd.c bvh.c hierarchy.c camera.c camera_path.c camera_array.c -o scene_test -lm
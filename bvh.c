@@ -0,0 +1,988 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file bvh.c
+ * @brief bvh.h implementation
+ *
+ * The build runs in two phases. Nodes bigger than BVH_PARALLEL_NODE are
+ * split one at a time, with every thread binning a chunk of the node.
+ * Below that, whole subtrees go to threads, each built serially. Either
+ * way the tree is the same, only node slots may come out in a different
+ * order between runs.
+ *
+ * The LBVH build sorts triangles by the Morton code of their centroid and
+ * reads the tree off the sorted codes (Karras 2012, "Maximizing
+ * Parallelism in the Construction of BVHs, Octrees, and k-d Trees"):
+ * every inner node is found on its own, then boxes are merged bottom-up
+ * with the second child to finish walking on to the parent. Internal
+ * node k keeps its children in slots 2 + 2k, so a child can sit in a
+ * lower slot than its parent.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bvh.h"
+
+#define BVH_BINS 16
+#define BVH_LEAF_MIN 4 //one kernel pass tests this many as fast as one
+#define BVH_LEAF_MAX 8 //one pass of the 8-wide triangle kernel
+#define BVH_TRAVERSAL_COST 1.0f //one node step, in triangle tests
+#define BVH_MAX_DEPTH 48 //deeper nodes are halved, so depth stays under BVH_STACK
+#define BVH_STACK 96
+#define BVH_PARALLEL_NODE 16384
+#define BVH_CHUNK 4096
+#define BVH_SORT_BLOCK 65536 //keys per radix sort histogram
+#define BVH_LEAF_FLAG 0x80000000u //LBVH child is a sorted triangle, not an inner node
+#define BVH_NONE UINT32_MAX
+
+#ifdef _OPENMP
+	#define BVH_PRAGMA(x) _Pragma(#x)
+#else
+	#define BVH_PRAGMA(x)
+#endif
+
+typedef struct bvh_bounds
+{
+	float min[3];
+	float max[3];
+} bvh_bounds;
+
+//triangle bounds, centroid bounds and count of a bin (or a whole range)
+typedef struct bvh_bin
+{
+	bvh_bounds bounds;
+	bvh_bounds centroids;
+	uint32_t count;
+} bvh_bin;
+
+typedef struct bvh_task
+{
+	uint32_t node;
+	uint32_t first;
+	uint32_t depth;
+	bvh_bin info;
+} bvh_task;
+
+typedef struct bvh_builder
+{
+	ts_bvh *bvh;
+	bvh_bounds *prims;
+	float (*centroids)[3]; //min + max, twice the center
+} bvh_builder;
+
+//Karras inner node: sorted range first..last, split between child[0] and child[1]
+typedef struct lbvh_node
+{
+	uint32_t child[2];
+	uint32_t first;
+	uint32_t last;
+	uint32_t parent;
+} lbvh_node;
+
+static void bounds_empty(bvh_bounds *bounds)
+{
+	for(int k = 0; k < 3; k++)
+	{
+		bounds->min[k] = FLT_MAX;
+		bounds->max[k] = -FLT_MAX;
+	}
+}
+
+static void bounds_grow(bvh_bounds *bounds, const float *min, const float *max)
+{
+	for(int k = 0; k < 3; k++)
+	{
+		bounds->min[k] = min[k] < bounds->min[k] ? min[k] : bounds->min[k];
+		bounds->max[k] = max[k] > bounds->max[k] ? max[k] : bounds->max[k];
+	}
+}
+
+//half the surface area, all SAH needs
+static float bounds_area(const bvh_bounds *bounds)
+{
+	float x = bounds->max[0] - bounds->min[0];
+	float y = bounds->max[1] - bounds->min[1];
+	float z = bounds->max[2] - bounds->min[2];
+	return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+}
+
+static void triangle_bounds(bvh_bounds *bounds, const triangle_stream *tris, size_t i)
+{
+	size_t capacity = tris->v0.capacity;
+	for(int k = 0; k < 3; k++)
+	{
+		float v0 = tris->v0.x[k * capacity + i];
+		float v1 = v0 + tris->e1.x[k * capacity + i];
+		float v2 = v0 + tris->e2.x[k * capacity + i];
+		bounds->min[k] = v0 < v1 ? (v0 < v2 ? v0 : v2) : (v1 < v2 ? v1 : v2);
+		bounds->max[k] = v0 > v1 ? (v0 > v2 ? v0 : v2) : (v1 > v2 ? v1 : v2);
+	}
+}
+
+static void bin_empty(bvh_bin *bin)
+{
+	bounds_empty(&bin->bounds);
+	bounds_empty(&bin->centroids);
+	bin->count = 0;
+}
+
+//centroid may be NULL, SAH bins only need bounds and counts
+static void bin_add(bvh_bin *bin, const bvh_bounds *bounds, const float *centroid)
+{
+	bounds_grow(&bin->bounds, bounds->min, bounds->max);
+	if(centroid != NULL)
+		bounds_grow(&bin->centroids, centroid, centroid);
+	bin->count++;
+}
+
+static void bin_merge(bvh_bin *bin, const bvh_bin *other)
+{
+	bounds_grow(&bin->bounds, other->bounds.min, other->bounds.max);
+	bounds_grow(&bin->centroids, other->centroids.min, other->centroids.max);
+	bin->count += other->count;
+}
+
+//0 for axes where the centroids are flat, those can't be split
+static float bin_scale(const bvh_bin *info, int axis)
+{
+	float extent = info->centroids.max[axis] - info->centroids.min[axis];
+	return extent > 0.0f ? BVH_BINS / extent : 0.0f;
+}
+
+//the partition uses this too, so its counts agree with the bins
+static int bin_index(const bvh_bin *info, int axis, float scale, const float *centroid)
+{
+	float f = (centroid[axis] - info->centroids.min[axis]) * scale;
+	int index = f > 0.0f ? (int)f : 0;
+	return index < BVH_BINS ? index : BVH_BINS - 1;
+}
+
+/*
+ * With info NULL, sums positions first..first + count into bins[0].
+ * Otherwise bins them on all three axes by centroid, bins[axis *
+ * BVH_BINS + bin], without centroid bounds (the partition gets those).
+ * Flat axes stay empty.
+*/
+static void bin_range(const bvh_builder *b, const bvh_bin *info, size_t first, size_t count, bvh_bin *bins)
+{
+	int slots = info != NULL ? 3 * BVH_BINS : 1;
+	for(int s = 0; s < slots; s++)
+		bin_empty(&bins[s]);
+
+	if(info == NULL)
+	{
+		for(size_t i = first; i < first + count; i++)
+			bin_add(&bins[0], &b->prims[i], b->centroids[i]);
+		return;
+	}
+
+	float scale[3] = {bin_scale(info, 0), bin_scale(info, 1), bin_scale(info, 2)};
+	for(size_t i = first; i < first + count; i++)
+		for(int axis = 0; axis < 3; axis++)
+			if(scale[axis] > 0.0f)
+				bin_add(&bins[axis * BVH_BINS + bin_index(info, axis, scale[axis], b->centroids[i])], &b->prims[i], NULL);
+}
+
+//bin_range with big ranges cut in chunks for the threads, merged in order
+static void bin_parallel(const bvh_builder *b, const bvh_bin *info, size_t first, size_t count, bvh_bin *bins)
+{
+	int slots = info != NULL ? 3 * BVH_BINS : 1;
+	long chunks = (long)((count + BVH_CHUNK - 1) / BVH_CHUNK);
+	bvh_bin *partial = NULL;
+	if(count > BVH_PARALLEL_NODE)
+		partial = malloc(chunks * slots * sizeof(bvh_bin));
+	if(partial == NULL)
+	{
+		bin_range(b, info, first, count, bins);
+		return;
+	}
+
+	BVH_PRAGMA(omp parallel for schedule(static))
+	for(long c = 0; c < chunks; c++)
+	{
+		size_t offset = (size_t)c * BVH_CHUNK;
+		size_t n = count - offset < BVH_CHUNK ? count - offset : BVH_CHUNK;
+		bin_range(b, info, first + offset, n, partial + c * slots);
+	}
+
+	for(int s = 0; s < slots; s++)
+	{
+		bins[s] = partial[s];
+		for(long c = 1; c < chunks; c++)
+			bin_merge(&bins[s], &partial[c * slots + s]);
+	}
+	free(partial);
+}
+
+//the builder's arrays are kept in leaf order with the indices, so binning reads them in a row
+static void swap_prims(bvh_builder *b, size_t i, size_t j)
+{
+	uint32_t index = b->bvh->indices[i];
+	bvh_bounds bounds = b->prims[i];
+	float centroid[3];
+	memcpy(centroid, b->centroids[i], sizeof(centroid));
+
+	b->bvh->indices[i] = b->bvh->indices[j];
+	b->prims[i] = b->prims[j];
+	memcpy(b->centroids[i], b->centroids[j], sizeof(centroid));
+
+	b->bvh->indices[j] = index;
+	b->prims[j] = bounds;
+	memcpy(b->centroids[j], centroid, sizeof(centroid));
+}
+
+/*
+ * Write the task's node as a leaf, or split it with the cheapest binned
+ * SAH plane and fill children. Returns whether it split.
+*/
+static int bvh_split(bvh_builder *b, const bvh_task *task, bvh_task children[2])
+{
+	ts_bvh *bvh = b->bvh;
+	bvh_node *node = &bvh->nodes[task->node];
+	uint32_t count = task->info.count;
+
+	memcpy(node->min, task->info.bounds.min, sizeof(node->min));
+	memcpy(node->max, task->info.bounds.max, sizeof(node->max));
+	node->first = task->first;
+	node->count = count;
+	if(count <= BVH_LEAF_MIN)
+		return 0;
+
+	bvh_bin bins[3 * BVH_BINS];
+	int axis = -1;
+	int split = 0;
+	float best = FLT_MAX;
+	if(task->depth < BVH_MAX_DEPTH)
+	{
+		bin_parallel(b, &task->info, task->first, count, bins);
+		for(int a = 0; a < 3; a++)
+		{
+			const bvh_bin *axis_bins = bins + a * BVH_BINS;
+			float right[BVH_BINS];
+			bvh_bin sum;
+
+			//area * count of everything right of each plane, then sweep from the left
+			bin_empty(&sum);
+			for(int i = BVH_BINS - 1; i > 0; i--)
+			{
+				bin_merge(&sum, &axis_bins[i]);
+				right[i] = bounds_area(&sum.bounds) * sum.count;
+			}
+			bin_empty(&sum);
+			for(int i = 0; i < BVH_BINS - 1; i++)
+			{
+				bin_merge(&sum, &axis_bins[i]);
+				if(sum.count == 0 || sum.count == count)
+					continue;
+				float cost = bounds_area(&sum.bounds) * sum.count + right[i + 1];
+				if(cost < best)
+				{
+					best = cost;
+					axis = a;
+					split = i + 1;
+				}
+			}
+		}
+	}
+
+	//a split costs one node step plus the children's tests, weighted by area
+	float area = bounds_area(&task->info.bounds);
+	if(count <= BVH_LEAF_MAX && (axis < 0 || BVH_TRAVERSAL_COST * area + best >= area * count))
+		return 0;
+
+	uint32_t left = 0;
+	if(axis >= 0)
+	{
+		const bvh_bin *axis_bins = bins + axis * BVH_BINS;
+		float scale = bin_scale(&task->info, axis);
+		uint32_t right = count;
+		bin_empty(&children[0].info);
+		bin_empty(&children[1].info);
+		for(int i = 0; i < BVH_BINS; i++)
+			bin_merge(&children[i >= split].info, &axis_bins[i]);
+
+		while(left < right)
+		{
+			const float *centroid = b->centroids[task->first + left];
+			if(bin_index(&task->info, axis, scale, centroid) < split)
+			{
+				bounds_grow(&children[0].info.centroids, centroid, centroid);
+				left++;
+			}
+			else
+			{
+				swap_prims(b, task->first + left, task->first + --right);
+				centroid = b->centroids[task->first + right];
+				bounds_grow(&children[1].info.centroids, centroid, centroid);
+			}
+		}
+	}
+	else
+	{
+		//flat centroids or too deep: halve the range as it is
+		left = count / 2;
+		bin_parallel(b, NULL, task->first, left, &children[0].info);
+		bin_parallel(b, NULL, task->first + left, count - left, &children[1].info);
+	}
+
+	//siblings go in pairs starting at even slots, so each pair is one cache line
+	uint32_t pair;
+	BVH_PRAGMA(omp atomic capture)
+	{
+		pair = bvh->node_count;
+		bvh->node_count += 2;
+	}
+	node->first = pair;
+	node->count = 0;
+
+	for(int c = 0; c < 2; c++)
+	{
+		children[c].node = pair + c;
+		children[c].first = task->first + (c == 0 ? 0 : left);
+		children[c].depth = task->depth + 1;
+	}
+	return 1;
+}
+
+static void bvh_build_task(bvh_builder *b, const bvh_task *task)
+{
+	bvh_task children[2];
+	if(bvh_split(b, task, children))
+	{
+		bvh_build_task(b, &children[0]);
+		bvh_build_task(b, &children[1]);
+	}
+}
+
+//triangle index of the soup into slot i, as math_triangle_stream_from_aos writes it
+static void load_triangle(triangle_stream *tris, size_t i, const float *vertices, size_t stride, size_t index)
+{
+	size_t capacity = tris->v0.capacity;
+	const float *v0 = vertices + 3 * index * stride;
+	for(int k = 0; k < 3; k++)
+	{
+		tris->v0.x[k * capacity + i] = v0[k];
+		tris->e1.x[k * capacity + i] = v0[stride + k] - v0[k];
+		tris->e2.x[k * capacity + i] = v0[2 * stride + k] - v0[k];
+	}
+}
+
+static void copy_triangle(triangle_stream *result, size_t i, const triangle_stream *tris, size_t j)
+{
+	const vec3_stream *from[3] = {&tris->v0, &tris->e1, &tris->e2};
+	vec3_stream *to[3] = {&result->v0, &result->e1, &result->e2};
+	for(int s = 0; s < 3; s++)
+		for(int k = 0; k < 3; k++)
+			to[s]->x[k * to[s]->capacity + i] = from[s]->x[k * from[s]->capacity + j];
+}
+
+int bvh_build(ts_bvh *bvh, const float *vertices, size_t stride, size_t count)
+{
+	memset(bvh, 0, sizeof(*bvh));
+	size_t node_bytes = (2 * count + 2) * sizeof(bvh_node);
+
+	triangle_stream soup;
+	bvh_builder b = {bvh, NULL, NULL};
+	bvh_task *tasks = malloc((count + 1) * sizeof(bvh_task));
+	bvh->nodes = aligned_alloc(64, (node_bytes + 63) / 64 * 64);
+	bvh->indices = malloc((count + 1) * sizeof(uint32_t));
+	b.prims = malloc((count + 1) * sizeof(bvh_bounds));
+	b.centroids = malloc((count + 1) * sizeof(*b.centroids));
+	int soup_ok = math_triangle_stream_alloc(&soup, count);
+	int tris_ok = math_triangle_stream_alloc(&bvh->tris, count);
+	int ok = tasks != NULL && bvh->nodes != NULL && bvh->indices != NULL && b.prims != NULL &&
+		b.centroids != NULL && soup_ok && tris_ok;
+
+	if(ok)
+	{
+		math_triangle_stream_from_aos(&soup, vertices, stride, count);
+
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < (long)count; i++)
+		{
+			triangle_bounds(&b.prims[i], &soup, i);
+			for(int k = 0; k < 3; k++)
+				b.centroids[i][k] = b.prims[i].min[k] + b.prims[i].max[k];
+			bvh->indices[i] = (uint32_t)i;
+		}
+
+		bvh->count = (uint32_t)count;
+		bvh->node_count = 2;
+		bvh->nodes[1].first = bvh->nodes[1].count = 0; //padding slot
+
+		//big nodes one at a time, every thread binning. Small ones are queued from the front
+		size_t small = 0;
+		size_t big = count + 1;
+		memset(&tasks[--big], 0, sizeof(bvh_task));
+		bin_parallel(&b, NULL, 0, count, &tasks[big].info);
+		while(big < count + 1)
+		{
+			bvh_task task = tasks[big++];
+			bvh_task children[2];
+			if(task.info.count <= BVH_PARALLEL_NODE)
+				tasks[small++] = task;
+			else if(bvh_split(&b, &task, children))
+			{
+				tasks[--big] = children[1];
+				tasks[--big] = children[0];
+			}
+		}
+
+		//then whole subtrees, one per thread
+		BVH_PRAGMA(omp parallel for schedule(dynamic, 1))
+		for(long i = 0; i < (long)small; i++)
+			bvh_build_task(&b, &tasks[i]);
+
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < (long)count; i++)
+			copy_triangle(&bvh->tris, i, &soup, bvh->indices[i]);
+		bvh->tris.v0.count = bvh->tris.e1.count = bvh->tris.e2.count = count;
+	}
+
+	math_triangle_stream_free(&soup);
+	free(b.prims);
+	free(b.centroids);
+	free(tasks);
+	if(!ok)
+		bvh_free(bvh);
+	return ok;
+}
+
+static double bvh_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/*
+ * LSD radix sort of keys (bits wide) with their values, 8 bits a pass.
+ * Blocks of BVH_SORT_BLOCK keys are counted and scattered by the threads,
+ * offsets go digit by digit then block by block, so the sort is stable
+ * and the same on any thread count. Passes over a digit all keys share
+ * are skipped. keys[0]/values[0] hold the result, the buffers swap.
+*/
+static void radix_sort(uint32_t *keys[2], uint32_t *values[2], size_t count, int bits, uint32_t *offsets)
+{
+	long blocks = (long)((count + BVH_SORT_BLOCK - 1) / BVH_SORT_BLOCK);
+	for(int shift = 0; shift < bits; shift += 8)
+	{
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long b = 0; b < blocks; b++)
+		{
+			uint32_t *histogram = offsets + b * 256;
+			size_t end = (size_t)(b + 1) * BVH_SORT_BLOCK < count ? (size_t)(b + 1) * BVH_SORT_BLOCK : count;
+			memset(histogram, 0, 256 * sizeof(uint32_t));
+			for(size_t i = (size_t)b * BVH_SORT_BLOCK; i < end; i++)
+				histogram[(keys[0][i] >> shift) & 255]++;
+		}
+
+		uint32_t sum = 0;
+		int skip = 0;
+		for(int digit = 0; digit < 256; digit++)
+		{
+			uint32_t start = sum;
+			for(long b = 0; b < blocks; b++)
+			{
+				uint32_t n = offsets[b * 256 + digit];
+				offsets[b * 256 + digit] = sum;
+				sum += n;
+			}
+			skip |= sum - start == count;
+		}
+		if(skip)
+			continue;
+
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long b = 0; b < blocks; b++)
+		{
+			uint32_t *offset = offsets + b * 256;
+			size_t end = (size_t)(b + 1) * BVH_SORT_BLOCK < count ? (size_t)(b + 1) * BVH_SORT_BLOCK : count;
+			for(size_t i = (size_t)b * BVH_SORT_BLOCK; i < end; i++)
+			{
+				uint32_t to = offset[(keys[0][i] >> shift) & 255]++;
+				keys[1][to] = keys[0][i];
+				values[1][to] = values[0][i];
+			}
+		}
+
+		uint32_t *swap = keys[0];
+		keys[0] = keys[1];
+		keys[1] = swap;
+		swap = values[0];
+		values[0] = values[1];
+		values[1] = swap;
+	}
+}
+
+static int clz32(uint32_t x)
+{
+#ifdef __GNUC__
+	return __builtin_clz(x);
+#else
+	int n = 0;
+	for(; !(x & 0x80000000u); x <<= 1)
+		n++;
+	return n;
+#endif
+}
+
+//common prefix of sorted codes i and j, equal codes go on with the indices. -1 past the ends
+static int lbvh_prefix(const uint32_t *codes, long count, long i, long j)
+{
+	if(j < 0 || j >= count)
+		return -1;
+	if(codes[i] == codes[j])
+		return 32 + clz32((uint32_t)(i ^ j));
+	return clz32(codes[i] ^ codes[j]);
+}
+
+//range and children of inner node i, Karras 2012 figure 4
+static void lbvh_inner(lbvh_node *nodes, uint32_t *leaf_parents, const uint32_t *codes, long count, long i)
+{
+	int d = lbvh_prefix(codes, count, i, i + 1) > lbvh_prefix(codes, count, i, i - 1) ? 1 : -1;
+	int prefix_min = lbvh_prefix(codes, count, i, i - d);
+
+	//range end: grow by powers of two, then binary search
+	long length_max = 2;
+	while(lbvh_prefix(codes, count, i, i + length_max * d) > prefix_min)
+		length_max *= 2;
+	long length = 0;
+	for(long t = length_max / 2; t >= 1; t /= 2)
+		if(lbvh_prefix(codes, count, i, i + (length + t) * d) > prefix_min)
+			length += t;
+	long j = i + length * d;
+
+	//split: the last key sharing more than the whole range's prefix
+	int prefix = lbvh_prefix(codes, count, i, j);
+	long split = 0;
+	long t = length;
+	do
+	{
+		t = (t + 1) / 2;
+		if(lbvh_prefix(codes, count, i, i + (split + t) * d) > prefix)
+			split += t;
+	} while(t > 1);
+	long gamma = i + split * d + (d < 0 ? -1 : 0);
+
+	lbvh_node *node = &nodes[i];
+	node->first = (uint32_t)(i < j ? i : j);
+	node->last = (uint32_t)(i < j ? j : i);
+	node->child[0] = (uint32_t)gamma | (node->first == gamma ? BVH_LEAF_FLAG : 0);
+	node->child[1] = (uint32_t)(gamma + 1) | (node->last == gamma + 1 ? BVH_LEAF_FLAG : 0);
+	for(int c = 0; c < 2; c++)
+	{
+		uint32_t child = node->child[c];
+		if(child & BVH_LEAF_FLAG)
+			leaf_parents[child & ~BVH_LEAF_FLAG] = (uint32_t)i;
+		else
+			nodes[child].parent = (uint32_t)i;
+	}
+}
+
+//prims are in sorted order here, one box per leaf
+static const bvh_bounds *lbvh_child_bounds(const bvh_bounds *inner, const bvh_bounds *prims, uint32_t child)
+{
+	return child & BVH_LEAF_FLAG ? &prims[child & ~BVH_LEAF_FLAG] : &inner[child];
+}
+
+//node for a child of an inner node: ranges up to BVH_LEAF_MIN become one leaf
+static void lbvh_emit(bvh_node *node, const lbvh_node *nodes, const bvh_bounds *inner, const bvh_bounds *prims, uint32_t child)
+{
+	const bvh_bounds *bounds = lbvh_child_bounds(inner, prims, child);
+	memcpy(node->min, bounds->min, sizeof(node->min));
+	memcpy(node->max, bounds->max, sizeof(node->max));
+	if(child & BVH_LEAF_FLAG)
+	{
+		node->first = child & ~BVH_LEAF_FLAG;
+		node->count = 1;
+	}
+	else if(nodes[child].last - nodes[child].first < BVH_LEAF_MIN)
+	{
+		node->first = nodes[child].first;
+		node->count = nodes[child].last - nodes[child].first + 1;
+	}
+	else
+	{
+		node->first = 2 + 2 * child;
+		node->count = 0;
+	}
+}
+
+int bvh_build_lbvh(ts_bvh *bvh, const float *vertices, size_t stride, size_t count, bvh_timings *timings)
+{
+	bvh_timings times = {0};
+	double start = bvh_now();
+	double mark = start;
+	memset(bvh, 0, sizeof(*bvh));
+	size_t node_bytes = (2 * count + 2) * sizeof(bvh_node);
+	long n = (long)count;
+	long blocks = (long)((count + BVH_SORT_BLOCK - 1) / BVH_SORT_BLOCK);
+
+	bvh_bounds *prims = malloc((count + 1) * sizeof(bvh_bounds));
+	bvh_bounds *inner = malloc((count + 1) * sizeof(bvh_bounds));
+	bvh_bounds *partial = malloc((blocks + 1) * sizeof(bvh_bounds));
+	float *centroids = malloc((3 * count + 1) * sizeof(float));
+	uint32_t *keys[2] = {malloc((count + 1) * sizeof(uint32_t)), malloc((count + 1) * sizeof(uint32_t))};
+	uint32_t *values[2] = {malloc((count + 1) * sizeof(uint32_t)), malloc((count + 1) * sizeof(uint32_t))};
+	uint32_t *offsets = malloc((blocks * 256 + 1) * sizeof(uint32_t));
+	uint32_t *leaf_parents = malloc((count + 1) * sizeof(uint32_t));
+	lbvh_node *nodes = malloc((count + 1) * sizeof(lbvh_node));
+	bvh->nodes = aligned_alloc(64, (node_bytes + 63) / 64 * 64);
+	int tris_ok = math_triangle_stream_alloc(&bvh->tris, count);
+	int ok = prims != NULL && inner != NULL && partial != NULL && centroids != NULL && keys[0] != NULL &&
+		keys[1] != NULL && values[0] != NULL && values[1] != NULL && offsets != NULL &&
+		leaf_parents != NULL && nodes != NULL && bvh->nodes != NULL && tris_ok;
+
+	if(ok)
+	{
+		float *cx = centroids;
+		float *cy = centroids + count;
+		float *cz = centroids + 2 * count;
+
+		//centroids (min + max) straight from the soup, as SoA for the Morton kernel, and their bounds
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long b = 0; b < blocks; b++)
+		{
+			long end = (b + 1) * BVH_SORT_BLOCK < n ? (b + 1) * BVH_SORT_BLOCK : n;
+			bounds_empty(&partial[b]);
+			for(long i = b * BVH_SORT_BLOCK; i < end; i++)
+			{
+				const float *v = vertices + 3 * (size_t)i * stride;
+				bvh_bounds triangle;
+				bounds_empty(&triangle);
+				for(int c = 0; c < 3; c++)
+					bounds_grow(&triangle, v + c * stride, v + c * stride);
+				float centroid[3];
+				for(int k = 0; k < 3; k++)
+					centroid[k] = triangle.min[k] + triangle.max[k];
+				cx[i] = centroid[0];
+				cy[i] = centroid[1];
+				cz[i] = centroid[2];
+				bounds_grow(&partial[b], centroid, centroid);
+				values[0][i] = (uint32_t)i;
+			}
+		}
+		bvh_bounds scene;
+		bounds_empty(&scene);
+		for(long b = 0; b < blocks; b++)
+			bounds_grow(&scene, partial[b].min, partial[b].max);
+		times.bounds = bvh_now() - mark;
+		mark = bvh_now();
+
+		if(count > 0)
+			math_morton3_batch(keys[0], cx, cy, cz, scene.min, scene.max, count);
+		times.morton = bvh_now() - mark;
+		mark = bvh_now();
+
+		radix_sort(keys, values, count, 30, offsets);
+		bvh->indices = values[0];
+		values[0] = NULL;
+		times.sort = bvh_now() - mark;
+		mark = bvh_now();
+
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < n - 1; i++)
+			lbvh_inner(nodes, leaf_parents, keys[0], n, i);
+		if(n > 0)
+			nodes[0].parent = BVH_NONE;
+		times.hierarchy = bvh_now() - mark;
+		mark = bvh_now();
+
+		//triangles in leaf order, boxes from those so they cover what the kernels test
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < n; i++)
+		{
+			load_triangle(&bvh->tris, i, vertices, stride, bvh->indices[i]);
+			triangle_bounds(&prims[i], &bvh->tris, i);
+		}
+		bvh->tris.v0.count = bvh->tris.e1.count = bvh->tris.e2.count = count;
+
+		//every triangle walks up, the second child to arrive at a node merges its box
+		uint32_t *arrivals = keys[1];
+		memset(arrivals, 0, count * sizeof(uint32_t));
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < n; i++)
+		{
+			uint32_t node = n > 1 ? leaf_parents[i] : BVH_NONE;
+			while(node != BVH_NONE)
+			{
+				uint32_t arrived;
+				BVH_PRAGMA(omp atomic capture seq_cst)
+				arrived = arrivals[node]++;
+				if(arrived == 0)
+					break;
+
+				bvh_bounds bounds = *lbvh_child_bounds(inner, prims, nodes[node].child[0]);
+				const bvh_bounds *right = lbvh_child_bounds(inner, prims, nodes[node].child[1]);
+				bounds_grow(&bounds, right->min, right->max);
+				inner[node] = bounds;
+				node = nodes[node].parent;
+			}
+		}
+		times.fit = bvh_now() - mark;
+		mark = bvh_now();
+
+		//children of inner node k go to slots 2 + 2k, pairs under a leaf stay zeroed
+		bvh->count = (uint32_t)count;
+		bvh->node_count = (uint32_t)(2 * count);
+		memset(&bvh->nodes[1], 0, sizeof(bvh_node));
+		BVH_PRAGMA(omp parallel for schedule(static))
+		for(long i = 0; i < n - 1; i++)
+		{
+			bvh_node *pair = &bvh->nodes[2 + 2 * i];
+			if(nodes[i].last - nodes[i].first < BVH_LEAF_MIN)
+				memset(pair, 0, 2 * sizeof(bvh_node));
+			else
+			{
+				lbvh_emit(&pair[0], nodes, inner, prims, nodes[i].child[0]);
+				lbvh_emit(&pair[1], nodes, inner, prims, nodes[i].child[1]);
+			}
+		}
+		if(n > 0)
+			lbvh_emit(&bvh->nodes[0], nodes, inner, prims, n > 1 ? 0 : BVH_LEAF_FLAG);
+		times.emit = bvh_now() - mark;
+	}
+
+	free(prims);
+	free(inner);
+	free(partial);
+	free(centroids);
+	free(keys[0]);
+	free(keys[1]);
+	free(values[0]);
+	free(values[1]);
+	free(offsets);
+	free(leaf_parents);
+	free(nodes);
+	if(!ok)
+		bvh_free(bvh);
+	times.total = bvh_now() - start;
+	if(timings != NULL)
+		*timings = times;
+	return ok;
+}
+
+//depth first, LBVH children can sit in lower slots than their parent
+static void refit_inner(ts_bvh *bvh, uint32_t n)
+{
+	bvh_node *node = &bvh->nodes[n];
+	if(node->count > 0)
+		return;
+	refit_inner(bvh, node->first);
+	refit_inner(bvh, node->first + 1);
+
+	bvh_bounds bounds;
+	bounds_empty(&bounds);
+	bounds_grow(&bounds, bvh->nodes[node->first].min, bvh->nodes[node->first].max);
+	bounds_grow(&bounds, bvh->nodes[node->first + 1].min, bvh->nodes[node->first + 1].max);
+	memcpy(node->min, bounds.min, sizeof(node->min));
+	memcpy(node->max, bounds.max, sizeof(node->max));
+}
+
+void bvh_refit(ts_bvh *bvh, const float *vertices, size_t stride)
+{
+	triangle_stream *tris = &bvh->tris;
+	if(bvh->count == 0)
+		return;
+
+	BVH_PRAGMA(omp parallel for schedule(static))
+	for(long i = 0; i < (long)bvh->count; i++)
+		load_triangle(tris, i, vertices, stride, bvh->indices[i]);
+
+	//leaves from their triangles, then inner nodes from their children
+	BVH_PRAGMA(omp parallel for schedule(static))
+	for(long n = 0; n < (long)bvh->node_count; n++)
+	{
+		bvh_node *node = &bvh->nodes[n];
+		if(n == 1 || node->count == 0)
+			continue;
+		bvh_bounds bounds, triangle;
+		bounds_empty(&bounds);
+		for(uint32_t i = node->first; i < node->first + node->count; i++)
+		{
+			triangle_bounds(&triangle, tris, i);
+			bounds_grow(&bounds, triangle.min, triangle.max);
+		}
+		memcpy(node->min, bounds.min, sizeof(node->min));
+		memcpy(node->max, bounds.max, sizeof(node->max));
+	}
+
+	refit_inner(bvh, 0);
+}
+
+void bvh_free(ts_bvh *bvh)
+{
+	free(bvh->nodes);
+	free(bvh->indices);
+	math_triangle_stream_free(&bvh->tris);
+	memset(bvh, 0, sizeof(*bvh));
+}
+
+//slab test, NaN slabs (origin on the plane, zero direction) are skipped
+static int node_hit(const bvh_node *node, const float *origin, const float *inv, float t_min, float t_max, float *t_near)
+{
+	for(int k = 0; k < 3; k++)
+	{
+		float t0 = (node->min[k] - origin[k]) * inv[k];
+		float t1 = (node->max[k] - origin[k]) * inv[k];
+		float lo = t0 < t1 ? t0 : t1;
+		float hi = t0 < t1 ? t1 : t0;
+		t_min = lo > t_min ? lo : t_min;
+		t_max = hi < t_max ? hi : t_max;
+	}
+	*t_near = t_min;
+	return t_min <= t_max;
+}
+
+int bvh_intersect(const ts_bvh *bvh, const ray *r, ray_hit *hit)
+{
+	hit->t = r->t_max;
+	hit->u = hit->v = 0.0f;
+	hit->primitive = MATH_RAY_MISS;
+
+	vec3 inv = {1.0f / r->direction[0], 1.0f / r->direction[1], 1.0f / r->direction[2]};
+	uint32_t stack[BVH_STACK];
+	float stack_t[BVH_STACK];
+	int top = 0;
+	uint32_t node = 0;
+	float t;
+	if(bvh->count == 0 || !node_hit(&bvh->nodes[0], r->origin, inv, r->t_min, hit->t, &t))
+		return 0;
+
+	for(;;)
+	{
+		const bvh_node *n = &bvh->nodes[node];
+		if(n->count > 0)
+			math_ray_nearest_triangle_range(hit, r, &bvh->tris, n->first, n->count);
+		else
+		{
+			float t_left, t_right;
+			int left = node_hit(&bvh->nodes[n->first], r->origin, inv, r->t_min, hit->t, &t_left);
+			int right = node_hit(&bvh->nodes[n->first + 1], r->origin, inv, r->t_min, hit->t, &t_right);
+			if(left && right)
+			{
+				//nearer child first, the other one waits with its entry t
+				int right_first = t_right < t_left;
+				stack[top] = n->first + !right_first;
+				stack_t[top++] = right_first ? t_left : t_right;
+				node = n->first + right_first;
+				continue;
+			}
+			if(left || right)
+			{
+				node = n->first + right;
+				continue;
+			}
+		}
+
+		//boxes entered past the closest hit so far can't hold anything closer
+		while(top > 0 && stack_t[top - 1] >= hit->t)
+			top--;
+		if(top == 0)
+			break;
+		node = stack[--top];
+	}
+
+	if(hit->primitive == MATH_RAY_MISS)
+		return 0;
+	hit->primitive = bvh->indices[hit->primitive];
+	return 1;
+}
+
+int bvh_occluded(const ts_bvh *bvh, const ray *r)
+{
+	ray_hit hit = {r->t_max, 0.0f, 0.0f, MATH_RAY_MISS};
+	vec3 inv = {1.0f / r->direction[0], 1.0f / r->direction[1], 1.0f / r->direction[2]};
+	uint32_t stack[BVH_STACK];
+	int top = 0;
+	if(bvh->count > 0)
+		stack[top++] = 0;
+
+	while(top > 0)
+	{
+		const bvh_node *n = &bvh->nodes[stack[--top]];
+		float t;
+		if(!node_hit(n, r->origin, inv, r->t_min, r->t_max, &t))
+			continue;
+		if(n->count > 0)
+		{
+			if(math_ray_nearest_triangle_range(&hit, r, &bvh->tris, n->first, n->count))
+				return 1;
+			continue;
+		}
+		stack[top++] = n->first + 1;
+		stack[top++] = n->first;
+	}
+	return 0;
+}
+
+void bvh_intersect_packet(const ts_bvh *bvh, const ray_packet *rays, ray_packet_hit *hit)
+{
+	vec3 direction = {0.0f, 0.0f, 0.0f};
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+	{
+		hit->t[lane] = rays->t_max[lane];
+		hit->u[lane] = hit->v[lane] = 0.0f;
+		hit->primitive[lane] = MATH_RAY_MISS;
+		direction[0] += rays->direction_x[lane];
+		direction[1] += rays->direction_y[lane];
+		direction[2] += rays->direction_z[lane];
+	}
+
+	uint32_t stack[BVH_STACK];
+	int top = 0;
+	if(bvh->count > 0)
+		stack[top++] = 0;
+
+	while(top > 0)
+	{
+		const bvh_node *n = &bvh->nodes[stack[--top]];
+		float t_near[MATH_RAY_PACKET];
+		uint32_t mask = math_ray_packet_aabb(t_near, rays, (float *)n->min, (float *)n->max);
+		//lanes that already hit something in front of the box are done with it
+		for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+			if(!(t_near[lane] < hit->t[lane]))
+				mask &= ~(1u << lane);
+		if(mask == 0)
+			continue;
+
+		if(n->count > 0)
+		{
+			math_ray_packet_nearest_triangle_range(hit, rays, &bvh->tris, n->first, n->count);
+			continue;
+		}
+
+		//visit the child nearer along the packet's overall direction first
+		const bvh_node *left = &bvh->nodes[n->first];
+		const bvh_node *right = &bvh->nodes[n->first + 1];
+		float ahead = 0.0f;
+		for(int k = 0; k < 3; k++)
+			ahead += (left->min[k] + left->max[k] - right->min[k] - right->max[k]) * direction[k];
+		stack[top++] = n->first + (ahead > 0.0f ? 0 : 1);
+		stack[top++] = n->first + (ahead > 0.0f ? 1 : 0);
+	}
+
+	for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+		if(hit->primitive[lane] != MATH_RAY_MISS)
+			hit->primitive[lane] = bvh->indices[hit->primitive[lane]];
+}
+
+void bvh_intersect_batch(const ts_bvh *bvh, const ray *rays, ray_hit *hits, size_t count)
+{
+	BVH_PRAGMA(omp parallel for schedule(dynamic, 64))
+	for(long i = 0; i < (long)count; i++)
+		bvh_intersect(bvh, &rays[i], &hits[i]);
+}
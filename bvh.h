@@ -0,0 +1,112 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file bvh.h
+ * @brief Bounding volume hierarchy over triangle soups
+ *
+ * Binned SAH build (split across threads with -fopenmp) for CPU ray
+ * queries: picking, visibility and occlusion, and a linear (LBVH) build
+ * fast enough to redo every frame for scenes that move. Both give the
+ * same kind of tree to the same queries. Nodes live in one flat
+ * array, 32 bytes each, siblings next to each other in the same cache
+ * line. Leaves test their triangles with the 3d_math ray kernels.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#ifndef BVH
+#define BVH
+
+#include "3d_math.h"
+
+typedef struct bvh_node
+{
+	float min[3];
+	uint32_t first; //leaf: first triangle, inner: left child (right is first + 1)
+	float max[3];
+	uint32_t count; //triangles in a leaf, 0 for inner nodes
+} bvh_node;
+
+typedef struct ts_bvh
+{
+	bvh_node *nodes; //64-byte aligned, root at 0
+	uint32_t node_count; //used slots, node 1 (and LBVH pairs under leaves) left empty
+	uint32_t count; //triangles
+	uint32_t *indices; //leaf order -> triangle index in the soup
+	triangle_stream tris; //triangles in leaf order
+} ts_bvh;
+
+/**
+ * Vertices are a triangle soup like math_triangle_stream_from_aos:
+ * three vertices per triangle, every stride floats. Hits report the
+ * triangle index in that soup.
+ * @brief Build a BVH with binned SAH
+ * @param bvh (ts_bvh*) the BVH, free it with bvh_free
+ * @param vertices (const float*) triangle soup
+ * @param stride (size_t) floats from one vertex to the next
+ * @param count (size_t) triangles
+ * @return 0 when out of memory
+*/
+int bvh_build(ts_bvh *bvh, const float *vertices, size_t stride, size_t count);
+
+//milliseconds spent in each phase of bvh_build_lbvh
+typedef struct bvh_timings
+{
+	double bounds; //triangle centroids and their bounds
+	double morton;
+	double sort; //radix sort of the codes
+	double hierarchy; //inner nodes from the sorted codes
+	double fit; //triangles in leaf order, then boxes bottom-up
+	double emit; //node array
+	double total;
+} bvh_timings;
+
+/**
+ * Sorts triangles along a Morton curve of their centroids and builds the
+ * tree from the sorted codes, every phase split across threads. Several
+ * times faster than bvh_build, for scenes that change every frame, but
+ * the tree traces slower: splits follow the curve, not the SAH.
+ * @brief Build a BVH from Morton codes
+ * @param timings (bvh_timings*) time per phase, may be NULL
+ * @return 0 when out of memory
+*/
+int bvh_build_lbvh(ts_bvh *bvh, const float *vertices, size_t stride, size_t count, bvh_timings *timings);
+
+/**
+ * For deforming meshes: same soup and triangle count as the build,
+ * vertices moved. Keeps the tree and grows/shrinks the boxes, which is
+ * much cheaper than a rebuild but traces slower the further the mesh
+ * gets from its shape at build time.
+ * @brief Refit the boxes to moved vertices
+*/
+void bvh_refit(ts_bvh *bvh, const float *vertices, size_t stride);
+
+void bvh_free(ts_bvh *bvh);
+
+/**
+ * @brief Closest hit along a ray
+ * @return 1 if something was hit, hit->primitive is the triangle index
+*/
+int bvh_intersect(const ts_bvh *bvh, const ray *r, ray_hit *hit);
+
+/**
+ * Stops at the first triangle found, for shadow and visibility rays.
+ * @brief Whether anything is hit in [t_min, t_max)
+*/
+int bvh_occluded(const ts_bvh *bvh, const ray *r);
+
+//8 coherent rays (e.g. neighbouring pixels) walking the tree together
+void bvh_intersect_packet(const ts_bvh *bvh, const ray_packet *rays, ray_packet_hit *hit);
+
+//closest hits of many rays, split across threads
+void bvh_intersect_batch(const ts_bvh *bvh, const ray *rays, ray_hit *hits, size_t count);
+
+#endif
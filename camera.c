@@ -18,21 +18,83 @@
 #include <math.h>
 #include "camera.h"
 
+//rotation columns of the orientation: identity looks down -Z like yaw -90
+static void camera_update_quaternion(ts_camera *input)
+{
+	float x = input->orientation[0];
+	float y = input->orientation[1];
+	float z = input->orientation[2];
+	float w = input->orientation[3];
+
+	input->right[0] = 1.0f - 2.0f * (y * y + z * z);
+	input->right[1] = 2.0f * (x * y + w * z);
+	input->right[2] = 2.0f * (x * z - w * y);
+	input->up[0] = 2.0f * (x * y - w * z);
+	input->up[1] = 1.0f - 2.0f * (x * x + z * z);
+	input->up[2] = 2.0f * (y * z + w * x);
+	input->front[0] = -2.0f * (x * z + w * y);
+	input->front[1] = -2.0f * (y * z - w * x);
+	input->front[2] = 2.0f * (x * x + y * y) - 1.0f;
+
+	input->dirty |= CAMERA_DIRTY_VIEW;
+}
+
+//yaw around +Y, then pitch around right, then roll around front
+static void camera_euler_to_quaternion(ts_camera *input)
+{
+	quat yaw, pitch, roll, yaw_pitch;
+	math_quat_from_axis_angle(yaw, (vec3){0.0f, 1.0f, 0.0f}, -deg_to_rad(input->yaw + 90.0f));
+	math_quat_from_axis_angle(pitch, (vec3){1.0f, 0.0f, 0.0f}, deg_to_rad(input->pitch));
+	math_quat_from_axis_angle(roll, (vec3){0.0f, 0.0f, 1.0f}, -deg_to_rad(input->roll));
+	math_quat_mul(yaw_pitch, yaw, pitch);
+	math_quat_mul(input->orientation, yaw_pitch, roll);
+}
+
 static void camera_update(ts_camera *input)
 {
+	if(input->quaternion)
+	{
+		camera_update_quaternion(input);
+		return;
+	}
+
 	vec3 front;
+	float sin_yaw, cos_yaw;
+	float sin_pitch, cos_pitch;
 
-	front[0] = cos(deg_to_rad(input->yaw)) * cos(deg_to_rad(input->pitch));
-	front[1] = sin(deg_to_rad(input->pitch));
-	front[2] = sin(deg_to_rad(input->yaw)) * cos(deg_to_rad(input->pitch));
-	math_vec3_normalize_to(input->front, front);
+	math_sincos(deg_to_rad(input->yaw), &sin_yaw, &cos_yaw);
+	math_sincos(deg_to_rad(input->pitch), &sin_pitch, &cos_pitch);
+
+	front[0] = cos_yaw * cos_pitch;
+	front[1] = sin_pitch;
+	front[2] = sin_yaw * cos_pitch;
+	MATH_NORMALIZE_HOT(input->front, front);
 
 	vec3 crossprod;
 	math_vec3_cross(crossprod, input->front, input->world_up);
-	math_vec3_normalize_to(input->right, crossprod);
+	MATH_NORMALIZE_HOT(input->right, crossprod);
 
 	math_vec3_cross(crossprod, input->right, input->front);
-	math_vec3_normalize_to(input->up, crossprod);
+	MATH_NORMALIZE_HOT(input->up, crossprod);
+
+	input->dirty |= CAMERA_DIRTY_VIEW;
+}
+
+static void camera_defaults(ts_camera *input)
+{
+	input->aspect = ASPECT;
+	input->near = Z_NEAR;
+	input->far = Z_FAR;
+	input->projection_mode = CAMERA_PROJECTION_STANDARD;
+	input->quaternion = 0;
+	math_quat_identity(input->orientation);
+	input->jitter_mode = CAMERA_JITTER_NONE;
+	input->jitter_index = 0;
+	input->jitter_period = 0;
+	input->jitter_scale[0] = input->jitter_scale[1] = 0.0f;
+	input->jitter[0] = input->jitter[1] = 0.0f;
+	math_mat4_identity(input->previous_view_projection);
+	input->dirty = CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION;
 }
 
 void camera_initialize(ts_camera *input, vec3 position)
@@ -44,6 +106,7 @@ void camera_initialize(ts_camera *input, vec3 position)
 	input->pitch = PITCH;
 	input->roll = ROLL;
 	input->zoom = ZOOM;
+	camera_defaults(input);
 
 	camera_update(input);
 }
@@ -66,6 +129,7 @@ void camera_initialize_full
 	input->pitch = pitch;
 	input->roll = roll;
 	input->zoom = zoom;
+	camera_defaults(input);
 
 	camera_update(input);
 }
@@ -102,15 +166,174 @@ void camera_initialize_fulls
 	input->pitch = pitch;
 	input->roll = roll;
 	input->zoom = zoom;
+	camera_defaults(input);
 
 	camera_update(input);
 }
 
+int camera_update_matrices(ts_camera *input)
+{
+	int dirty = input->dirty;
+	if(dirty & CAMERA_DIRTY_VIEW && input->quaternion)
+	{
+		//the basis is already orthonormal, no need for math_lookat
+		mat4 *view = &input->view;
+		for(int i = 0; i < 3; i++)
+		{
+			(*view)[i][0] = input->right[i];
+			(*view)[i][1] = input->up[i];
+			(*view)[i][2] = -input->front[i];
+			(*view)[i][3] = 0.0f;
+		}
+		(*view)[3][0] = -math_vec3_dot(input->right, input->position);
+		(*view)[3][1] = -math_vec3_dot(input->up, input->position);
+		(*view)[3][2] = math_vec3_dot(input->front, input->position);
+		(*view)[3][3] = 1.0f;
+	}
+	else if(dirty & CAMERA_DIRTY_VIEW)
+	{
+		vec3 sum;
+		math_vec3_add(sum, input->position, input->front);
+		math_lookat(input->view, input->position, sum, input->up);
+	}
+	if(dirty & CAMERA_DIRTY_PROJECTION)
+	{
+		float fov = deg_to_rad(input->zoom);
+		if(input->projection_mode == CAMERA_PROJECTION_REVERSE)
+			math_perspective_reverse(input->projection, fov, input->aspect, input->near, input->far);
+		else if(input->projection_mode == CAMERA_PROJECTION_REVERSE_INFINITE)
+			math_perspective_reverse_infinite(input->projection, fov, input->aspect, input->near);
+		else
+			math_perspective(input->projection, fov, input->aspect, input->near, input->far);
+	}
+	if(dirty)
+	{
+		math_mat4_mul_perspective(input->view_projection_unjittered, input->view, input->projection);
+		if(input->jitter_mode == CAMERA_JITTER_NONE)
+			math_mat4_copy(input->view_projection, input->view_projection_unjittered);
+		else
+			math_mat4_jitter(input->view_projection, input->view_projection_unjittered,
+				input->jitter[0] * input->jitter_scale[0], input->jitter[1] * input->jitter_scale[1]);
+	}
+	input->dirty = 0;
+	return dirty != 0;
+}
+
 void camera_get_view_matrix(ts_camera *input, mat4 view)
 {
-	vec3 sum;
-	math_vec3_add(sum, input->position, input->front);
-	math_lookat(view, input->position, sum, input->up);
+	camera_update_matrices(input);
+	math_mat4_copy(view, input->view);
+}
+
+void camera_get_projection_matrix(ts_camera *input, mat4 projection)
+{
+	camera_update_matrices(input);
+	math_mat4_copy(projection, input->projection);
+}
+
+void camera_get_view_projection(ts_camera *input, mat4 view_projection)
+{
+	camera_update_matrices(input);
+	math_mat4_copy(view_projection, input->view_projection);
+}
+
+void camera_set_position(ts_camera *input, vec3 position)
+{
+	math_vec3_copy(input->position, position);
+	input->dirty |= CAMERA_DIRTY_VIEW;
+}
+
+void camera_set_zoom(ts_camera *input, float zoom)
+{
+	input->zoom = zoom;
+	input->dirty |= CAMERA_DIRTY_PROJECTION;
+}
+
+void camera_set_angles(ts_camera *input, float yaw, float pitch, float roll)
+{
+	input->yaw = yaw;
+	input->pitch = pitch;
+	input->roll = roll;
+	if(input->quaternion)
+		camera_euler_to_quaternion(input);
+	camera_update(input);
+}
+
+void camera_set_quaternion_mode(ts_camera *input, int enabled)
+{
+	input->quaternion = enabled != 0;
+	if(input->quaternion)
+		camera_euler_to_quaternion(input);
+	camera_update(input);
+}
+
+void camera_roll(ts_camera *input, float degrees)
+{
+	input->roll += degrees;
+	if(input->quaternion)
+	{
+		quat roll;
+		math_quat_from_axis_angle(roll, (vec3){0.0f, 0.0f, 1.0f}, -deg_to_rad(degrees));
+		math_quat_mul(input->orientation, input->orientation, roll);
+		math_quat_norm(input->orientation, input->orientation);
+		camera_update_quaternion(input);
+	}
+}
+
+void camera_set_projection(ts_camera *input, float aspect, float near, float far)
+{
+	input->aspect = aspect;
+	input->near = near;
+	input->far = far;
+	input->dirty |= CAMERA_DIRTY_PROJECTION;
+}
+
+static void camera_jitter_offset(ts_camera *input)
+{
+	//Halton starts at 1, its index 0 is (0, 0)
+	uint32_t index = input->jitter_period ? input->jitter_index % input->jitter_period : input->jitter_index;
+	if(input->jitter_mode == CAMERA_JITTER_HALTON)
+	{
+		input->jitter[0] = math_halton(index + 1, 2) - 0.5f;
+		input->jitter[1] = math_halton(index + 1, 3) - 0.5f;
+	}
+	else if(input->jitter_mode == CAMERA_JITTER_R2)
+	{
+		math_r2(input->jitter, index);
+		input->jitter[0] -= 0.5f;
+		input->jitter[1] -= 0.5f;
+	}
+	else
+		input->jitter[0] = input->jitter[1] = 0.0f;
+	input->dirty |= CAMERA_DIRTY_JITTER;
+}
+
+void camera_set_jitter(ts_camera *input, int mode, int width, int height, uint32_t period)
+{
+	input->jitter_mode = mode;
+	input->jitter_period = period;
+	input->jitter_index = 0;
+	//no viewport yet (or a minimized window): no jitter rather than inf
+	input->jitter_scale[0] = width > 0 ? 2.0f / (float)width : 0.0f;
+	input->jitter_scale[1] = height > 0 ? 2.0f / (float)height : 0.0f;
+	camera_jitter_offset(input);
+}
+
+void camera_next_frame(ts_camera *input)
+{
+	camera_update_matrices(input);
+	math_mat4_copy(input->previous_view_projection, input->view_projection_unjittered);
+	if(input->jitter_mode != CAMERA_JITTER_NONE)
+	{
+		input->jitter_index++;
+		camera_jitter_offset(input);
+	}
+}
+
+void camera_set_projection_mode(ts_camera *input, int mode)
+{
+	input->projection_mode = mode;
+	input->dirty |= CAMERA_DIRTY_PROJECTION;
 }
 
 void camera_freecam
@@ -124,6 +347,40 @@ void camera_freecam
 	x_offset *= SENSITIVITY;
 	y_offset *= SENSITIVITY;
 
+	if(input->quaternion)
+	{
+		if(constraint == 1)
+		{
+			if(input->pitch + y_offset > 89.0f)
+				y_offset = 89.0f - input->pitch;
+			if(input->pitch + y_offset < -89.0f)
+				y_offset = -89.0f - input->pitch;
+		}
+		input->yaw += x_offset;
+		input->pitch += y_offset;
+
+		//turn around world Y on the left, tilt around the camera's right
+		//on the right: two quaternion multiplies with the zeros skipped
+		float sin_turn, cos_turn, sin_tilt, cos_tilt;
+		math_sincos(-deg_to_rad(x_offset) * 0.5f, &sin_turn, &cos_turn);
+		math_sincos(deg_to_rad(y_offset) * 0.5f, &sin_tilt, &cos_tilt);
+		float *q = input->orientation;
+		float x = cos_turn * q[0] + sin_turn * q[2];
+		float y = cos_turn * q[1] + sin_turn * q[3];
+		float z = cos_turn * q[2] - sin_turn * q[0];
+		float w = cos_turn * q[3] - sin_turn * q[1];
+		q[0] = x * cos_tilt + w * sin_tilt;
+		q[1] = y * cos_tilt + z * sin_tilt;
+		q[2] = z * cos_tilt - y * sin_tilt;
+		q[3] = w * cos_tilt - x * sin_tilt;
+
+		//rounding drifts the length a little every time, one Newton step
+		//of 1 / sqrt around 1 pulls it back without a sqrt
+		math_vec4_scale(q, q, 1.5f - 0.5f * math_vec4_dot(q, q));
+		camera_update_quaternion(input);
+		return;
+	}
+
 	input->yaw += x_offset;
 	input->pitch += y_offset;
 
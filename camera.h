@@ -35,10 +35,44 @@ typedef struct ts_camera
 	float yaw;
 	float pitch;
 	float roll;
+	//quaternion mode: orientation drives front/right/up, yaw and pitch
+	//are kept as running totals
+	quat orientation;
+	int quaternion;
 	//options
 	float zoom;
+	float aspect;
+	float near;
+	float far; //ignored by CAMERA_PROJECTION_REVERSE_INFINITE
+	int projection_mode; //CAMERA_PROJECTION_*
+	//cached matrices, rebuilt by camera_update_matrices when dirty
+	mat4 view;
+	mat4 projection;
+	mat4 view_projection; //projection * view, jittered
+	mat4 view_projection_unjittered; //for culling and reprojection
+	mat4 previous_view_projection; //last frame's, unjittered
+	int dirty; //CAMERA_DIRTY_* bits
+	//sub-pixel jitter, see camera_set_jitter
+	int jitter_mode; //CAMERA_JITTER_*
+	uint32_t jitter_index;
+	uint32_t jitter_period;
+	float jitter_scale[2]; //pixels to NDC
+	float jitter[2]; //this frame's offset in pixels, in [-0.5, 0.5)
 } ts_camera;
 
+#define CAMERA_DIRTY_VIEW		1
+#define CAMERA_DIRTY_PROJECTION	2
+#define CAMERA_DIRTY_JITTER		4
+
+#define CAMERA_JITTER_NONE		0
+#define CAMERA_JITTER_HALTON	1 //math_halton bases 2 and 3
+#define CAMERA_JITTER_R2		2 //math_r2
+
+//math_perspective, math_perspective_reverse, math_perspective_reverse_infinite
+#define CAMERA_PROJECTION_STANDARD			0
+#define CAMERA_PROJECTION_REVERSE			1
+#define CAMERA_PROJECTION_REVERSE_INFINITE	2
+
 ///DEFAULT CAMERA VALUES
 //will be removed and replaced by settings-based variables in the 
 static const float YAW =			-90.0f;
@@ -47,6 +81,9 @@ static const float ROLL =			0.0f;
 static const float SPEED =			0.1f;
 static const float SENSITIVITY =	0.2f;
 static const float ZOOM =			45.0f;
+static const float ASPECT =			4.0f / 3.0f;
+static const float Z_NEAR =			0.1f;
+static const float Z_FAR =			100.0f;
 
 /**
  * Easiest camera setup, you just need the camera structure itself and
@@ -111,6 +148,36 @@ void camera_initialize_fulls
 	float zoom
 );
 
+/**
+ * Keeps the orientation as a quaternion: mouse turns become quaternion
+ * multiplies and front/right/up come straight from it, no per-update
+ * trig, cross products or normalizes. Roll is applied (camera_roll,
+ * camera_set_angles), Euler mode ignores it. Switching on starts from
+ * the current yaw/pitch/roll.
+ * @brief Switch between Euler and quaternion orientation
+ * @param input (camera*) the camera
+ * @param enabled (int) 0 == Euler angles
+*/
+void camera_set_quaternion_mode(ts_camera *input, int enabled);
+
+/**
+ * @brief Roll around the view direction (quaternion mode)
+ * @param input (camera*) the camera
+ * @param degrees (float) clockwise as seen from the camera
+*/
+void camera_roll(ts_camera *input, float degrees);
+
+/**
+ * The camera keeps its view, projection and view-projection and only
+ * rebuilds them after a setter (or camera_freecam) changed something.
+ * If you write the fields yourself, set the matching CAMERA_DIRTY_* bit.
+ * @brief Rebuild the cached matrices if needed
+ * @param input (camera*) the camera
+ * @return 0 if nothing changed since the last call, so uniforms
+ * uploaded then are still good
+*/
+int camera_update_matrices(ts_camera *input);
+
 /**
  * This one gets the matrix that you need to get a view from the 3d
  * world.
@@ -120,9 +187,84 @@ void camera_initialize_fulls
 */
 void camera_get_view_matrix(ts_camera *input, mat4 view);
 
+/**
+ * @brief Return the perspective projection (zoom is the fov in degrees)
+ * @param input (camera*) the camera
+ * @param projection (mat4) projection matrix
+*/
+void camera_get_projection_matrix(ts_camera *input, mat4 projection);
+
+/**
+ * Upload this one instead of projection and view, the vertex shader
+ * then does one matrix multiply instead of two.
+ * @brief Return projection * view
+ * @param input (camera*) the camera
+ * @param view_projection (mat4) view-projection matrix
+*/
+void camera_get_view_projection(ts_camera *input, mat4 view_projection);
+
+void camera_set_position(ts_camera *input, vec3 position);
+
+void camera_set_zoom(ts_camera *input, float zoom);
+
+/**
+ * @brief Set the euler angles (degrees) and rebuild front/right/up
+ * @param input (camera*) the camera
+ * @param yaw (float)
+ * @param pitch (float)
+ * @param roll (float)
+*/
+void camera_set_angles(ts_camera *input, float yaw, float pitch, float roll);
+
+/**
+ * @brief Set the projection's aspect ratio and clip planes
+ * @param input (camera*) the camera
+ * @param aspect (float) width / height
+ * @param near (float) near plane
+ * @param far (float) far plane
+*/
+void camera_set_projection(ts_camera *input, float aspect, float near, float far);
+
+/**
+ * Moves the projection by a different sub-pixel offset every frame, for
+ * temporal anti-aliasing or upsampling: a resolve pass blends each frame
+ * with the previous ones, reprojected with previous_view_projection.
+ * Only view_projection is jittered, cull with view_projection_unjittered
+ * if you need it exact. The offsets repeat every period frames (8 to
+ * 16 is typical, 0 means never for R2). A width or height of 0 or less
+ * (minimized window) leaves that axis unjittered until the next call.
+ * @brief Turn projection jitter on or off
+ * @param input (camera*) the camera
+ * @param mode (int) CAMERA_JITTER_*
+ * @param width (int) viewport width in pixels
+ * @param height (int) viewport height in pixels
+ * @param period (uint32_t) frames before the offsets repeat
+*/
+void camera_set_jitter(ts_camera *input, int mode, int width, int height, uint32_t period);
+
+/**
+ * Call once per frame, before changing the camera for the new frame:
+ * saves the unjittered view-projection as previous_view_projection (an
+ * identity until the first call) and moves to the next jitter offset.
+ * @brief Start a new frame
+ * @param input (camera*) the camera
+*/
+void camera_next_frame(ts_camera *input);
+
+/**
+ * The reverse-Z modes need the renderer set up for them, see
+ * math_perspective_reverse.
+ * @brief Pick the kind of projection
+ * @param input (camera*) the camera
+ * @param mode (int) CAMERA_PROJECTION_*
+*/
+void camera_set_projection_mode(ts_camera *input, int mode);
+
 /**
  * Restrict camera movements based on mouse input. This is meant for
- * first person shooter like cameras or free camera modes.
+ * first person shooter like cameras or free camera modes. In quaternion
+ * mode x turns around world Y and y around the camera's own right, so
+ * a rolled camera keeps its roll.
  * @brief Position the camera using mouse like a freecam or FPS cam
  * @param input (camera*) the camera
  * @param x_offset (float)
@@ -0,0 +1,235 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file camera_array.c
+ * @brief camera_array.h implementation
+ *
+ * Same math as camera_update, minus two of its three normalizes: front
+ * from sines and cosines is already unit length, and so is up, the
+ * cross product of two perpendicular unit vectors.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "camera_array.h"
+
+#define CAMERA_ARRAY_BLOCK 256 //cameras per block, scratch stays on the stack
+#define CAMERA_ARRAY_PARALLEL 1024 //fewer cameras than this stay on one thread
+
+#ifdef _OPENMP
+	#define CAMERA_ARRAY_PRAGMA(x) _Pragma(#x)
+#else
+	#define CAMERA_ARRAY_PRAGMA(x)
+#endif
+
+int camera_array_init(ts_camera_array *cameras, size_t count)
+{
+	memset(cameras, 0, sizeof(*cameras));
+	size_t floats = (count + 1) * sizeof(float);
+	size_t mats = (count + 1) * sizeof(mat4);
+
+	cameras->yaw = malloc(floats);
+	cameras->pitch = malloc(floats);
+	cameras->zoom = malloc(floats);
+	cameras->aspect = malloc(floats);
+	cameras->near = malloc(floats);
+	cameras->far = malloc(floats);
+	cameras->projection_mode = malloc((count + 1) * sizeof(int));
+	cameras->view = malloc(mats);
+	cameras->projection = malloc(mats);
+	cameras->view_projection = malloc(mats);
+	int streams_ok = math_vec3_stream_alloc(&cameras->position, count) &&
+		math_vec3_stream_alloc(&cameras->world_up, count) && math_vec3_stream_alloc(&cameras->front, count) &&
+		math_vec3_stream_alloc(&cameras->right, count) && math_vec3_stream_alloc(&cameras->up, count);
+	int ok = cameras->yaw != NULL && cameras->pitch != NULL && cameras->zoom != NULL &&
+		cameras->aspect != NULL && cameras->near != NULL && cameras->far != NULL &&
+		cameras->projection_mode != NULL && cameras->view != NULL && cameras->projection != NULL &&
+		cameras->view_projection != NULL && streams_ok;
+	if(!ok)
+	{
+		camera_array_free(cameras);
+		return 0;
+	}
+
+	cameras->count = count;
+	cameras->position.count = cameras->world_up.count = count;
+	cameras->front.count = cameras->right.count = cameras->up.count = count;
+	ts_camera camera;
+	camera_initialize(&camera, (vec3){0.0f, 0.0f, 0.0f});
+	for(size_t i = 0; i < count; i++)
+		camera_array_set(cameras, i, &camera);
+	camera_array_update(cameras);
+	return 1;
+}
+
+void camera_array_free(ts_camera_array *cameras)
+{
+	free(cameras->yaw);
+	free(cameras->pitch);
+	free(cameras->zoom);
+	free(cameras->aspect);
+	free(cameras->near);
+	free(cameras->far);
+	free(cameras->projection_mode);
+	free(cameras->view);
+	free(cameras->projection);
+	free(cameras->view_projection);
+	math_vec3_stream_free(&cameras->position);
+	math_vec3_stream_free(&cameras->world_up);
+	math_vec3_stream_free(&cameras->front);
+	math_vec3_stream_free(&cameras->right);
+	math_vec3_stream_free(&cameras->up);
+	memset(cameras, 0, sizeof(*cameras));
+}
+
+void camera_array_set(ts_camera_array *cameras, size_t index, ts_camera *camera)
+{
+	cameras->position.x[index] = camera->position[0];
+	cameras->position.y[index] = camera->position[1];
+	cameras->position.z[index] = camera->position[2];
+	cameras->world_up.x[index] = camera->world_up[0];
+	cameras->world_up.y[index] = camera->world_up[1];
+	cameras->world_up.z[index] = camera->world_up[2];
+	cameras->yaw[index] = camera->yaw;
+	cameras->pitch[index] = camera->pitch;
+	cameras->zoom[index] = camera->zoom;
+	cameras->aspect[index] = camera->aspect;
+	cameras->near[index] = camera->near;
+	cameras->far[index] = camera->far;
+	cameras->projection_mode[index] = camera->projection_mode;
+	cameras->projection_dirty = 1;
+}
+
+void camera_array_get(ts_camera_array *cameras, size_t index, ts_camera *camera)
+{
+	vec3 position = {cameras->position.x[index], cameras->position.y[index], cameras->position.z[index]};
+	vec3 world_up = {cameras->world_up.x[index], cameras->world_up.y[index], cameras->world_up.z[index]};
+	camera_initialize_full(camera, position, world_up, cameras->yaw[index], cameras->pitch[index], 0.0f, cameras->zoom[index]);
+	camera_set_projection(camera, cameras->aspect[index], cameras->near[index], cameras->far[index]);
+	camera_set_projection_mode(camera, cameras->projection_mode[index]);
+}
+
+static void camera_array_block(ts_camera_array *cameras, size_t first, size_t n, int projections)
+{
+	float yaw[CAMERA_ARRAY_BLOCK], pitch[CAMERA_ARRAY_BLOCK];
+	float sin_yaw[CAMERA_ARRAY_BLOCK], cos_yaw[CAMERA_ARRAY_BLOCK];
+	float sin_pitch[CAMERA_ARRAY_BLOCK], cos_pitch[CAMERA_ARRAY_BLOCK];
+	for(size_t j = 0; j < n; j++)
+	{
+		yaw[j] = deg_to_rad(cameras->yaw[first + j]);
+		pitch[j] = deg_to_rad(cameras->pitch[first + j]);
+	}
+	math_sincos_batch(sin_yaw, cos_yaw, yaw, n);
+	math_sincos_batch(sin_pitch, cos_pitch, pitch, n);
+
+	float *front_x = cameras->front.x + first;
+	float *front_y = cameras->front.y + first;
+	float *front_z = cameras->front.z + first;
+	float *right_x = cameras->right.x + first;
+	float *right_y = cameras->right.y + first;
+	float *right_z = cameras->right.z + first;
+	float *up_x = cameras->up.x + first;
+	float *up_y = cameras->up.y + first;
+	float *up_z = cameras->up.z + first;
+	const float *world_x = cameras->world_up.x + first;
+	const float *world_y = cameras->world_up.y + first;
+	const float *world_z = cameras->world_up.z + first;
+	for(size_t j = 0; j < n; j++)
+	{
+		front_x[j] = cos_yaw[j] * cos_pitch[j];
+		front_y[j] = sin_pitch[j];
+		front_z[j] = sin_yaw[j] * cos_pitch[j];
+	}
+	for(size_t j = 0; j < n; j++)
+	{
+		float x = front_y[j] * world_z[j] - front_z[j] * world_y[j];
+		float y = front_z[j] * world_x[j] - front_x[j] * world_z[j];
+		float z = front_x[j] * world_y[j] - front_y[j] * world_x[j];
+		float k = 1.0f / sqrtf(x * x + y * y + z * z);
+		right_x[j] = x * k;
+		right_y[j] = y * k;
+		right_z[j] = z * k;
+	}
+	for(size_t j = 0; j < n; j++)
+	{
+		up_x[j] = right_y[j] * front_z[j] - right_z[j] * front_y[j];
+		up_y[j] = right_z[j] * front_x[j] - right_x[j] * front_z[j];
+		up_z[j] = right_x[j] * front_y[j] - right_y[j] * front_x[j];
+	}
+
+	for(size_t j = 0; j < n; j++)
+	{
+		size_t i = first + j;
+		float px = cameras->position.x[i];
+		float py = cameras->position.y[i];
+		float pz = cameras->position.z[i];
+		mat4 *view = &cameras->view[i];
+		(*view)[0][0] = right_x[j];
+		(*view)[0][1] = up_x[j];
+		(*view)[0][2] = -front_x[j];
+		(*view)[0][3] = 0.0f;
+		(*view)[1][0] = right_y[j];
+		(*view)[1][1] = up_y[j];
+		(*view)[1][2] = -front_y[j];
+		(*view)[1][3] = 0.0f;
+		(*view)[2][0] = right_z[j];
+		(*view)[2][1] = up_z[j];
+		(*view)[2][2] = -front_z[j];
+		(*view)[2][3] = 0.0f;
+		(*view)[3][0] = -(right_x[j] * px + right_y[j] * py + right_z[j] * pz);
+		(*view)[3][1] = -(up_x[j] * px + up_y[j] * py + up_z[j] * pz);
+		(*view)[3][2] = front_x[j] * px + front_y[j] * py + front_z[j] * pz;
+		(*view)[3][3] = 1.0f;
+	}
+
+	if(projections)
+	{
+		for(size_t i = first; i < first + n; i++)
+		{
+			float fov = deg_to_rad(cameras->zoom[i]);
+			if(cameras->projection_mode[i] == CAMERA_PROJECTION_REVERSE)
+				math_perspective_reverse(cameras->projection[i], fov, cameras->aspect[i], cameras->near[i], cameras->far[i]);
+			else if(cameras->projection_mode[i] == CAMERA_PROJECTION_REVERSE_INFINITE)
+				math_perspective_reverse_infinite(cameras->projection[i], fov, cameras->aspect[i], cameras->near[i]);
+			else
+				math_perspective(cameras->projection[i], fov, cameras->aspect[i], cameras->near[i], cameras->far[i]);
+		}
+	}
+
+	for(size_t i = first; i < first + n; i++)
+		math_mat4_mul_perspective(cameras->view_projection[i], cameras->view[i], cameras->projection[i]);
+}
+
+void camera_array_update(ts_camera_array *cameras)
+{
+	long blocks = (long)((cameras->count + CAMERA_ARRAY_BLOCK - 1) / CAMERA_ARRAY_BLOCK);
+	int projections = cameras->projection_dirty;
+
+	//even with if() false a parallel region costs microseconds
+	if(blocks == 1)
+	{
+		camera_array_block(cameras, 0, cameras->count, projections);
+		cameras->projection_dirty = 0;
+		return;
+	}
+
+	CAMERA_ARRAY_PRAGMA(omp parallel for if(cameras->count > CAMERA_ARRAY_PARALLEL) schedule(static))
+	for(long b = 0; b < blocks; b++)
+	{
+		size_t first = (size_t)b * CAMERA_ARRAY_BLOCK;
+		size_t n = cameras->count - first < CAMERA_ARRAY_BLOCK ? cameras->count - first : CAMERA_ARRAY_BLOCK;
+		camera_array_block(cameras, first, n, projections);
+	}
+	cameras->projection_dirty = 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file camera_array.h
+ * @brief Many cameras at once
+ *
+ * For hundreds of views per frame (camera walls, thumbnails). The
+ * camera state is stored SoA and camera_array_update rebuilds the bases,
+ * views and view-projections of all of them in blocks: batched sincos,
+ * plain loops over the arrays, blocks split across threads (with
+ * -fopenmp). Matrices come out AoS, ready to upload. Cameras use Euler
+ * angles like ts_camera, roll isn't kept.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#ifndef CAMERA_ARRAY
+#define CAMERA_ARRAY
+
+#include "camera.h"
+
+typedef struct ts_camera_array
+{
+	size_t count;
+	//input, per camera. Write them directly, setting projection_dirty
+	//after touching zoom, aspect, near, far or projection_mode
+	vec3_stream position;
+	vec3_stream world_up;
+	float *yaw; //degrees
+	float *pitch;
+	float *zoom;
+	float *aspect;
+	float *near;
+	float *far;
+	int *projection_mode; //CAMERA_PROJECTION_*
+	int projection_dirty;
+	//output, per camera
+	vec3_stream front;
+	vec3_stream right;
+	vec3_stream up;
+	mat4 *view;
+	mat4 *projection;
+	mat4 *view_projection; //projection * view
+} ts_camera_array;
+
+/**
+ * Every camera starts like camera_initialize at the origin.
+ * @brief Allocate count cameras
+ * @param cameras (ts_camera_array*) the cameras, free them with camera_array_free
+ * @param count (size_t) cameras
+ * @return 0 when out of memory
+*/
+int camera_array_init(ts_camera_array *cameras, size_t count);
+
+void camera_array_free(ts_camera_array *cameras);
+
+//copy a ts_camera into slot index
+void camera_array_set(ts_camera_array *cameras, size_t index, ts_camera *camera);
+
+//copy slot index into a ts_camera, matrices are rebuilt when it needs them
+void camera_array_get(ts_camera_array *cameras, size_t index, ts_camera *camera);
+
+/**
+ * Projections are only rebuilt when projection_dirty is set.
+ * @brief Rebuild front/right/up and the matrices of every camera
+*/
+void camera_array_update(ts_camera_array *cameras);
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file camera_path.c
+ * @brief camera_path.h implementation
+ *
+ * Keys come at frame times, not evenly spaced, so the spline tangents
+ * are divided by the time between the neighbouring keys (non-uniform
+ * Catmull-Rom). Otherwise a slow frame would make the camera speed up
+ * around it.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "camera_path.h"
+
+#define CAMERA_PATH_VALUES 6 //interpolated floats per key
+#define CAMERA_KEY_BYTES 28
+
+static const char magic[4] = {'T', 'B', 'C', 'P'};
+
+void camera_path_init(ts_camera_path *path)
+{
+	memset(path, 0, sizeof(*path));
+}
+
+void camera_path_free(ts_camera_path *path)
+{
+	free(path->keys);
+	memset(path, 0, sizeof(*path));
+}
+
+int camera_path_record(ts_camera_path *path, ts_camera *camera, float time)
+{
+	if(path->count > 0 && time <= path->keys[path->count - 1].time)
+		return 1;
+	if(path->count == path->capacity)
+	{
+		uint32_t capacity = path->capacity ? path->capacity * 2 : 1024;
+		camera_key *keys = realloc(path->keys, capacity * sizeof(camera_key));
+		if(keys == NULL)
+			return 0;
+		path->keys = keys;
+		path->capacity = capacity;
+	}
+
+	camera_key *key = &path->keys[path->count++];
+	key->time = time;
+	key->position[0] = camera->position[0];
+	key->position[1] = camera->position[1];
+	key->position[2] = camera->position[2];
+	key->yaw = camera->yaw;
+	key->pitch = camera->pitch;
+	key->zoom = camera->zoom;
+	return 1;
+}
+
+static void put_u32(unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = (unsigned char)value;
+	bytes[1] = (unsigned char)(value >> 8);
+	bytes[2] = (unsigned char)(value >> 16);
+	bytes[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *bytes)
+{
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static void put_f32(unsigned char *bytes, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u32(bytes, bits);
+}
+
+static float get_f32(const unsigned char *bytes)
+{
+	uint32_t bits = get_u32(bytes);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static void key_values(const camera_key *key, float values[CAMERA_PATH_VALUES])
+{
+	values[0] = key->position[0];
+	values[1] = key->position[1];
+	values[2] = key->position[2];
+	values[3] = key->yaw;
+	values[4] = key->pitch;
+	values[5] = key->zoom;
+}
+
+int camera_path_save(const ts_camera_path *path, const char *filename)
+{
+	FILE *file = fopen(filename, "wb");
+	if(file == NULL)
+		return 0;
+
+	unsigned char header[12];
+	memcpy(header, magic, sizeof(magic));
+	put_u32(header + 4, CAMERA_PATH_VERSION);
+	put_u32(header + 8, path->count);
+	int ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+	for(uint32_t i = 0; ok && i < path->count; i++)
+	{
+		unsigned char bytes[CAMERA_KEY_BYTES];
+		float values[CAMERA_PATH_VALUES];
+		key_values(&path->keys[i], values);
+		put_f32(bytes, path->keys[i].time);
+		for(int v = 0; v < CAMERA_PATH_VALUES; v++)
+			put_f32(bytes + 4 + 4 * v, values[v]);
+		ok = fwrite(bytes, sizeof(bytes), 1, file) == 1;
+	}
+
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+int camera_path_load(ts_camera_path *path, const char *filename)
+{
+	camera_path_init(path);
+	FILE *file = fopen(filename, "rb");
+	if(file == NULL)
+		return 0;
+
+	unsigned char header[12];
+	int ok = fread(header, sizeof(header), 1, file) == 1 && memcmp(header, magic, sizeof(magic)) == 0 &&
+		get_u32(header + 4) == CAMERA_PATH_VERSION;
+	uint32_t count = ok ? get_u32(header + 8) : 0;
+	//nothing to play back
+	ok = ok && count > 0;
+
+	//a corrupted count can't ask for more keys than the file holds
+	if(ok)
+	{
+		long start = ftell(file);
+		ok = start >= 0 && fseek(file, 0, SEEK_END) == 0;
+		long end = ok ? ftell(file) : -1;
+		ok = ok && end >= start && (uint64_t)(end - start) >= (uint64_t)count * CAMERA_KEY_BYTES &&
+			fseek(file, start, SEEK_SET) == 0;
+	}
+	if(ok)
+	{
+		path->keys = malloc((size_t)count * sizeof(camera_key));
+		ok = path->keys != NULL;
+		path->capacity = ok ? count : 0;
+	}
+
+	for(uint32_t i = 0; ok && i < count; i++)
+	{
+		unsigned char bytes[CAMERA_KEY_BYTES];
+		ok = fread(bytes, sizeof(bytes), 1, file) == 1;
+		if(ok)
+		{
+			camera_key *key = &path->keys[i];
+			key->time = get_f32(bytes);
+			key->position[0] = get_f32(bytes + 4);
+			key->position[1] = get_f32(bytes + 8);
+			key->position[2] = get_f32(bytes + 12);
+			key->yaw = get_f32(bytes + 16);
+			key->pitch = get_f32(bytes + 20);
+			key->zoom = get_f32(bytes + 24);
+			ok = i == 0 || key->time > path->keys[i - 1].time;
+			path->count = i + 1;
+		}
+	}
+
+	fclose(file);
+	if(!ok)
+		camera_path_free(path);
+	return ok;
+}
+
+float camera_path_duration(const ts_camera_path *path)
+{
+	return path->count > 0 ? path->keys[path->count - 1].time : 0.0f;
+}
+
+void camera_path_sample(const ts_camera_path *path, float time, ts_camera *camera)
+{
+	if(path->count == 0)
+		return;
+
+	float values[CAMERA_PATH_VALUES];
+	const camera_key *keys = path->keys;
+	uint32_t last = path->count - 1;
+
+	if(time <= keys[0].time || last == 0)
+		key_values(&keys[0], values);
+	else if(time >= keys[last].time)
+		key_values(&keys[last], values);
+	else
+	{
+		//segment i to i + 1 holding time
+		uint32_t lo = 0;
+		uint32_t hi = last;
+		while(hi - lo > 1)
+		{
+			uint32_t mid = (lo + hi) / 2;
+			if(keys[mid].time <= time)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		//ends reuse their own key as the missing neighbour
+		const camera_key *k0 = &keys[lo > 0 ? lo - 1 : lo];
+		const camera_key *k1 = &keys[lo];
+		const camera_key *k2 = &keys[hi];
+		const camera_key *k3 = &keys[hi < last ? hi + 1 : hi];
+		float p0[CAMERA_PATH_VALUES], p1[CAMERA_PATH_VALUES], p2[CAMERA_PATH_VALUES], p3[CAMERA_PATH_VALUES];
+		key_values(k0, p0);
+		key_values(k1, p1);
+		key_values(k2, p2);
+		key_values(k3, p3);
+
+		float h = k2->time - k1->time;
+		float u = (time - k1->time) / h;
+		float u2 = u * u;
+		float u3 = u2 * u;
+		float h00 = 2.0f * u3 - 3.0f * u2 + 1.0f;
+		float h10 = (u3 - 2.0f * u2 + u) * h;
+		float h01 = 3.0f * u2 - 2.0f * u3;
+		float h11 = (u3 - u2) * h;
+		float span1 = k2->time - k0->time;
+		float span2 = k3->time - k1->time;
+		for(int v = 0; v < CAMERA_PATH_VALUES; v++)
+		{
+			float m1 = (p2[v] - p0[v]) / span1;
+			float m2 = (p3[v] - p1[v]) / span2;
+			values[v] = h00 * p1[v] + h10 * m1 + h01 * p2[v] + h11 * m2;
+		}
+	}
+
+	camera_set_position(camera, values);
+	camera_set_angles(camera, values[3], values[4], camera->roll);
+	camera_set_zoom(camera, values[5]);
+}
@@ -0,0 +1,93 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file camera_path.h
+ * @brief Camera path recording and playback
+ *
+ * Records the camera (position, yaw, pitch, zoom) with a timestamp every
+ * frame and plays it back at any time with a Catmull-Rom spline through
+ * the keys. Playing back at a fixed timestep gives the same frames on
+ * every run, whatever the frame rate, for fly-through benchmarks.
+ *
+ * File: "TBCP", uint32 version, uint32 key count, then the keys as
+ * 7 floats each (time, position xyz, yaw, pitch, zoom). Everything is
+ * little endian.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#ifndef CAMERA_PATH
+#define CAMERA_PATH
+
+#include "camera.h"
+
+#define CAMERA_PATH_VERSION 1
+#define CAMERA_PATH_STEP (1.0f / 60.0f) //playback timestep, in seconds
+
+typedef struct camera_key
+{
+	float time; //seconds, increasing
+	float position[3];
+	float yaw;
+	float pitch;
+	float zoom;
+} camera_key;
+
+typedef struct ts_camera_path
+{
+	camera_key *keys;
+	uint32_t count;
+	uint32_t capacity;
+} ts_camera_path;
+
+//empty path, ready for camera_path_record
+void camera_path_init(ts_camera_path *path);
+
+void camera_path_free(ts_camera_path *path);
+
+/**
+ * Keys that don't move forward in time are dropped.
+ * @brief Add the camera's current state to the path
+ * @param path (ts_camera_path*) the path
+ * @param camera (ts_camera*) the camera
+ * @param time (float) seconds since the recording started
+ * @return 0 when out of memory
+*/
+int camera_path_record(ts_camera_path *path, ts_camera *camera, float time);
+
+/**
+ * @brief Write the path to a file
+ * @return 0 if the file couldn't be written
+*/
+int camera_path_save(const ts_camera_path *path, const char *filename);
+
+/**
+ * @brief Read a path written by camera_path_save
+ * @param path (ts_camera_path*) the path, free it with camera_path_free
+ * @return 0 if the file is missing, not a path, has no keys, is shorter
+ * than its key count says or out of memory
+*/
+int camera_path_load(ts_camera_path *path, const char *filename);
+
+//time of the last key
+float camera_path_duration(const ts_camera_path *path);
+
+/**
+ * Times before the first key or after the last one hold that key. An
+ * empty path leaves the camera alone.
+ * @brief Put the camera where the path is at a given time
+ * @param path (ts_camera_path*) the path
+ * @param time (float) seconds
+ * @param camera (ts_camera*) the camera
+*/
+void camera_path_sample(const ts_camera_path *path, float time, ts_camera *camera);
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file hierarchy.c
+ * @brief hierarchy.h implementation
+ *
+ * An update goes down one level at a time. A level's work list is the
+ * children of the previous level's list plus the nodes flagged on this
+ * level, the dirty flags keep every slot in at most one list. Levels
+ * with nothing to do are skipped.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "hierarchy.h"
+
+#define HIERARCHY_PARALLEL 4096 //levels with fewer changes than this stay on one thread
+#define HIERARCHY_SCAN 64 //flags on more than 1 / this of the nodes are sorted by a scan
+
+#ifdef _OPENMP
+	#define HIERARCHY_PRAGMA(x) _Pragma(#x)
+#else
+	#define HIERARCHY_PRAGMA(x)
+#endif
+
+int hierarchy_init(ts_hierarchy *tree, const uint32_t *parents, size_t count)
+{
+	memset(tree, 0, sizeof(*tree));
+	size_t bytes = (count + 1) * sizeof(uint32_t);
+
+	uint32_t *offsets = malloc(bytes + sizeof(uint32_t));
+	uint32_t *children = malloc(bytes);
+	tree->levels = malloc(bytes);
+	tree->parents = malloc(bytes);
+	tree->first_child = malloc(bytes);
+	tree->child_count = malloc(bytes);
+	tree->slots = malloc(bytes);
+	tree->nodes = malloc(bytes);
+	tree->dirty_list = malloc(bytes);
+	tree->queue = malloc(bytes);
+	tree->dirty = calloc(count + 1, 1);
+	tree->world = malloc((count + 1) * sizeof(mat4x3));
+	int streams_ok = math_vec3_stream_alloc(&tree->translation, count) &&
+		math_vec4_stream_alloc(&tree->rotation, count) && math_vec3_stream_alloc(&tree->scale, count);
+	int ok = offsets != NULL && children != NULL && tree->levels != NULL && tree->parents != NULL &&
+		tree->first_child != NULL && tree->child_count != NULL && tree->slots != NULL &&
+		tree->nodes != NULL && tree->dirty_list != NULL && tree->queue != NULL &&
+		tree->dirty != NULL && tree->world != NULL && streams_ok;
+
+	for(size_t i = 0; ok && i < count; i++)
+		ok = parents[i] == HIERARCHY_NONE || parents[i] < count;
+
+	if(ok)
+	{
+		//children of every node, in node order
+		memset(offsets, 0, bytes + sizeof(uint32_t));
+		for(size_t i = 0; i < count; i++)
+			if(parents[i] != HIERARCHY_NONE)
+				offsets[parents[i] + 2]++;
+		for(size_t i = 2; i < count + 2; i++)
+			offsets[i] += offsets[i - 1];
+		for(size_t i = 0; i < count; i++)
+			if(parents[i] != HIERARCHY_NONE)
+				children[offsets[parents[i] + 1]++] = (uint32_t)i;
+
+		//breadth first: roots, then the children of each slot in turn
+		uint32_t end = 0;
+		for(size_t i = 0; i < count; i++)
+		{
+			if(parents[i] == HIERARCHY_NONE)
+			{
+				tree->parents[end] = HIERARCHY_NONE;
+				tree->nodes[end++] = (uint32_t)i;
+			}
+		}
+		tree->levels[0] = 0;
+		for(uint32_t level_first = 0; level_first < end;)
+		{
+			uint32_t level_end = end;
+			tree->levels[++tree->level_count] = level_end;
+			for(uint32_t s = level_first; s < level_end; s++)
+			{
+				uint32_t node = tree->nodes[s];
+				tree->first_child[s] = end;
+				tree->child_count[s] = offsets[node + 1] - offsets[node];
+				for(uint32_t c = offsets[node]; c < offsets[node + 1]; c++)
+				{
+					tree->parents[end] = s;
+					tree->nodes[end++] = children[c];
+				}
+			}
+			level_first = level_end;
+		}
+		//nodes on a cycle are never reached from a root
+		ok = end == count;
+	}
+
+	if(ok)
+	{
+		tree->count = (uint32_t)count;
+		tree->translation.count = tree->rotation.count = tree->scale.count = count;
+		for(uint32_t s = 0; s < count; s++)
+		{
+			tree->slots[tree->nodes[s]] = s;
+			tree->translation.x[s] = tree->translation.y[s] = tree->translation.z[s] = 0.0f;
+			tree->rotation.x[s] = tree->rotation.y[s] = tree->rotation.z[s] = 0.0f;
+			tree->rotation.w[s] = 1.0f;
+			tree->scale.x[s] = tree->scale.y[s] = tree->scale.z[s] = 1.0f;
+			math_mat4x3_identity(tree->world[s]);
+		}
+	}
+
+	free(offsets);
+	free(children);
+	if(!ok)
+		hierarchy_free(tree);
+	return ok;
+}
+
+void hierarchy_free(ts_hierarchy *tree)
+{
+	free(tree->levels);
+	free(tree->parents);
+	free(tree->first_child);
+	free(tree->child_count);
+	free(tree->slots);
+	free(tree->nodes);
+	free(tree->dirty_list);
+	free(tree->queue);
+	free(tree->dirty);
+	free(tree->world);
+	math_vec3_stream_free(&tree->translation);
+	math_vec4_stream_free(&tree->rotation);
+	math_vec3_stream_free(&tree->scale);
+	memset(tree, 0, sizeof(*tree));
+}
+
+static uint32_t hierarchy_touch(ts_hierarchy *tree, uint32_t node)
+{
+	uint32_t slot = tree->slots[node];
+	if(!tree->dirty[slot])
+	{
+		tree->dirty[slot] = 1;
+		tree->dirty_list[tree->dirty_count++] = slot;
+	}
+	return slot;
+}
+
+void hierarchy_set_translation(ts_hierarchy *tree, uint32_t node, vec3 translation)
+{
+	uint32_t slot = hierarchy_touch(tree, node);
+	tree->translation.x[slot] = translation[0];
+	tree->translation.y[slot] = translation[1];
+	tree->translation.z[slot] = translation[2];
+}
+
+void hierarchy_set_rotation(ts_hierarchy *tree, uint32_t node, quat rotation)
+{
+	uint32_t slot = hierarchy_touch(tree, node);
+	tree->rotation.x[slot] = rotation[0];
+	tree->rotation.y[slot] = rotation[1];
+	tree->rotation.z[slot] = rotation[2];
+	tree->rotation.w[slot] = rotation[3];
+}
+
+void hierarchy_set_scale(ts_hierarchy *tree, uint32_t node, vec3 scale)
+{
+	uint32_t slot = hierarchy_touch(tree, node);
+	tree->scale.x[slot] = scale[0];
+	tree->scale.y[slot] = scale[1];
+	tree->scale.z[slot] = scale[2];
+}
+
+void hierarchy_set_local(ts_hierarchy *tree, uint32_t node, vec3 translation, quat rotation, vec3 scale)
+{
+	hierarchy_set_translation(tree, node, translation);
+	hierarchy_set_rotation(tree, node, rotation);
+	hierarchy_set_scale(tree, node, scale);
+}
+
+static int compare_slots(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+//last level starting at or before slot
+static uint32_t hierarchy_level(const ts_hierarchy *tree, uint32_t slot)
+{
+	uint32_t lo = 0;
+	uint32_t hi = tree->level_count - 1;
+	while(lo < hi)
+	{
+		uint32_t mid = (lo + hi + 1) / 2;
+		if(tree->levels[mid] <= slot)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+//parents are a level up, so they are done by now
+static void hierarchy_world(ts_hierarchy *tree, uint32_t slot)
+{
+	mat4x3 local;
+	vec3 translation = {tree->translation.x[slot], tree->translation.y[slot], tree->translation.z[slot]};
+	quat rotation = {tree->rotation.x[slot], tree->rotation.y[slot], tree->rotation.z[slot], tree->rotation.w[slot]};
+	vec3 scale = {tree->scale.x[slot], tree->scale.y[slot], tree->scale.z[slot]};
+	math_mat4x3_compose(local, translation, rotation, scale);
+
+	uint32_t parent = tree->parents[slot];
+	if(parent == HIERARCHY_NONE)
+		math_mat4x3_copy(tree->world[slot], local);
+	else
+		math_mat4x3_mul(tree->world[slot], local, tree->world[parent]);
+}
+
+uint32_t hierarchy_update(ts_hierarchy *tree)
+{
+	if(tree->dirty_count == 0)
+		return 0;
+
+	//slots go level by level, so sorted flags come grouped by level. With
+	//lots of them a pass over the flags sorts quicker than qsort
+	if(tree->dirty_count > tree->count / HIERARCHY_SCAN)
+	{
+		uint32_t n = 0;
+		for(uint32_t s = 0; s < tree->count; s++)
+			if(tree->dirty[s])
+				tree->dirty_list[n++] = s;
+	}
+	else
+		qsort(tree->dirty_list, tree->dirty_count, sizeof(uint32_t), compare_slots);
+
+	uint32_t *queue = tree->queue;
+	uint32_t done = 0;
+	uint32_t next = 0;
+	uint32_t above_first = 0;
+	uint32_t above_end = 0;
+	uint32_t level = hierarchy_level(tree, tree->dirty_list[0]);
+	while(level < tree->level_count)
+	{
+		uint32_t first = done;
+		for(uint32_t q = above_first; q < above_end; q++)
+		{
+			uint32_t slot = queue[q];
+			for(uint32_t c = tree->first_child[slot]; c < tree->first_child[slot] + tree->child_count[slot]; c++)
+			{
+				if(!tree->dirty[c])
+				{
+					tree->dirty[c] = 1;
+					queue[done++] = c;
+				}
+			}
+		}
+		while(next < tree->dirty_count && tree->dirty_list[next] < tree->levels[level + 1])
+			queue[done++] = tree->dirty_list[next++];
+
+		HIERARCHY_PRAGMA(omp parallel for if(done - first > HIERARCHY_PARALLEL) schedule(static))
+		for(long q = first; q < (long)done; q++)
+			hierarchy_world(tree, queue[q]);
+
+		above_first = first;
+		above_end = done;
+		if(first < done)
+			level++;
+		else if(next < tree->dirty_count)
+			level = hierarchy_level(tree, tree->dirty_list[next]);
+		else
+			break;
+	}
+
+	for(uint32_t q = 0; q < done; q++)
+		tree->dirty[queue[q]] = 0;
+	tree->dirty_count = 0;
+	return done;
+}
+
+void hierarchy_get_world(ts_hierarchy *tree, uint32_t node, mat4x3 world)
+{
+	math_mat4x3_copy(world, tree->world[tree->slots[node]]);
+}
+
+void hierarchy_bounds(ts_hierarchy *tree, aabb *world, aabb *subtree, const aabb *local)
+{
+	math_aabb_transform_batch(world, local, tree->world, tree->count);
+	if(subtree == NULL || tree->count == 0)
+		return;
+	if(subtree != world)
+		memcpy(subtree, world, tree->count * sizeof(aabb));
+
+	//children are a level down and next to each other
+	for(long level = (long)tree->level_count - 2; level >= 0; level--)
+	{
+		uint32_t first = tree->levels[level];
+		uint32_t end = tree->levels[level + 1];
+		HIERARCHY_PRAGMA(omp parallel for if(end - first > HIERARCHY_PARALLEL) schedule(static))
+		for(long s = first; s < (long)end; s++)
+			for(uint32_t c = tree->first_child[s]; c < tree->first_child[s] + tree->child_count[s]; c++)
+				math_aabb_merge(&subtree[s], &subtree[s], &subtree[c]);
+	}
+}
@@ -0,0 +1,98 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file hierarchy.h
+ * @brief Scene transform hierarchy
+ *
+ * Nodes have a local translation, rotation and scale (stored SoA) and a
+ * world matrix (mat4x3) that is parent world * local. Internally nodes
+ * sit in breadth-first slots: every depth level is one run of slots and
+ * the children of a node are next to each other in the next level.
+ * Setters flag nodes dirty, hierarchy_update then recomputes only the
+ * flagged nodes and everything under them, one level at a time, big
+ * levels split across threads (with -fopenmp). Cost follows the number
+ * of changed nodes, not the size of the scene.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#ifndef HIERARCHY
+#define HIERARCHY
+
+#include "3d_math.h"
+
+#define HIERARCHY_NONE UINT32_MAX
+
+typedef struct ts_hierarchy
+{
+	uint32_t count;
+	uint32_t level_count;
+	uint32_t *levels; //level d is slots levels[d] to levels[d + 1]
+	uint32_t *parents; //per slot, parent slot or HIERARCHY_NONE
+	uint32_t *first_child; //per slot, children are first_child..first_child + child_count
+	uint32_t *child_count;
+	uint32_t *slots; //node -> slot
+	uint32_t *nodes; //slot -> node
+	vec3_stream translation; //local TRS per slot
+	vec4_stream rotation;
+	vec3_stream scale;
+	mat4x3 *world; //per slot
+	uint8_t *dirty; //per slot
+	uint32_t *dirty_list; //slots flagged since the last update
+	uint32_t dirty_count;
+	uint32_t *queue; //update scratch
+} ts_hierarchy;
+
+/**
+ * Nodes are 0..count - 1, parents[i] is the parent of node i (any index)
+ * or HIERARCHY_NONE for roots. Starts with identity transforms.
+ * @brief Build the hierarchy
+ * @param tree (ts_hierarchy*) the hierarchy, free it with hierarchy_free
+ * @param parents (const uint32_t*) parent per node
+ * @param count (size_t) nodes
+ * @return 0 when out of memory or parents has a cycle or a bad index
+*/
+int hierarchy_init(ts_hierarchy *tree, const uint32_t *parents, size_t count);
+
+void hierarchy_free(ts_hierarchy *tree);
+
+/*
+ * Setters flag the node for the next hierarchy_update. Not thread safe,
+ * set from one thread.
+*/
+
+void hierarchy_set_local(ts_hierarchy *tree, uint32_t node, vec3 translation, quat rotation, vec3 scale);
+
+void hierarchy_set_translation(ts_hierarchy *tree, uint32_t node, vec3 translation);
+
+void hierarchy_set_rotation(ts_hierarchy *tree, uint32_t node, quat rotation);
+
+void hierarchy_set_scale(ts_hierarchy *tree, uint32_t node, vec3 scale);
+
+/**
+ * @brief Recompute world matrices of flagged nodes and their subtrees
+ * @return how many world matrices were recomputed
+*/
+uint32_t hierarchy_update(ts_hierarchy *tree);
+
+void hierarchy_get_world(ts_hierarchy *tree, uint32_t node, mat4x3 world);
+
+/**
+ * Arrays are per slot (tree->nodes[slot] is the node). world gets each
+ * local box through its world matrix, subtree (may be NULL, or world)
+ * also grows it by everything under the slot, to cull whole branches at
+ * once. Nodes without geometry can have an empty box. Call after
+ * hierarchy_update. Deepest level first, big levels across threads.
+ * @brief World bounds of every node and of its subtree
+*/
+void hierarchy_bounds(ts_hierarchy *tree, aabb *world, aabb *subtree, const aabb *local);
+
+#endif
@@ -18,10 +18,12 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include "gl.h"
 #include "3d_math.h"
 #include "camera.h"
+#include "camera_path.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -64,26 +66,112 @@ unsigned int load_texture(char const *path)
 	return texture_id;
 }
 
+//relative mouse motion waiting for the next camera update
+typedef struct mouse_motion
+{
+	int x;
+	int y;
+	int events;
+	Uint32 oldest; //timestamp of the first event, in SDL_GetTicks ms
+} mouse_motion;
+
+static void mouse_motion_add(mouse_motion *motion, const SDL_MouseMotionEvent *event)
+{
+	if(motion->events++ == 0)
+		motion->oldest = event->timestamp;
+	motion->x += event->xrel;
+	motion->y += event->yrel;
+}
+
+//motion that came in after the event loop, taken right before drawing
+static void mouse_motion_late(mouse_motion *motion)
+{
+	SDL_Event events[64];
+	int count;
+	SDL_PumpEvents();
+	while((count = SDL_PeepEvents(events, 64, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION)) > 0)
+		for(int i = 0; i < count; i++)
+			mouse_motion_add(motion, &events[i].motion);
+}
+
+//glClipControl is GL 4.5 (or ARB_clip_control), past what gl.h loads
+#define GL_ZERO_TO_ONE 0x935F
+typedef void (GLAD_API_PTR *clip_control_proc)(GLenum origin, GLenum depth);
+
+//reverse-Z needs a float depth buffer, which the window can't have, so
+//the scene goes to this framebuffer and is blitted to the window
+typedef struct depth_target
+{
+	unsigned int framebuffer;
+	unsigned int color;
+	unsigned int depth;
+} depth_target;
+
+static bool reverse_z_setup(depth_target *target, int version, int width, int height)
+{
+	bool has_clip_control = GLAD_VERSION_MAJOR(version) > 4 ||
+		(GLAD_VERSION_MAJOR(version) == 4 && GLAD_VERSION_MINOR(version) >= 5) ||
+		SDL_GL_ExtensionSupported("GL_ARB_clip_control");
+	clip_control_proc clip_control = (clip_control_proc)SDL_GL_GetProcAddress("glClipControl");
+	if(!has_clip_control || clip_control == NULL)
+		return false;
+
+	glGenFramebuffers(1, &target->framebuffer);
+	glGenRenderbuffers(1, &target->color);
+	glGenRenderbuffers(1, &target->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &target->framebuffer);
+		glDeleteRenderbuffers(1, &target->color);
+		glDeleteRenderbuffers(1, &target->depth);
+		return false;
+	}
+
+	//depth [0, 1] instead of [-1, 1], near is 1 and far 0
+	clip_control(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+	glClearDepth(0.0);
+	glDepthFunc(GL_GREATER);
+	return true;
+}
+
 //non commercial
 const char *vertexshadersource = "#version 330 core\n"
 		"layout (location = 0) in vec3 aPos;\n"
-		"layout (location = 1) in vec3 aNormal;\n"
-		"layout (location = 2) in vec2 aTexCoords;\n"
+		"layout (location = 1) in vec2 aNormal; //octahedral, raw snorm16\n"
+		"layout (location = 2) in vec2 aTexCoords; //raw snorm16\n"
 		"out VS_OUT\n"
 		"{\n"
 		"	vec3 FragPos;\n"
 		"	vec3 Normal;\n"
 		"	vec2 TexCoords;\n"
 		"} vs_out;\n"
-		"uniform mat4 projection;\n"
-		"uniform mat4 view;\n"
+		"uniform mat4 view_projection;\n"
+		"uniform mat4x3 model;\n"
+		"uniform mat4 normal_matrix;\n"
+		"uniform float uv_scale;\n"
+		"\n"
+		"vec3 oct_decode(vec2 e)\n"
+		"{\n"
+		"	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+		"	float t = max(-v.z, 0.0);\n"
+		"	v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));\n"
+		"	return normalize(v);\n"
+		"}\n"
 		"\n"
 		"void main()\n"
 		"{\n"
-		"	vs_out.FragPos = aPos;\n"
-		"	vs_out.Normal = aNormal;\n"
-		"	vs_out.TexCoords = aTexCoords;\n"
-		"	gl_Position = projection * view * vec4(aPos, 1.0);\n"
+		"	vs_out.FragPos = model * vec4(aPos, 1.0);\n"
+		"	vs_out.Normal = mat3(normal_matrix) * oct_decode(aNormal * (1.0 / 32767.0));\n"
+		"	vs_out.TexCoords = aTexCoords * (uv_scale / 32767.0);\n"
+		"	gl_Position = view_projection * vec4(vs_out.FragPos, 1.0);\n"
 		"}\0";
 
 //non commercial
@@ -119,9 +207,37 @@ const char *fragshadersource = "#version 330 core\n"
 		"	FragColor = vec4(ambient + diffuse + specular, 1.0);\n"
 		"}\0";
 
-int main()
+/**
+ * ./TinyBlinnPhongGL [--record FILE | --play FILE] [--standard-z]
+ * --record saves the camera path flown with the mouse when the program
+ * exits, --play flies it again at a fixed timestep (no mouse), logs the
+ * frame times and exits at the end of the path. --standard-z turns off
+ * the reverse-Z infinite projection (also off without glClipControl).
+*/
+int main(int argc, char *argv[])
 {
 	SDL_Window *window;
+
+	const char *record_file = NULL;
+	const char *play_file = NULL;
+	bool reverse_z = true;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			record_file = argv[++i];
+		else if(strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+			play_file = argv[++i];
+		else if(strcmp(argv[i], "--standard-z") == 0)
+			reverse_z = false;
+	}
+
+	ts_camera_path path;
+	camera_path_init(&path);
+	if(play_file != NULL && !camera_path_load(&path, play_file))
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "ERROR: can't load camera path %s (missing, not a path or empty)", play_file);
+		return -1;
+	}
 	
 	if(SDL_Init(SDL_INIT_EVERYTHING) < 0)
 	{
@@ -153,22 +269,37 @@ int main()
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	depth_target target = {0};
+	if(reverse_z)
+		reverse_z = reverse_z_setup(&target, version, 800, 600);
+	SDL_LogInfo(SDL_LOG_CATEGORY_TEST, reverse_z ? "Reverse-Z, no far plane." : "Standard depth.");
+
 	ts_camera camera;
 	vec3 cam_pos;
 	cam_pos[0] = 0.0f;
 	cam_pos[1] = 0.0f;
 	cam_pos[2] = -3.0f;
 	camera_initialize(&camera, cam_pos);
-	float last_x = 800 / 2.0f;
-	float last_y = 600 / 2.0f;
-	int mouse_x = last_x;
-	int mouse_y = last_y;
-	bool first_mouse = true;
+	camera_set_projection(&camera, 800.0f / 600.0f, 0.1f, 100.0f);
+	if(reverse_z)
+		camera_set_projection_mode(&camera, CAMERA_PROJECTION_REVERSE_INFINITE);
+	//high polling rate mice send hundreds of events per frame, they are
+	//summed up and turned into one camera update
+	mouse_motion motion = {0};
 
 	//timing
 	float delta_time = 0.0f;
 	float last_frame = 0.0f;
 
+	//frame stats, logged every second. Latency goes from the oldest mouse
+	//event used in a frame to that frame's swap
+	Uint32 stats_start = SDL_GetTicks();
+	Uint32 stats_frames = 0;
+	Uint32 stats_events = 0;
+	Uint32 stats_latency_sum = 0;
+	Uint32 stats_latency_max = 0;
+	Uint32 stats_latency_count = 0;
+
 	unsigned int vertex_shader;
 	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(vertex_shader, 1, &vertexshadersource, NULL);
@@ -236,25 +367,44 @@ int main()
 		 10.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,  10.0f, 10.0f
 	};
 
+	//16 bytes per vertex instead of 32: half positions, octahedral normals,
+	//texcoords as snorm16 of uv / plane_uv_scale (decoded in the shader)
+	const float plane_uv_scale = 10.0f;
+	vertex_packed plane_packed[6];
+	math_pack_vertices(plane_packed, planeVertices, planeVertices + 3, planeVertices + 6, 8, plane_uv_scale, 6);
+
 	// plane VAO
 	unsigned int planeVAO, planeVBO;
 	glGenVertexArrays(1, &planeVAO);
 	glGenBuffers(1, &planeVBO);
 	glBindVertexArray(planeVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(plane_packed), plane_packed, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(vertex_packed), (void*)offsetof(vertex_packed, position));
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(vertex_packed), (void*)offsetof(vertex_packed, normal));
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_FALSE, sizeof(vertex_packed), (void*)offsetof(vertex_packed, texcoord));
 	glBindVertexArray(0);
 
 	unsigned int floor_texture = load_texture("wood floor 2.png");
 
+	//the plane doesn't move, so its matrices are only built once
+	mat4x3 plane_model;
+	math_mat4x3_identity(plane_model);
+	mat4 plane_normal_matrix;
+	math_mat4x3_to_mat4(plane_normal_matrix, plane_model);
+	math_mat4_normal_matrix(plane_normal_matrix, plane_normal_matrix);
+	//world space bounds, the model is identity
+	vec3 plane_center = {0.0f, -0.5f, 0.0f};
+	vec3 plane_extent = {10.0f, 0.0f, 10.0f};
+
 	glUseProgram(shader_program);
 	glUniform1i(glGetUniformLocation(shader_program, "floortexture"), 0);
+	glUniform1f(glGetUniformLocation(shader_program, "uv_scale"), plane_uv_scale);
+	int view_projection_location = glGetUniformLocation(shader_program, "view_projection");
+	vec4 frustum[6];
 
 	vec3 light_pos;
 	light_pos[0] = 0.0f;
@@ -264,6 +414,10 @@ int main()
 	SDL_Event event;
 	bool playing = true;
 
+	//playback goes by frame count, not by the clock
+	Uint32 path_frame = 0;
+	Uint32 path_start = SDL_GetTicks();
+
 	while(playing)
 	{
 		float currentframe = (float)SDL_GetTicks();
@@ -281,23 +435,7 @@ int main()
 				}
 			}
 			if(event.type == SDL_MOUSEMOTION)
-			{
-				if(first_mouse)
-				{
-					last_x = mouse_x;
-					last_y = mouse_y;
-					first_mouse = false;
-				}
-
-				mouse_x += event.motion.xrel;
-				mouse_y += event.motion.yrel;
-				float x_offset = mouse_x - last_x;
-				float y_offset = last_y - mouse_y;
-				last_x = mouse_x;
-				last_y = mouse_y;
-
-				camera_freecam(&camera, x_offset, y_offset, 0);
-			}
+				mouse_motion_add(&motion, &event.motion);
 			if(event.type == SDL_QUIT)
 			{
 				SDL_LogInfo(SDL_LOG_CATEGORY_TEST, "Exiting due to other exit input.");
@@ -306,35 +444,109 @@ int main()
 			}
 		}
 
+		if(reverse_z)
+			glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//draw objects
 		glUseProgram(shader_program);
-		mat4 projection;
-		math_perspective(projection, deg_to_rad(camera.zoom), 800 / 600, 0.1f, 100.0f);
-		mat4 view;
-		camera_get_view_matrix(&camera, view);
-		glUniformMatrix4fv(glGetUniformLocation(shader_program, "projection"), 1, GL_FALSE, &projection[0][0]);
-		glUniformMatrix4fv(glGetUniformLocation(shader_program, "view"), 1, GL_FALSE, &view[0][0]);
-		
+
+		mouse_motion_late(&motion);
+		Uint32 input_time = motion.oldest;
+		int input_events = motion.events;
+		if(play_file != NULL)
+		{
+			float path_time = path_frame++ * CAMERA_PATH_STEP;
+			if(path_time > camera_path_duration(&path))
+			{
+				Uint32 elapsed = SDL_GetTicks() - path_start;
+				SDL_LogInfo(SDL_LOG_CATEGORY_TEST, "Camera path done: %u frames in %u ms, %.3f ms/frame",
+					path_frame - 1, elapsed, elapsed / (double)(path_frame - 1));
+				break;
+			}
+			camera_path_sample(&path, path_time, &camera);
+			input_events = 0;
+		}
+		else if(input_events > 0)
+			camera_freecam(&camera, (float)motion.x, (float)-motion.y, 0);
+		if(record_file != NULL && !camera_path_record(&path, &camera, (SDL_GetTicks() - path_start) / 1000.0f))
+			SDL_LogError(SDL_LOG_CATEGORY_ERROR, "ERROR: out of memory recording the camera path");
+		motion = (mouse_motion){0};
+
+		//the program only has this camera, so while it stays still the
+		//uniforms and frustum from the last change are still good
+		if(camera_update_matrices(&camera))
+		{
+			glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, &camera.view_projection[0][0]);
+			glUniform3fv(glGetUniformLocation(shader_program, "view_pos"), 1, &camera.position[0]);
+			//skip whatever is outside the view
+			math_frustum_planes(frustum, camera.view_projection);
+		}
+
 		//light uniforms
-		glUniform3fv(glGetUniformLocation(shader_program, "view_pos"), 1, &camera.position[0]);
 		glUniform3fv(glGetUniformLocation(shader_program, "light_pos"), 1, &light_pos[0]);
-		
+
 		//floor
-		glBindVertexArray(planeVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, floor_texture);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		if(math_frustum_test_aabb(frustum, plane_center, plane_extent))
+		{
+			glUniformMatrix4x3fv(glGetUniformLocation(shader_program, "model"), 1, GL_FALSE, &plane_model[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(shader_program, "normal_matrix"), 1, GL_FALSE, &plane_normal_matrix[0][0]);
+			glBindVertexArray(planeVAO);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, floor_texture);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}
+
+		if(reverse_z)
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, target.framebuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, 800, 600, 0, 0, 800, 600, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
 
 		SDL_GL_SwapWindow(window);
 		SDL_UpdateWindowSurface(window);
+		//keeps last frame's view-projection, for reprojection once there's
+		//a temporal pass (camera_set_jitter)
+		camera_next_frame(&camera);
+
+		Uint32 now = SDL_GetTicks();
+		stats_frames++;
+		stats_events += input_events;
+		if(input_events > 0)
+		{
+			Uint32 latency = now - input_time;
+			stats_latency_sum += latency;
+			stats_latency_count++;
+			if(latency > stats_latency_max)
+				stats_latency_max = latency;
+		}
+		if(now - stats_start >= 1000)
+		{
+			SDL_LogInfo(SDL_LOG_CATEGORY_TEST, "%.2f ms/frame, input latency %.1f ms (max %u ms), %.1f mouse events/frame",
+				(now - stats_start) / (double)stats_frames,
+				stats_latency_count ? stats_latency_sum / (double)stats_latency_count : 0.0,
+				stats_latency_max, stats_events / (double)stats_frames);
+			stats_start = now;
+			stats_frames = stats_events = 0;
+			stats_latency_sum = stats_latency_max = stats_latency_count = 0;
+		}
 	}
 
+	if(record_file != NULL && !camera_path_save(&path, record_file))
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "ERROR: can't save camera path %s", record_file);
+	camera_path_free(&path);
+
 	glDeleteVertexArrays(1, &planeVAO);
 	glDeleteBuffers(1, &planeVBO);
 	glDeleteProgram(shader_program);
+	if(reverse_z)
+	{
+		glDeleteFramebuffers(1, &target.framebuffer);
+		glDeleteRenderbuffers(1, &target.color);
+		glDeleteRenderbuffers(1, &target.depth);
+	}
 
 	//shutdown
 	SDL_GL_DeleteContext(context);
@@ -0,0 +1,367 @@
+/**
+ * Matheus' Tiny Blinn Phong
+ * Copyright 2023 Matheus Klein Schaefer
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/**
+ * @file scene_test.c
+ * @brief Checks the scene modules against brute force
+ *
+ * bvh: bvh_intersect, bvh_occluded, bvh_intersect_packet and
+ * bvh_intersect_batch against math_ray_triangle over the whole soup,
+ * for the SAH and the LBVH build, before and after bvh_refit. The
+ * leaves use the same ray/triangle test, so hits must have the same t;
+ * a different triangle is only accepted when it is hit at that same t.
+ *
+ * hierarchy: world matrices against a recursive parent * local walk in
+ * mat4, after the first update and after moving a few nodes.
+ *
+ * camera_array: view-projections against ts_camera, and camera_path: a
+ * save/load round trip.
+ *
+ * Everything runs at each math_simd level the CPU supports.
+ * ./scene_test exits with 1 on any mismatch.
+ *
+ * @author
+ * - Matheus Klein Schaefer
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "3d_math.h"
+#include "3d_math_simd.h"
+#include "bvh.h"
+#include "hierarchy.h"
+#include "camera.h"
+#include "camera_path.h"
+#include "camera_array.h"
+
+#define TRIS 2003
+#define RAYS 256 //multiple of MATH_RAY_PACKET
+#define NODES 500
+#define CAMERAS 67
+#define PATH_FILE "scene_test.path"
+
+/*
+ * Relative to max(1, |expected|). The mat4 walk and the mat4x3 tree
+ * round differently (FMA at AVX2), camera_array uses the batched sincos.
+*/
+#define TOLERANCE_WORLD 1e-5f
+#define TOLERANCE_CAMERA 1e-4f
+
+static float soup[TRIS * 9], moved[TRIS * 9];
+static ray rays[RAYS];
+static ray_hit hits[RAYS];
+
+static float frand(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rand() / (float)RAND_MAX;
+}
+
+static int close_enough(const float *a, const float *b, size_t count, float tolerance)
+{
+	for(size_t i = 0; i < count; i++)
+		if(!(fabsf(a[i] - b[i]) <= tolerance * fmaxf(1.0f, fabsf(b[i]))))
+			return 0;
+	return 1;
+}
+
+static void setup(void)
+{
+	srand(1);
+	//small triangles scattered in a 20 unit cube, a deformed copy for refit
+	for(size_t i = 0; i < TRIS; i++)
+	{
+		vec3 center = {frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f)};
+		for(int k = 0; k < 9; k++)
+		{
+			soup[i * 9 + k] = center[k % 3] + frand(-1.0f, 1.0f);
+			moved[i * 9 + k] = soup[i * 9 + k] + frand(-0.5f, 0.5f);
+		}
+	}
+
+	//from outside the cube towards it, every fourth one a short segment
+	//that starts inside, for t_min and t_max
+	for(size_t i = 0; i < RAYS; i++)
+	{
+		vec3 target = {frand(-8.0f, 8.0f), frand(-8.0f, 8.0f), frand(-8.0f, 8.0f)};
+		vec3 origin = {frand(-1.0f, 1.0f), frand(-1.0f, 1.0f), frand(-1.0f, 1.0f)};
+		math_vec3_normalize(origin);
+		math_vec3_scale(rays[i].origin, origin, 20.0f);
+		math_vec3_sub(rays[i].direction, target, rays[i].origin);
+		math_vec3_normalize(rays[i].direction);
+		rays[i].t_min = i % 4 == 3 ? frand(5.0f, 15.0f) : 0.0f;
+		rays[i].t_max = i % 4 == 3 ? rays[i].t_min + frand(1.0f, 10.0f) : 1000.0f;
+	}
+}
+
+static int brute_intersect(const float *vertices, const ray *r, ray_hit *hit)
+{
+	ray closest = *r;
+	hit->primitive = MATH_RAY_MISS;
+	for(size_t i = 0; i < TRIS; i++)
+	{
+		const float *v = vertices + i * 9;
+		ray_hit h;
+		if(math_ray_triangle(&h, &closest, (float *)v, (float *)v + 3, (float *)v + 6))
+		{
+			*hit = h;
+			hit->primitive = (uint32_t)i;
+			closest.t_max = h.t;
+		}
+	}
+	return hit->primitive != MATH_RAY_MISS;
+}
+
+//same hit as brute force, or a tie at the same t
+static int same_hit(const float *vertices, const ray *r, const ray_hit *expected, uint32_t primitive, float t)
+{
+	if(primitive == MATH_RAY_MISS || expected->primitive == MATH_RAY_MISS)
+		return primitive == expected->primitive;
+	if(t != expected->t || primitive >= TRIS)
+		return 0;
+	if(primitive == expected->primitive)
+		return 1;
+
+	const float *v = vertices + primitive * 9;
+	ray_hit h;
+	return math_ray_triangle(&h, r, (float *)v, (float *)v + 3, (float *)v + 6) && h.t == t;
+}
+
+static int check_bvh_queries(const ts_bvh *bvh, const float *vertices, const char *name)
+{
+	int failed = 0;
+	ray_hit expected[RAYS];
+	for(size_t i = 0; i < RAYS; i++)
+	{
+		brute_intersect(vertices, &rays[i], &expected[i]);
+
+		ray_hit hit;
+		int found = bvh_intersect(bvh, &rays[i], &hit);
+		failed |= found != (expected[i].primitive != MATH_RAY_MISS);
+		failed |= !same_hit(vertices, &rays[i], &expected[i], found ? hit.primitive : MATH_RAY_MISS, hit.t);
+		failed |= bvh_occluded(bvh, &rays[i]) != (expected[i].primitive != MATH_RAY_MISS);
+	}
+
+	for(size_t i = 0; i < RAYS; i += MATH_RAY_PACKET)
+	{
+		ray_packet packet;
+		ray_packet_hit hit;
+		math_ray_packet_from_rays(&packet, &rays[i], MATH_RAY_PACKET);
+		bvh_intersect_packet(bvh, &packet, &hit);
+		for(int lane = 0; lane < MATH_RAY_PACKET; lane++)
+			failed |= !same_hit(vertices, &rays[i + lane], &expected[i + lane], hit.primitive[lane], hit.t[lane]);
+	}
+
+	bvh_intersect_batch(bvh, rays, hits, RAYS);
+	for(size_t i = 0; i < RAYS; i++)
+		failed |= !same_hit(vertices, &rays[i], &expected[i], hits[i].primitive, hits[i].t);
+
+	if(failed)
+		printf("  bvh %-20s FAILED\n", name);
+	return failed;
+}
+
+static int check_bvh(void)
+{
+	int failures = 0;
+	for(int lbvh = 0; lbvh < 2; lbvh++)
+	{
+		ts_bvh bvh;
+		int built = lbvh ? bvh_build_lbvh(&bvh, soup, 3, TRIS, NULL) : bvh_build(&bvh, soup, 3, TRIS);
+		if(!built)
+		{
+			printf("  bvh build out of memory\n");
+			return 1;
+		}
+		failures += check_bvh_queries(&bvh, soup, lbvh ? "lbvh" : "sah");
+		bvh_refit(&bvh, moved, 3);
+		failures += check_bvh_queries(&bvh, moved, lbvh ? "lbvh refit" : "sah refit");
+		bvh_free(&bvh);
+	}
+	return failures;
+}
+
+static void reference_world(mat4 *world, uint8_t *done, const uint32_t *parents, const mat4x3 *locals, uint32_t node)
+{
+	if(done[node])
+		return;
+	math_mat4x3_to_mat4(world[node], (float (*)[3])locals[node]);
+	if(parents[node] != HIERARCHY_NONE)
+	{
+		reference_world(world, done, parents, locals, parents[node]);
+		math_mat4_mul(world[node], world[node], world[parents[node]]);
+	}
+	done[node] = 1;
+}
+
+static int compare_worlds(ts_hierarchy *tree, const uint32_t *parents, const mat4x3 *locals)
+{
+	static mat4 expected[NODES];
+	static uint8_t done[NODES];
+	memset(done, 0, sizeof(done));
+
+	int failed = 0;
+	for(uint32_t i = 0; i < NODES; i++)
+	{
+		mat4x3 world;
+		mat4 world4;
+		reference_world(expected, done, parents, locals, i);
+		hierarchy_get_world(tree, i, world);
+		math_mat4x3_to_mat4(world4, world);
+		failed |= !close_enough(&world4[0][0], &expected[i][0][0], 16, TOLERANCE_WORLD);
+	}
+	return failed;
+}
+
+static void random_local(ts_hierarchy *tree, mat4x3 *locals, uint32_t node)
+{
+	vec3 translation = {frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f)};
+	vec3 axis = {frand(-1.0f, 1.0f), frand(-1.0f, 1.0f), frand(-1.0f, 1.0f)};
+	vec3 scale = {frand(0.5f, 1.5f), frand(0.5f, 1.5f), frand(0.5f, 1.5f)};
+	quat rotation;
+	math_vec3_normalize(axis);
+	math_quat_from_axis_angle(rotation, axis, frand(-3.0f, 3.0f));
+	hierarchy_set_local(tree, node, translation, rotation, scale);
+	math_mat4x3_compose(locals[node], translation, rotation, scale);
+}
+
+static int check_hierarchy(void)
+{
+	static uint32_t parents[NODES], order[NODES];
+	static mat4x3 locals[NODES];
+	ts_hierarchy tree;
+
+	//random forest, then node numbers shuffled so parents can come after children
+	for(uint32_t i = 0; i < NODES; i++)
+		order[i] = i;
+	for(uint32_t i = NODES - 1; i > 0; i--)
+	{
+		uint32_t j = (uint32_t)rand() % (i + 1);
+		uint32_t swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+	for(uint32_t i = 0; i < NODES; i++)
+		parents[order[i]] = i == 0 || rand() % 10 == 0 ? HIERARCHY_NONE : order[(uint32_t)rand() % i];
+
+	if(!hierarchy_init(&tree, parents, NODES))
+	{
+		printf("  hierarchy_init FAILED\n");
+		return 1;
+	}
+	for(uint32_t i = 0; i < NODES; i++)
+		random_local(&tree, locals, i);
+	hierarchy_update(&tree);
+	int failed = compare_worlds(&tree, parents, locals);
+
+	//a few moved nodes must drag their subtrees along
+	for(int k = 0; k < 16; k++)
+		random_local(&tree, locals, (uint32_t)rand() % NODES);
+	hierarchy_update(&tree);
+	failed |= compare_worlds(&tree, parents, locals);
+
+	hierarchy_free(&tree);
+	if(failed)
+		printf("  hierarchy world matrices FAILED\n");
+	return failed;
+}
+
+static void random_camera(ts_camera *camera)
+{
+	camera_initialize(camera, (vec3){frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f)});
+	camera_set_angles(camera, frand(-360.0f, 360.0f), frand(-80.0f, 80.0f), 0.0f);
+	camera_set_zoom(camera, frand(20.0f, 90.0f));
+	camera_set_projection(camera, frand(1.0f, 2.0f), frand(0.1f, 1.0f), frand(100.0f, 1000.0f));
+	camera_set_projection_mode(camera, rand() % 3);
+}
+
+static int check_camera_array(void)
+{
+	static ts_camera cameras[CAMERAS];
+	ts_camera_array array;
+	if(!camera_array_init(&array, CAMERAS))
+	{
+		printf("  camera_array_init FAILED\n");
+		return 1;
+	}
+
+	for(size_t i = 0; i < CAMERAS; i++)
+	{
+		random_camera(&cameras[i]);
+		camera_array_set(&array, i, &cameras[i]);
+	}
+	camera_array_update(&array);
+
+	int failed = 0;
+	for(size_t i = 0; i < CAMERAS; i++)
+	{
+		mat4 expected, round_trip;
+		ts_camera copy;
+		camera_get_view_projection(&cameras[i], expected);
+		failed |= !close_enough(&array.view_projection[i][0][0], &expected[0][0], 16, TOLERANCE_CAMERA);
+
+		//get gives back the same ts_camera
+		camera_array_get(&array, i, &copy);
+		camera_get_view_projection(&copy, round_trip);
+		failed |= memcmp(round_trip, expected, sizeof(mat4)) != 0;
+	}
+
+	camera_array_free(&array);
+	if(failed)
+		printf("  camera_array FAILED\n");
+	return failed;
+}
+
+static int check_camera_path(void)
+{
+	ts_camera_path path, loaded;
+	ts_camera camera;
+	camera_path_init(&path);
+	for(int i = 0; i < 8; i++)
+	{
+		random_camera(&camera);
+		camera_path_record(&path, &camera, i * 0.5f);
+	}
+
+	int failed = !camera_path_save(&path, PATH_FILE) || !camera_path_load(&loaded, PATH_FILE);
+	failed |= !failed && (loaded.count != path.count ||
+		memcmp(loaded.keys, path.keys, path.count * sizeof(camera_key)) != 0);
+	camera_path_free(&loaded);
+	remove(PATH_FILE);
+	failed |= camera_path_load(&loaded, PATH_FILE);
+
+	camera_path_free(&path);
+	camera_path_free(&loaded);
+	if(failed)
+		printf("camera_path save/load  FAILED\n");
+	return failed;
+}
+
+int main(void)
+{
+	setup();
+	int failures = check_camera_path();
+	int detected = math_simd_detect();
+
+	for(int level = MATH_SIMD_SCALAR; level <= detected; level++)
+	{
+		math_simd_set_level(level);
+		printf("%s:\n", math_simd_level_name(level));
+		failures += check_bvh();
+		failures += check_hierarchy();
+		failures += check_camera_array();
+	}
+
+	if(failures > 0)
+		printf("%d failure(s)\n", failures);
+	else
+		printf("ok\n");
+	return failures > 0;
+}